@@ -0,0 +1,287 @@
+// 本机编译守护进程：同一台机器上的多个渲染进程共用的 GLSL -> SPIR-V 编译和 VkPipelineCache 存储。
+// 用法：ShaderCompileDaemon [socket 路径] [缓存目录]
+// 同时到达的相同请求只编译一次，结果写到缓存目录，守护进程重启后依然有效。
+
+#include "CompileProtocol.h"
+#include "Hash.h"
+
+#include <shaderc/shaderc.hpp>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct Result
+{
+    uint32_t status = CompileStatusOk;
+    std::vector<char> data;
+};
+
+static bool readBinary(const fs::path& path, std::vector<char>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    std::string text = stream.str();
+    data.assign(text.begin(), text.end());
+    return true;
+}
+
+// 先写临时文件再改名，客户端和其他线程不会读到一半
+static void writeBinary(const fs::path& path, const std::vector<char>& data)
+{
+    fs::path tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary);
+        out.write(data.data(), data.size());
+    }
+    std::error_code error;
+    fs::rename(tempPath, path, error);
+}
+
+static std::string keyName(const char* prefix, uint64_t key, const char* extension)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%016llx%s", prefix, (unsigned long long)key, extension);
+    return name;
+}
+
+class CompileDaemon
+{
+public:
+    explicit CompileDaemon(std::string cacheDir) : cacheDir(std::move(cacheDir))
+    {
+        std::error_code error;
+        fs::create_directories(this->cacheDir, error);
+    }
+
+    void serve(int fd)
+    {
+        RequestHeader header{};
+        std::vector<char> payload;
+        if (!readAll(fd, &header, sizeof(header)) || header.magic != CompileProtocolMagic || header.payloadSize > MaxCompilePayload)
+        {
+            ::close(fd);
+            return;
+        }
+        payload.resize(header.payloadSize);
+        if (!payload.empty() && !readAll(fd, payload.data(), payload.size()))
+        {
+            ::close(fd);
+            return;
+        }
+
+        Result result;
+        switch (header.op)
+        {
+        case CompileOpGlsl:
+            result = compileGlsl(header.kind, header.flags, std::string(payload.begin(), payload.end()));
+            break;
+        case CompileOpGetPipelineCache:
+            result = getPipelineCache(header.key);
+            break;
+        case CompileOpPutPipelineCache:
+            result = putPipelineCache(header.key, payload);
+            break;
+        default:
+        {
+            const std::string message = "unknown op";
+            result.status = CompileStatusError;
+            result.data.assign(message.begin(), message.end());
+            break;
+        }
+        }
+
+        ResponseHeader reply{ result.status, 0, result.data.size() };
+        if (writeAll(fd, &reply, sizeof(reply)) && !result.data.empty())
+        {
+            writeAll(fd, result.data.data(), result.data.size());
+        }
+        ::close(fd);
+    }
+
+private:
+    Result compileGlsl(uint32_t kind, uint32_t flags, const std::string& text)
+    {
+        // 和客户端的磁盘缓存一样：预处理结果 + 编译器版本 + 选项
+        unsigned int spvVersion = 0;
+        unsigned int spvRevision = 0;
+        shaderc_get_spv_version(&spvVersion, &spvRevision);
+        uint64_t key = hashBytes(text.data(), text.size());
+        key = hashCombine(key, (uint64_t)spvVersion << 32 | spvRevision);
+        key = hashCombine(key, kind);
+        key = hashCombine(key, flags);
+
+        std::promise<Result> promise;
+        std::shared_future<Result> future;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = inFlight.find(key);
+            if (it != inFlight.end())
+            {
+                future = it->second;
+                deduplicated++;
+            }
+            else
+            {
+                future = promise.get_future().share();
+                inFlight.emplace(key, future);
+                owner = true;
+            }
+        }
+        if (!owner)
+        {
+            return future.get();
+        }
+
+        Result result;
+        const fs::path cachePath = fs::path(cacheDir) / keyName("", key, ".spv");
+        if (readBinary(cachePath, result.data) && !result.data.empty())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            diskHits++;
+        }
+        else
+        {
+            shaderc::CompileOptions options;
+            options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_1);
+            options.SetOptimizationLevel(shaderc_optimization_level_zero);
+            if (flags & CompileFlagDebugInfo)
+            {
+                options.SetGenerateDebugInfo();
+            }
+            shaderc::Compiler compiler;
+            shaderc::SpvCompilationResult compiled = compiler.CompileGlslToSpv(text, static_cast<shaderc_shader_kind>(kind), "daemon", options);
+            if (compiled.GetCompilationStatus() == shaderc_compilation_status_success)
+            {
+                result.data.assign(reinterpret_cast<const char*>(compiled.cbegin()), reinterpret_cast<const char*>(compiled.cend()));
+                writeBinary(cachePath, result.data);
+                std::lock_guard<std::mutex> lock(mutex);
+                compiledCount++;
+            }
+            else
+            {
+                std::string message = compiled.GetErrorMessage();
+                result.status = CompileStatusError;
+                result.data.assign(message.begin(), message.end());
+            }
+        }
+
+        promise.set_value(result);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlight.erase(key);
+            std::cout << "glsl " << keyName("", key, "") << ": compiled " << compiledCount << ", disk hits " << diskHits
+                << ", deduplicated " << deduplicated << std::endl;
+        }
+        return result;
+    }
+
+    Result getPipelineCache(uint64_t key)
+    {
+        Result result;
+        std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+        if (!readBinary(fs::path(cacheDir) / keyName("pipeline_", key, ".bin"), result.data) || result.data.empty())
+        {
+            result.status = CompileStatusMiss;
+            result.data.clear();
+        }
+        return result;
+    }
+
+    Result putPipelineCache(uint64_t key, const std::vector<char>& data)
+    {
+        // 守护进程没有 device，合并不了；客户端存之前先取回当前的数据用 vkMergePipelineCaches 合并，这里直接覆盖
+        std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+        writeBinary(fs::path(cacheDir) / keyName("pipeline_", key, ".bin"), data);
+        return Result{};
+    }
+
+    std::string cacheDir;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_future<Result>> inFlight;
+    uint32_t compiledCount = 0;
+    uint32_t diskHits = 0;
+    uint32_t deduplicated = 0;
+    std::mutex pipelineCacheMutex;
+};
+
+int main(int argc, char** argv)
+{
+    const std::string socketPath = argc > 1 ? argv[1] : defaultCompileDaemonSocket();
+    const std::string cacheDir = argc > 2 ? argv[2] : "compile_daemon_cache";
+
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        std::perror("socket");
+        return EXIT_FAILURE;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    // 上次异常退出留下的 socket 文件
+    ::unlink(socketPath.c_str());
+    // 缓存里的 SPIR-V 和 pipeline cache 会被直接拿去用，socket 只让同一个用户连；bind 时就按 0600 创建，不留空档
+    mode_t oldMask = ::umask(0077);
+    bool bound = ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    ::umask(oldMask);
+    if (!bound || ::chmod(socketPath.c_str(), 0600) != 0 || ::listen(listenFd, 64) != 0)
+    {
+        std::perror("bind");
+        return EXIT_FAILURE;
+    }
+    std::cout << "compile daemon listening on " << socketPath << ", cache " << cacheDir << std::endl;
+
+    // 连接线程 detach 之后可能比这个循环活得久，各自持有一份 daemon 的引用
+    auto daemon = std::make_shared<CompileDaemon>(cacheDir);
+    for (;;)
+    {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::perror("accept");
+            break;
+        }
+        // socket 已经是 0600，这里再挡一次：别的用户写进缓存的东西会被当成可信的结果发给客户端
+        if (!peerIsSameUser(fd))
+        {
+            ::close(fd);
+            continue;
+        }
+        std::thread([daemon, fd] { daemon->serve(fd); }).detach();
+    }
+
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+    return EXIT_SUCCESS;
+}
@@ -3,4 +3,8 @@ glslc.exe shader.frag -o frag.spv
 glslc.exe shader.tesc -o tesc.spv
 glslc.exe shader.tese -o tese.spv
 glslc.exe shader.geom -o geom.spv
+glslc.exe depth_prepass.vert -o depth_prepass_vert.spv
+glslc.exe gbuffer.frag -o gbuffer_frag.spv
+glslc.exe lighting.vert -o lighting_vert.spv
+glslc.exe lighting.frag -o lighting_frag.spv
 pause
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 450
+
+// depth pre-pass 只需要位置，不输出颜色，也没有 fragment shader
+layout(location = 0) in vec2 inPosition;
+
+layout(push_constant) uniform DrawConstants {
+    vec2 offset;
+    float scale;
+    float depth;
+} draw;
+
+// pre-pass 和主 pass 的深度必须逐位相同，EQUAL 测试才不会丢片元
+invariant gl_Position;
+
+void main() {
+    gl_Position = vec4(inPosition * draw.scale + draw.offset, draw.depth, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 450
+
+// deferred 的几何 subpass：只写 G-buffer，光照在 lighting.frag 里做
+layout(location = 0) in vec3 inColor;
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+
+void main() {
+    outAlbedo = vec4(inColor, 1.0);
+    // 场景都是朝向相机的三角形，用颜色扰动出法线让光照有变化
+    vec3 normal = normalize(vec3(inColor.rg * 2.0 - 1.0, 1.0));
+    outNormal = vec4(normal * 0.5 + 0.5, 1.0);
+}
@@ -0,0 +1,28 @@
+#version 450
+
+// G-buffer 作为 input attachment 读，只能读当前像素，tiler 上数据不离开片上内存
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput inAlbedo;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput inNormal;
+
+layout(location = 0) out vec4 outColor;
+
+const int LightCount = 4;
+const vec3 lightDirections[LightCount] = vec3[](
+    vec3(0.5, 0.5, 1.0), vec3(-0.7, 0.2, 0.6), vec3(0.1, -0.8, 0.5), vec3(-0.3, -0.3, 1.0));
+const vec3 lightColors[LightCount] = vec3[](
+    vec3(0.9, 0.8, 0.7), vec3(0.2, 0.3, 0.6), vec3(0.4, 0.2, 0.1), vec3(0.2, 0.2, 0.2));
+
+void main() {
+    vec4 albedo = subpassLoad(inAlbedo);
+    if (albedo.a == 0.0) {
+        // 没有被几何覆盖的像素保持清屏颜色
+        outColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+    vec3 normal = normalize(subpassLoad(inNormal).xyz * 2.0 - 1.0);
+    vec3 lighting = vec3(0.05);
+    for (int i = 0; i < LightCount; i++) {
+        lighting += lightColors[i] * max(dot(normal, normalize(lightDirections[i])), 0.0);
+    }
+    outColor = vec4(albedo.rgb * lighting, 1.0);
+}
@@ -4,7 +4,17 @@ layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 layout (location = 0) out vec3 color;
 
+// 每个 draw 一份，depth_prepass.vert 里必须保持一致
+layout(push_constant) uniform DrawConstants {
+    vec2 offset;
+    float scale;
+    float depth;
+} draw;
+
+// pre-pass 和主 pass 的深度必须逐位相同，EQUAL 测试才不会丢片元
+invariant gl_Position;
+
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 1.0);
+    gl_Position = vec4(inPosition * draw.scale + draw.offset, draw.depth, 1.0);
     color = inColor;
 }
@@ -0,0 +1,146 @@
+#include "ApiCallCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// 包装函数用到的状态。pipeline library 的后台线程也会调 Vulkan，计数用 relaxed 原子
+static std::atomic<uint32_t> currentCounts[VulkanFunctionCount];
+static PFN_vkVoidFunction realFunctions[VulkanFunctionCount];
+static VulkanDispatch realDispatch;
+
+static uint32_t lastCounts[VulkanFunctionCount];
+static uint32_t maxCounts[VulkanFunctionCount];
+static uint64_t totalCounts[VulkanFunctionCount];
+static uint64_t startupCounts[VulkanFunctionCount];
+
+bool ApiCallCounter::active = false;
+uint64_t ApiCallCounter::frameCount = 0;
+
+template <VulkanFunctionId Id, typename Function>
+struct CountingThunk;
+
+template <VulkanFunctionId Id, typename Result, typename... Args>
+struct CountingThunk<Id, Result (VKAPI_PTR*)(Args...)>
+{
+    static Result VKAPI_PTR call(Args... args)
+    {
+        currentCounts[Id].fetch_add(1, std::memory_order_relaxed);
+        return reinterpret_cast<Result (VKAPI_PTR*)(Args...)>(realFunctions[Id])(args...);
+    }
+};
+
+void ApiCallCounter::setEnabled(bool enabled)
+{
+    if (enabled == active)
+    {
+        return;
+    }
+    if (enabled)
+    {
+        realDispatch = vkd;
+#define VULKAN_INSTALL_THUNK(name) \
+        realFunctions[name##Id] = reinterpret_cast<PFN_vkVoidFunction>(realDispatch.name); \
+        vkd.name = &CountingThunk<name##Id, PFN_##name>::call;
+        VULKAN_DEVICE_FUNCTIONS(VULKAN_INSTALL_THUNK)
+#undef VULKAN_INSTALL_THUNK
+    }
+    else
+    {
+        vkd = realDispatch;
+    }
+    active = enabled;
+}
+
+void ApiCallCounter::endStartup()
+{
+    for (uint32_t i = 0; i < VulkanFunctionCount; i++)
+    {
+        startupCounts[i] += currentCounts[i].exchange(0, std::memory_order_relaxed);
+    }
+}
+
+void ApiCallCounter::endFrame()
+{
+    if (!active)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < VulkanFunctionCount; i++)
+    {
+        uint32_t count = currentCounts[i].exchange(0, std::memory_order_relaxed);
+        lastCounts[i] = count;
+        maxCounts[i] = std::max(maxCounts[i], count);
+        totalCounts[i] += count;
+    }
+    frameCount++;
+}
+
+uint32_t ApiCallCounter::lastFrameCount(VulkanFunctionId id)
+{
+    return lastCounts[id];
+}
+
+uint32_t ApiCallCounter::maxFrameCount(VulkanFunctionId id)
+{
+    return maxCounts[id];
+}
+
+uint64_t ApiCallCounter::totalFrameCount(VulkanFunctionId id)
+{
+    return totalCounts[id];
+}
+
+uint64_t ApiCallCounter::startupCount(VulkanFunctionId id)
+{
+    return startupCounts[id];
+}
+
+void ApiCallCounter::printReport()
+{
+    if (!active)
+    {
+        return;
+    }
+    std::cout << "vulkan api calls (startup, then per frame last / avg / max over " << frameCount << " frames):" << std::endl;
+    for (uint32_t i = 0; i < VulkanFunctionCount; i++)
+    {
+        if (startupCounts[i] == 0 && totalCounts[i] == 0)
+        {
+            continue;
+        }
+        std::cout << "  " << vulkanFunctionName(static_cast<VulkanFunctionId>(i)) << ": " << startupCounts[i];
+        if (totalCounts[i] > 0)
+        {
+            std::cout << ", " << lastCounts[i] << " / " << static_cast<double>(totalCounts[i]) / frameCount << " / " << maxCounts[i];
+        }
+        std::cout << std::endl;
+    }
+}
+
+bool ApiCallCounter::exportJson(const std::string& path)
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "failed to write api call counts " << path << std::endl;
+        return false;
+    }
+    file << std::fixed << std::setprecision(3) << "{\"frames\":" << frameCount << ",\"functions\":{";
+    bool first = true;
+    for (uint32_t i = 0; i < VulkanFunctionCount; i++)
+    {
+        if (startupCounts[i] == 0 && totalCounts[i] == 0)
+        {
+            continue;
+        }
+        file << (first ? "\n" : ",\n") << "\"" << vulkanFunctionName(static_cast<VulkanFunctionId>(i)) << "\":{\"startup\":" << startupCounts[i]
+            << ",\"last\":" << lastCounts[i] << ",\"avg\":" << (frameCount ? static_cast<double>(totalCounts[i]) / frameCount : 0.0)
+            << ",\"max\":" << maxCounts[i] << "}";
+        first = false;
+    }
+    file << "\n}}" << std::endl;
+    return true;
+}
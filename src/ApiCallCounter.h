@@ -0,0 +1,37 @@
+#pragma once
+
+#include "VulkanDispatch.h"
+
+#include <cstdint>
+#include <string>
+
+// 统计 vkd 里每个 device 级函数的调用次数。
+// 打开时把 vkd 的指针换成先原子加一再转发的包装函数，关掉时恢复原来的指针，不打开就没有任何额外开销。
+// 初始化阶段的调用单独算一份，之后每帧 endFrame 时把这一帧的计数存下来清零
+class ApiCallCounter
+{
+public:
+    // vkd 换入口（VulkanDispatch::load）之前要先关掉，换完再打开，计数不会清零
+    static void setEnabled(bool enabled);
+    static bool enabled() { return active; }
+
+    // 第一次 present 之后调用一次，之前的调用记为启动阶段
+    static void endStartup();
+    // 每帧 present 之后调用
+    static void endFrame();
+
+    static uint64_t frames() { return frameCount; }
+    // 最近一个完整帧里的调用次数
+    static uint32_t lastFrameCount(VulkanFunctionId id);
+    static uint32_t maxFrameCount(VulkanFunctionId id);
+    static uint64_t totalFrameCount(VulkanFunctionId id);
+    static uint64_t startupCount(VulkanFunctionId id);
+
+    static void printReport();
+    // 给 CI 对比用的 JSON：每个函数的启动次数和每帧的 last / avg / max
+    static bool exportJson(const std::string& path);
+
+private:
+    static bool active;
+    static uint64_t frameCount;
+};
@@ -0,0 +1,491 @@
+#include "BarrierBatch.h"
+#include "VulkanDispatch.h"
+
+#include <iostream>
+#include <stdexcept>
+
+static const VkAccessFlags2 WriteAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT |
+    VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+struct UsageInfo
+{
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    bool write;
+};
+
+static UsageInfo usageInfo(ResourceUsage usage)
+{
+    switch (usage)
+    {
+    case ResourceUsage::ColorAttachmentWrite:
+        return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+    case ResourceUsage::DepthStencilAttachmentWrite:
+        return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+    case ResourceUsage::DepthStencilAttachmentRead:
+        return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false };
+    case ResourceUsage::FragmentSampledRead:
+        return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+    case ResourceUsage::FragmentInputAttachmentRead:
+        return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+    case ResourceUsage::ComputeStorageRead:
+        return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+    case ResourceUsage::ComputeStorageWrite:
+        return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, true };
+    case ResourceUsage::TransferRead:
+        return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+    case ResourceUsage::TransferWrite:
+        return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+    case ResourceUsage::Present:
+        // present 由 semaphore 等待，barrier 只做布局转换
+        return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false };
+    case ResourceUsage::VertexBufferRead:
+        return { VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+    case ResourceUsage::IndexBufferRead:
+        return { VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+    case ResourceUsage::UniformRead:
+        return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_UNIFORM_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false };
+    case ResourceUsage::IndirectRead:
+        return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+    }
+    throw std::runtime_error("unknown resource usage!");
+}
+
+// 低 32 位和旧的 VkPipelineStageFlagBits 一样，高位是 synchronization2 拆细的阶段，归回原来的大阶段
+static VkPipelineStageFlags legacyStages(VkPipelineStageFlags2 stages, bool src)
+{
+    VkPipelineStageFlags result = static_cast<VkPipelineStageFlags>(stages & 0xFFFFFFFFull);
+    if (stages & (VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT))
+    {
+        result |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    if (stages & (VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT))
+    {
+        result |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    if (stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT)
+    {
+        result |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+            VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT;
+    }
+    if (result == 0)
+    {
+        result = src ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+    return result;
+}
+
+static VkAccessFlags legacyAccess(VkAccessFlags2 access)
+{
+    VkAccessFlags result = static_cast<VkAccessFlags>(access & 0xFFFFFFFFull);
+    if (access & (VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT))
+    {
+        result |= VK_ACCESS_SHADER_READ_BIT;
+    }
+    if (access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT)
+    {
+        result |= VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    return result;
+}
+
+static bool overlaps(const VkImageSubresourceRange& a, const VkImageSubresourceRange& b)
+{
+    return (a.aspectMask & b.aspectMask) != 0 &&
+        a.baseMipLevel < b.baseMipLevel + b.levelCount && b.baseMipLevel < a.baseMipLevel + a.levelCount &&
+        a.baseArrayLayer < b.baseArrayLayer + b.layerCount && b.baseArrayLayer < a.baseArrayLayer + a.layerCount;
+}
+
+static bool contains(const VkImageSubresourceRange& outer, const VkImageSubresourceRange& inner)
+{
+    return (outer.aspectMask & inner.aspectMask) == inner.aspectMask &&
+        outer.baseMipLevel <= inner.baseMipLevel && inner.baseMipLevel + inner.levelCount <= outer.baseMipLevel + outer.levelCount &&
+        outer.baseArrayLayer <= inner.baseArrayLayer && inner.baseArrayLayer + inner.layerCount <= outer.baseArrayLayer + outer.layerCount;
+}
+
+void BarrierBatch::load(const FeatureFlags& coreFeatures)
+{
+    // 打开了 synchronization2 说明协商到了 1.3，vkd 里的 vkCmdPipelineBarrier2 一定取到了
+    useSynchronization2 = coreFeatures.synchronization2 && vkd.vkCmdPipelineBarrier2 != nullptr;
+}
+
+void BarrierBatch::imageBarrier(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+    VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess)
+{
+    requested++;
+    // 和已经攒着的 barrier 范围重叠：同一个依赖换了个目标阶段，或者接在它后面（等的正是它的目标阶段，布局也不再变），
+    // 都并进去，只是多等一些阶段。同一次调用里的 barrier 之间没有先后，别的情况只能在中间 flush
+    for (auto& pending : imageBarriers)
+    {
+        if (pending.image != image || !overlaps(pending.subresourceRange, range))
+        {
+            continue;
+        }
+        bool sameTransition = pending.srcStageMask == srcStages && pending.srcAccessMask == srcAccess &&
+            pending.oldLayout == oldLayout && pending.newLayout == newLayout;
+        bool chained = oldLayout == pending.newLayout && newLayout == pending.newLayout && (srcStages & ~pending.dstStageMask) == 0;
+        if (!contains(pending.subresourceRange, range) || (!sameTransition && !chained))
+        {
+            throw std::runtime_error("conflicting barriers on the same subresources in one batch, flush between the commands!");
+        }
+        pending.dstStageMask |= dstStages;
+        pending.dstAccessMask |= dstAccess;
+        merged++;
+        return;
+    }
+
+    // 参数完全一样的接成一个更大的范围：同样 mip 范围的下一组 layer，或者同样 layer 范围的下一级 mip
+    for (size_t i = 0; i < imageBarriers.size(); i++)
+    {
+        VkImageMemoryBarrier2& pending = imageBarriers[i];
+        if (pending.image != image || pending.oldLayout != oldLayout || pending.newLayout != newLayout ||
+            pending.srcStageMask != srcStages || pending.srcAccessMask != srcAccess ||
+            pending.dstStageMask != dstStages || pending.dstAccessMask != dstAccess || pending.subresourceRange.aspectMask != range.aspectMask)
+        {
+            continue;
+        }
+        VkImageSubresourceRange& pendingRange = pending.subresourceRange;
+        if (pendingRange.baseMipLevel == range.baseMipLevel && pendingRange.levelCount == range.levelCount &&
+            pendingRange.baseArrayLayer + pendingRange.layerCount == range.baseArrayLayer)
+        {
+            pendingRange.layerCount += range.layerCount;
+            merged++;
+            mergeMipNeighbour(i);
+            return;
+        }
+        if (pendingRange.baseArrayLayer == range.baseArrayLayer && pendingRange.layerCount == range.layerCount &&
+            pendingRange.baseMipLevel + pendingRange.levelCount == range.baseMipLevel)
+        {
+            pendingRange.levelCount += range.levelCount;
+            merged++;
+            return;
+        }
+    }
+
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = srcStages;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstStageMask = dstStages;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    imageBarriers.push_back(barrier);
+}
+
+void BarrierBatch::mergeMipNeighbour(size_t index)
+{
+    // 一级 mip 的 layer 接满之后，可能正好和上一级 mip 的范围一样，并到上一级里
+    const VkImageMemoryBarrier2& barrier = imageBarriers[index];
+    for (size_t i = 0; i < imageBarriers.size(); i++)
+    {
+        VkImageMemoryBarrier2& pending = imageBarriers[i];
+        if (i == index || pending.image != barrier.image || pending.oldLayout != barrier.oldLayout || pending.newLayout != barrier.newLayout ||
+            pending.srcStageMask != barrier.srcStageMask || pending.srcAccessMask != barrier.srcAccessMask ||
+            pending.dstStageMask != barrier.dstStageMask || pending.dstAccessMask != barrier.dstAccessMask ||
+            pending.subresourceRange.aspectMask != barrier.subresourceRange.aspectMask ||
+            pending.subresourceRange.baseArrayLayer != barrier.subresourceRange.baseArrayLayer ||
+            pending.subresourceRange.layerCount != barrier.subresourceRange.layerCount ||
+            pending.subresourceRange.baseMipLevel + pending.subresourceRange.levelCount != barrier.subresourceRange.baseMipLevel)
+        {
+            continue;
+        }
+        pending.subresourceRange.levelCount += barrier.subresourceRange.levelCount;
+        imageBarriers.erase(imageBarriers.begin() + index);
+        merged++;
+        return;
+    }
+}
+
+void BarrierBatch::bufferBarrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+    VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess)
+{
+    requested++;
+    for (auto& pending : bufferBarriers)
+    {
+        if (pending.buffer != buffer || pending.offset != offset || pending.size != size)
+        {
+            continue;
+        }
+        bool sameSource = pending.srcStageMask == srcStages && pending.srcAccessMask == srcAccess;
+        bool chained = (srcStages & ~pending.dstStageMask) == 0;
+        if (!sameSource && !chained)
+        {
+            throw std::runtime_error("conflicting barriers on the same buffer range in one batch, flush between the commands!");
+        }
+        pending.dstStageMask |= dstStages;
+        pending.dstAccessMask |= dstAccess;
+        merged++;
+        return;
+    }
+
+    VkBufferMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    barrier.srcStageMask = srcStages;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstStageMask = dstStages;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    bufferBarriers.push_back(barrier);
+}
+
+void BarrierBatch::memoryBarrier(VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages,
+    VkAccessFlags2 dstAccess)
+{
+    requested++;
+    if (hasMemoryBarrier)
+    {
+        merged++;
+    }
+    else
+    {
+        memory = {};
+        memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        hasMemoryBarrier = true;
+    }
+    memory.srcStageMask |= srcStages;
+    memory.srcAccessMask |= srcAccess;
+    memory.dstStageMask |= dstStages;
+    memory.dstAccessMask |= dstAccess;
+}
+
+void BarrierBatch::registerImage(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevels, uint32_t arrayLayers, VkImageLayout layout,
+    VkPipelineStageFlags2 pendingStages, VkAccessFlags2 pendingAccess)
+{
+    TrackedImage& tracked = images[image];
+    tracked.aspect = aspect;
+    tracked.mipLevels = mipLevels;
+    tracked.arrayLayers = arrayLayers;
+    tracked.subresources.assign(mipLevels * arrayLayers, State{});
+    for (State& state : tracked.subresources)
+    {
+        state.layout = layout;
+        state.writeStages = pendingStages;
+        state.writeAccess = pendingAccess;
+    }
+}
+
+void BarrierBatch::forgetImage(VkImage image)
+{
+    images.erase(image);
+}
+
+BarrierBatch::Dependency BarrierBatch::advance(State& state, ResourceUsage usage, bool isImage)
+{
+    UsageInfo info = usageInfo(usage);
+    Dependency dependency;
+    dependency.oldLayout = state.layout;
+    bool layoutChange = isImage && info.layout != state.layout;
+
+    // 写、布局转换要等之前所有的读写；读只在还没看到上一次写入的阶段 / access 上等
+    if (layoutChange || info.write)
+    {
+        dependency.srcStages = state.writeStages | state.readStages;
+        dependency.srcAccess = state.writeAccess;
+        dependency.needed = layoutChange || dependency.srcStages != 0;
+        if (isImage)
+        {
+            state.layout = info.layout;
+        }
+        state.writeStages = info.stages;
+        state.writeAccess = info.write ? info.access & WriteAccessMask : 0;
+        state.readStages = info.write ? 0 : info.stages;
+        state.readAccess = info.write ? 0 : info.access;
+    }
+    else
+    {
+        if (state.writeStages != 0 && ((state.readStages & info.stages) != info.stages || (state.readAccess & info.access) != info.access))
+        {
+            dependency.srcStages = state.writeStages;
+            dependency.srcAccess = state.writeAccess;
+            dependency.needed = true;
+        }
+        state.readStages |= info.stages;
+        state.readAccess |= info.access;
+    }
+    return dependency;
+}
+
+void BarrierBatch::useImage(VkImage image, ResourceUsage usage)
+{
+    auto it = images.find(image);
+    if (it == images.end())
+    {
+        throw std::runtime_error("image used before registerImage!");
+    }
+    useImage(image, usage, 0, it->second.mipLevels, 0, it->second.arrayLayers);
+}
+
+void BarrierBatch::useImage(VkImage image, ResourceUsage usage, uint32_t baseMip, uint32_t mipCount, uint32_t baseLayer, uint32_t layerCount)
+{
+    auto it = images.find(image);
+    if (it == images.end())
+    {
+        throw std::runtime_error("image used before registerImage!");
+    }
+    TrackedImage& tracked = it->second;
+    if (baseMip + mipCount > tracked.mipLevels || baseLayer + layerCount > tracked.arrayLayers)
+    {
+        throw std::runtime_error("image subresource range out of bounds!");
+    }
+    UsageInfo info = usageInfo(usage);
+
+    // 中途 imageBarrier 报冲突时，已经推进的状态和并进去的 barrier 都要退回去，调用者 flush 之后还能重来
+    std::vector<State> savedStates = tracked.subresources;
+    std::vector<VkImageMemoryBarrier2> savedBarriers = imageBarriers;
+    uint64_t savedRequested = requested;
+    uint64_t savedMerged = merged;
+    try
+    {
+        // 按 subresource 逐个出 barrier，由 imageBarrier 并回已有的 barrier 或者接成大的范围
+        for (uint32_t mip = baseMip; mip < baseMip + mipCount; mip++)
+        {
+            for (uint32_t layer = baseLayer; layer < baseLayer + layerCount; layer++)
+            {
+                Dependency dependency = advance(tracked.subresources[mip * tracked.arrayLayers + layer], usage, true);
+                if (dependency.needed)
+                {
+                    imageBarrier(image, { tracked.aspect, mip, 1, layer, 1 }, dependency.oldLayout, info.layout,
+                        dependency.srcStages, dependency.srcAccess, info.stages, info.access);
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        tracked.subresources = std::move(savedStates);
+        imageBarriers = std::move(savedBarriers);
+        requested = savedRequested;
+        merged = savedMerged;
+        throw;
+    }
+}
+
+VkImageLayout BarrierBatch::imageLayout(VkImage image, uint32_t mip, uint32_t layer) const
+{
+    auto it = images.find(image);
+    if (it == images.end() || mip >= it->second.mipLevels || layer >= it->second.arrayLayers)
+    {
+        return VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+    return it->second.subresources[mip * it->second.arrayLayers + layer].layout;
+}
+
+void BarrierBatch::useBuffer(VkBuffer buffer, ResourceUsage usage)
+{
+    UsageInfo info = usageInfo(usage);
+    // 先在副本上推进，bufferBarrier 没有报冲突再写回去
+    State state = buffers[buffer];
+    Dependency dependency = advance(state, usage, false);
+    if (dependency.needed)
+    {
+        bufferBarrier(buffer, 0, VK_WHOLE_SIZE, dependency.srcStages, dependency.srcAccess, info.stages, info.access);
+    }
+    buffers[buffer] = state;
+}
+
+void BarrierBatch::forgetBuffer(VkBuffer buffer)
+{
+    buffers.erase(buffer);
+}
+
+void BarrierBatch::flush(VkCommandBuffer commandBuffer)
+{
+    if (empty())
+    {
+        return;
+    }
+    if (useSynchronization2)
+    {
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.memoryBarrierCount = hasMemoryBarrier ? 1 : 0;
+        dependencyInfo.pMemoryBarriers = &memory;
+        dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+        dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+        vkd.vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+    else
+    {
+        // 旧接口每次调用只有一组 stage，取并集
+        VkPipelineStageFlags2 srcStages = 0;
+        VkPipelineStageFlags2 dstStages = 0;
+        VkMemoryBarrier legacyMemory{};
+        legacyMemory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        if (hasMemoryBarrier)
+        {
+            srcStages |= memory.srcStageMask;
+            dstStages |= memory.dstStageMask;
+            legacyMemory.srcAccessMask = legacyAccess(memory.srcAccessMask);
+            legacyMemory.dstAccessMask = legacyAccess(memory.dstAccessMask);
+        }
+        std::vector<VkBufferMemoryBarrier> legacyBuffers(bufferBarriers.size());
+        for (size_t i = 0; i < bufferBarriers.size(); i++)
+        {
+            const VkBufferMemoryBarrier2& barrier = bufferBarriers[i];
+            srcStages |= barrier.srcStageMask;
+            dstStages |= barrier.dstStageMask;
+            legacyBuffers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            legacyBuffers[i].srcAccessMask = legacyAccess(barrier.srcAccessMask);
+            legacyBuffers[i].dstAccessMask = legacyAccess(barrier.dstAccessMask);
+            legacyBuffers[i].srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+            legacyBuffers[i].dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+            legacyBuffers[i].buffer = barrier.buffer;
+            legacyBuffers[i].offset = barrier.offset;
+            legacyBuffers[i].size = barrier.size;
+        }
+        std::vector<VkImageMemoryBarrier> legacyImages(imageBarriers.size());
+        for (size_t i = 0; i < imageBarriers.size(); i++)
+        {
+            const VkImageMemoryBarrier2& barrier = imageBarriers[i];
+            srcStages |= barrier.srcStageMask;
+            dstStages |= barrier.dstStageMask;
+            legacyImages[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            legacyImages[i].srcAccessMask = legacyAccess(barrier.srcAccessMask);
+            legacyImages[i].dstAccessMask = legacyAccess(barrier.dstAccessMask);
+            legacyImages[i].oldLayout = barrier.oldLayout;
+            legacyImages[i].newLayout = barrier.newLayout;
+            legacyImages[i].srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+            legacyImages[i].dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+            legacyImages[i].image = barrier.image;
+            legacyImages[i].subresourceRange = barrier.subresourceRange;
+        }
+        vkd.vkCmdPipelineBarrier(commandBuffer, legacyStages(srcStages, true), legacyStages(dstStages, false), 0,
+            hasMemoryBarrier ? 1 : 0, &legacyMemory,
+            static_cast<uint32_t>(legacyBuffers.size()), legacyBuffers.data(),
+            static_cast<uint32_t>(legacyImages.size()), legacyImages.data());
+    }
+    emitted += imageBarriers.size() + bufferBarriers.size() + (hasMemoryBarrier ? 1 : 0);
+    calls++;
+    imageBarriers.clear();
+    bufferBarriers.clear();
+    hasMemoryBarrier = false;
+}
+
+void BarrierBatch::printReport() const
+{
+    if (calls == 0)
+    {
+        return;
+    }
+    std::cout << "barrier batch (" << (synchronization2() ? "synchronization2" : "legacy") << "): " << requested << " barriers requested, "
+        << merged << " merged, " << emitted << " emitted in " << calls << " calls" << std::endl;
+}
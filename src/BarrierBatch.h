@@ -0,0 +1,114 @@
+#pragma once
+
+#include "CoreFeatures.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// 资源接下来的用途，决定等待的 stage / access 和图像布局
+enum class ResourceUsage
+{
+    ColorAttachmentWrite,
+    DepthStencilAttachmentWrite,
+    DepthStencilAttachmentRead,
+    FragmentSampledRead,
+    FragmentInputAttachmentRead,
+    ComputeStorageRead,
+    ComputeStorageWrite,
+    TransferRead,
+    TransferWrite,
+    Present,
+    VertexBufferRead,
+    IndexBufferRead,
+    UniformRead,
+    IndirectRead,
+};
+
+// synchronization2 的 barrier 批处理，两种用法：
+//   - 显式：imageBarrier / bufferBarrier / memoryBarrier 直接给 64 位 stage / access，给自己跟踪状态的调用者（RenderGraph）用
+//   - 按用途：registerImage 之后 useImage / useBuffer 只说接下来怎么用，按每个 mip / layer 上一次的访问算出 barrier 和布局转换
+// barrier 先攒着：落在已有 barrier 范围里、源相同或者接在它后面的并进去，参数一样的相邻 layer / mip 接成一个范围；
+// 调用者在下一条依赖它们的命令之前 flush，一次 vkCmdPipelineBarrier2 提交。
+// 设备没有 synchronization2 时退回 vkCmdPipelineBarrier，所有 barrier 的 stage 合并成一组。
+// 不是线程安全的，每个录制线程用自己的
+class BarrierBatch
+{
+public:
+    // vkd.load 之后调用
+    void load(const FeatureFlags& coreFeatures);
+    bool synchronization2() const { return useSynchronization2; }
+
+    void imageBarrier(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess);
+    void bufferBarrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+        VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess);
+    // 一批里所有的全局 memory barrier 合并成一个，掩码取并集
+    void memoryBarrier(VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess);
+
+    // layout 是图像现在的布局；交换链图像 acquire 之后内容不要了，用 UNDEFINED 重新 register。
+    // pendingStages / pendingAccess 是登记之前还没完成、第一次使用要等的写入，比如 acquire semaphore 的 wait stage
+    void registerImage(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevels, uint32_t arrayLayers,
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, VkPipelineStageFlags2 pendingStages = 0, VkAccessFlags2 pendingAccess = 0);
+    void forgetImage(VkImage image);
+    void useImage(VkImage image, ResourceUsage usage);
+    void useImage(VkImage image, ResourceUsage usage, uint32_t baseMip, uint32_t mipCount, uint32_t baseLayer, uint32_t layerCount);
+    VkImageLayout imageLayout(VkImage image, uint32_t mip = 0, uint32_t layer = 0) const;
+    // 第一次出现的 buffer 当作没有未完成的访问
+    void useBuffer(VkBuffer buffer, ResourceUsage usage);
+    void forgetBuffer(VkBuffer buffer);
+
+    bool empty() const { return imageBarriers.empty() && bufferBarriers.empty() && !hasMemoryBarrier; }
+    void flush(VkCommandBuffer commandBuffer);
+
+    void printReport() const;
+
+private:
+    // 上一次写（或布局转换）发生在哪些阶段，以及之后已经对哪些阶段 / access 可见
+    struct State
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 writeStages = 0;
+        VkAccessFlags2 writeAccess = 0;
+        VkPipelineStageFlags2 readStages = 0;
+        VkAccessFlags2 readAccess = 0;
+    };
+
+    struct TrackedImage
+    {
+        VkImageAspectFlags aspect = 0;
+        uint32_t mipLevels = 1;
+        uint32_t arrayLayers = 1;
+        // 下标 mip * arrayLayers + layer
+        std::vector<State> subresources;
+    };
+
+    struct Dependency
+    {
+        VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 srcStages = 0;
+        VkAccessFlags2 srcAccess = 0;
+        bool needed = false;
+    };
+
+    static Dependency advance(State& state, ResourceUsage usage, bool isImage);
+    void mergeMipNeighbour(size_t index);
+
+    bool useSynchronization2 = false;
+
+    std::unordered_map<VkImage, TrackedImage> images;
+    std::unordered_map<VkBuffer, State> buffers;
+
+    std::vector<VkImageMemoryBarrier2> imageBarriers;
+    std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+    VkMemoryBarrier2 memory{};
+    bool hasMemoryBarrier = false;
+
+    // 统计
+    uint64_t requested = 0;
+    uint64_t merged = 0;
+    uint64_t emitted = 0;
+    uint64_t calls = 0;
+};
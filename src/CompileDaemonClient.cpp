@@ -0,0 +1,103 @@
+#include "CompileDaemonClient.h"
+
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+CompileDaemonClient::CompileDaemonClient(std::string socketPath)
+    : socketPath(std::move(socketPath))
+{
+}
+
+bool CompileDaemonClient::probe()
+{
+#ifdef _WIN32
+    reachable = false;
+#else
+    uint32_t status;
+    std::vector<char> response;
+    // 查一个不存在的 key，能收到回复就说明守护进程在
+    reachable = request(CompileOpGetPipelineCache, 0, 0, 0, nullptr, 0, status, response);
+#endif
+    std::cout << "compile daemon: " << (reachable ? "connected to " + socketPath : std::string("not running, compiling in-process")) << std::endl;
+    return reachable;
+}
+
+bool CompileDaemonClient::request(uint32_t op, uint64_t key, uint32_t kind, uint32_t flags, const void* payload, size_t payloadSize,
+    uint32_t& status, std::vector<char>& response)
+{
+#ifdef _WIN32
+    return false;
+#else
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    if (!peerIsSameUser(fd))
+    {
+        std::cerr << "compile daemon: " << socketPath << " is served by another user, ignoring it" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    RequestHeader header{ CompileProtocolMagic, op, key, kind, flags, payloadSize };
+    bool ok = writeAll(fd, &header, sizeof(header)) && (payloadSize == 0 || writeAll(fd, payload, payloadSize));
+
+    ResponseHeader reply{};
+    ok = ok && readAll(fd, &reply, sizeof(reply)) && reply.payloadSize <= MaxCompilePayload;
+    if (ok)
+    {
+        response.resize(reply.payloadSize);
+        ok = reply.payloadSize == 0 || readAll(fd, response.data(), response.size());
+    }
+    ::close(fd);
+
+    status = reply.status;
+    return ok;
+#endif
+}
+
+bool CompileDaemonClient::compileGlsl(const std::string& preprocessed, uint32_t shadercKind, uint32_t flags,
+    std::vector<char>& spirv, std::string& error)
+{
+    uint32_t status;
+    std::vector<char> response;
+    if (!reachable || !request(CompileOpGlsl, 0, shadercKind, flags, preprocessed.data(), preprocessed.size(), status, response))
+    {
+        return false;
+    }
+    if (status != CompileStatusOk)
+    {
+        error.assign(response.begin(), response.end());
+        return false;
+    }
+    spirv = std::move(response);
+    return true;
+}
+
+bool CompileDaemonClient::getPipelineCache(uint64_t key, std::vector<char>& data)
+{
+    uint32_t status;
+    return reachable && request(CompileOpGetPipelineCache, key, 0, 0, nullptr, 0, status, data) && status == CompileStatusOk;
+}
+
+bool CompileDaemonClient::putPipelineCache(uint64_t key, const std::vector<char>& data)
+{
+    uint32_t status;
+    std::vector<char> response;
+    return reachable && request(CompileOpPutPipelineCache, key, 0, 0, data.data(), data.size(), status, response) && status == CompileStatusOk;
+}
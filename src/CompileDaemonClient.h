@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CompileProtocol.h"
+
+// 连本机编译守护进程的客户端。每个请求单独建连接，可以被多个线程同时调用。
+// 守护进程不在（或者不是 Unix 平台）时所有调用返回 false，调用者自己在进程内编译。
+// 回复里的 SPIR-V 和 pipeline cache 会直接交给驱动，socket 另一端不是同一个用户的进程时不发请求
+class CompileDaemonClient
+{
+public:
+    explicit CompileDaemonClient(std::string socketPath = defaultCompileDaemonSocket());
+
+    // 试连一次，结果只用于日志和跳过后续请求
+    bool probe();
+    bool available() const { return reachable; }
+
+    bool compileGlsl(const std::string& preprocessed, uint32_t shadercKind, uint32_t flags,
+        std::vector<char>& spirv, std::string& error);
+    bool getPipelineCache(uint64_t key, std::vector<char>& data);
+    bool putPipelineCache(uint64_t key, const std::vector<char>& data);
+
+private:
+    bool request(uint32_t op, uint64_t key, uint32_t kind, uint32_t flags, const void* payload, size_t payloadSize,
+        uint32_t& status, std::vector<char>& response);
+
+    std::string socketPath;
+    bool reachable = false;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+// 本机编译守护进程（daemon/CompileDaemon.cpp）和客户端之间的协议，走 Unix domain socket。
+// 每个连接一个请求：RequestHeader + payload，回 ResponseHeader + payload
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+constexpr uint32_t CompileProtocolMagic = 0x56544344; // "DCTV"
+
+// 默认放在每个用户自己的 $XDG_RUNTIME_DIR 里；没有的话退回 /tmp，文件名带 uid。
+// /tmp 谁都能抢先 bind，所以两边还要用 peerIsSameUser 检查对方
+inline std::string defaultCompileDaemonSocket()
+{
+    const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != nullptr && runtimeDir[0] != '\0')
+    {
+        return std::string(runtimeDir) + "/vulkan_tutorial_compile.sock";
+    }
+#ifdef _WIN32
+    return "vulkan_tutorial_compile.sock";
+#else
+    return "/tmp/vulkan_tutorial_compile-" + std::to_string(::getuid()) + ".sock";
+#endif
+}
+
+enum CompileOp : uint32_t
+{
+    // payload 是预处理过的 GLSL，kind 是 shaderc_shader_kind，返回 SPIR-V
+    CompileOpGlsl = 1,
+    // 按 key 取 / 存 VkPipelineCache 的数据，key 由客户端按设备算
+    CompileOpGetPipelineCache = 2,
+    CompileOpPutPipelineCache = 3,
+};
+
+enum CompileStatus : uint32_t
+{
+    CompileStatusOk = 0,
+    CompileStatusMiss = 1,
+    // payload 是错误信息
+    CompileStatusError = 2,
+};
+
+enum CompileFlags : uint32_t
+{
+    CompileFlagDebugInfo = 1,
+};
+
+struct RequestHeader
+{
+    uint32_t magic;
+    uint32_t op;
+    uint64_t key;
+    uint32_t kind;
+    uint32_t flags;
+    uint64_t payloadSize;
+};
+
+struct ResponseHeader
+{
+    uint32_t status;
+    uint32_t reserved;
+    uint64_t payloadSize;
+};
+
+// 单个 payload 的上限，防止坏数据让对方分配过多内存
+constexpr uint64_t MaxCompilePayload = 256ull << 20;
+
+#ifndef _WIN32
+// 连接另一端的进程和自己是不是同一个用户；拿不到对方的凭据也当作不是
+inline bool peerIsSameUser(int fd)
+{
+#ifdef SO_PEERCRED
+    struct ucred credentials {};
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0 || length != sizeof(credentials))
+    {
+        return false;
+    }
+    return credentials.uid == ::getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return ::getpeereid(fd, &uid, &gid) == 0 && uid == ::getuid();
+#endif
+}
+
+inline bool readAll(int fd, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t n = ::read(fd, bytes, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        // 对方提前断开时不要被 SIGPIPE 杀掉
+#ifdef MSG_NOSIGNAL
+        ssize_t n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+#else
+        ssize_t n = ::send(fd, bytes, size, 0);
+#endif
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+#endif
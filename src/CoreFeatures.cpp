@@ -0,0 +1,114 @@
+#include "CoreFeatures.h"
+
+#include <vulkan/vulkan_profiles.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+uint32_t CoreFeatures::instanceApiVersion()
+{
+    // 1.0 的 loader 没有 vkEnumerateInstanceVersion
+    auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    uint32_t version = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion == nullptr || enumerateInstanceVersion(&version) != VK_SUCCESS)
+    {
+        return VK_API_VERSION_1_0;
+    }
+    version = VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(version), VK_API_VERSION_MINOR(version), 0);
+    return std::min(version, VK_API_VERSION_1_3);
+}
+
+void CoreFeatures::query(const DeviceCapabilities& capabilities)
+{
+    enabledFlags = FeatureFlags{};
+    enabledFlags.apiVersion = capabilities.apiVersion;
+    vulkan12Features = {};
+    vulkan13Features = {};
+    if (!capabilities.apiVersionAtLeast(VK_API_VERSION_1_2))
+    {
+        std::cout << "core features: Vulkan " << VK_API_VERSION_MAJOR(capabilities.apiVersion) << "."
+            << VK_API_VERSION_MINOR(capabilities.apiVersion) << ", no 1.2 / 1.3 features" << std::endl;
+        return;
+    }
+
+    bool vulkan13 = capabilities.apiVersionAtLeast(VK_API_VERSION_1_3);
+    VkPhysicalDeviceVulkan11Features supported11{};
+    supported11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceVulkan13Features supported13{};
+    supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    supported11.pNext = &supported12;
+    supported12.pNext = vulkan13 ? &supported13 : nullptr;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &supported11;
+    vkGetPhysicalDeviceFeatures2(capabilities.physicalDevice, &features);
+
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = supported12.timelineSemaphore;
+    vulkan12Features.bufferDeviceAddress = supported12.bufferDeviceAddress;
+    // descriptorIndexing 表示最小集合都支持；bindless 常用的几项单独查
+    vulkan12Features.descriptorIndexing = supported12.descriptorIndexing;
+    vulkan12Features.runtimeDescriptorArray = supported12.runtimeDescriptorArray;
+    vulkan12Features.descriptorBindingPartiallyBound = supported12.descriptorBindingPartiallyBound;
+    vulkan12Features.descriptorBindingVariableDescriptorCount = supported12.descriptorBindingVariableDescriptorCount;
+    vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = supported12.descriptorBindingSampledImageUpdateAfterBind;
+    vulkan12Features.descriptorBindingUpdateUnusedWhilePending = supported12.descriptorBindingUpdateUnusedWhilePending;
+    vulkan12Features.shaderSampledImageArrayNonUniformIndexing = supported12.shaderSampledImageArrayNonUniformIndexing;
+    enabledFlags.timelineSemaphore = supported12.timelineSemaphore == VK_TRUE;
+    enabledFlags.bufferDeviceAddress = supported12.bufferDeviceAddress == VK_TRUE;
+    enabledFlags.descriptorIndexing = supported12.descriptorIndexing == VK_TRUE;
+
+    if (vulkan13)
+    {
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        vulkan13Features.synchronization2 = supported13.synchronization2;
+        vulkan13Features.dynamicRendering = supported13.dynamicRendering;
+        vulkan13Features.maintenance4 = supported13.maintenance4;
+        enabledFlags.synchronization2 = supported13.synchronization2 == VK_TRUE;
+        enabledFlags.dynamicRendering = supported13.dynamicRendering == VK_TRUE;
+        enabledFlags.maintenance4 = supported13.maintenance4 == VK_TRUE;
+    }
+
+    std::cout << "core features: Vulkan " << VK_API_VERSION_MAJOR(capabilities.apiVersion) << "." << VK_API_VERSION_MINOR(capabilities.apiVersion)
+        << ", timeline semaphore " << enabledFlags.timelineSemaphore
+        << ", synchronization2 " << enabledFlags.synchronization2
+        << ", dynamic rendering " << enabledFlags.dynamicRendering
+        << ", descriptor indexing " << enabledFlags.descriptorIndexing
+        << ", buffer device address " << enabledFlags.bufferDeviceAddress
+        << ", maintenance4 " << enabledFlags.maintenance4
+        << ", shader draw parameters " << supported11.shaderDrawParameters << std::endl;
+}
+
+void* CoreFeatures::chainFeatures(void* pNext)
+{
+    if (vulkan12Features.sType == 0)
+    {
+        return pNext;
+    }
+    vulkan12Features.pNext = pNext;
+    if (vulkan13Features.sType == 0)
+    {
+        return &vulkan12Features;
+    }
+    vulkan13Features.pNext = &vulkan12Features;
+    return &vulkan13Features;
+}
+
+void CoreFeatures::checkProfile(VkInstance instance, VkPhysicalDevice physicalDevice) const
+{
+#ifdef VP_KHR_roadmap_2022
+    VpProfileProperties profile{ VP_KHR_ROADMAP_2022_NAME, VP_KHR_ROADMAP_2022_SPEC_VERSION };
+    VkBool32 supported = VK_FALSE;
+    if (vpGetPhysicalDeviceProfileSupport(instance, physicalDevice, &profile, &supported) != VK_SUCCESS)
+    {
+        std::cout << "profile " << VP_KHR_ROADMAP_2022_NAME << ": check failed" << std::endl;
+        return;
+    }
+    std::cout << "profile " << VP_KHR_ROADMAP_2022_NAME << ": " << (supported ? "supported" : "not supported") << std::endl;
+#else
+    std::cout << "profile check: VP_KHR_roadmap_2022 not available in these headers" << std::endl;
+#endif
+}
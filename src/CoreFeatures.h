@@ -0,0 +1,43 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// 协商出来的 API 版本和实际打开的可选特性，引擎按这些选快速路径
+struct FeatureFlags
+{
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    bool timelineSemaphore = false;
+    bool synchronization2 = false;
+    bool dynamicRendering = false;
+    bool descriptorIndexing = false;
+    bool bufferDeviceAddress = false;
+    bool maintenance4 = false;
+};
+
+// 1.2 / 1.3 核心特性的协商。instance 按 loader 支持的最高版本创建（不超过 1.3），device 的有效版本是两者取小；
+// 查 VkPhysicalDeviceVulkan11/12/13Features，下面几项支持就打开，不支持就关着，不影响选设备。
+// 只走核心版本，1.2 以下的设备不回退到对应的 KHR / EXT 扩展
+class CoreFeatures
+{
+public:
+    // createInstance 用的 apiVersion
+    static uint32_t instanceApiVersion();
+
+    void query(const DeviceCapabilities& capabilities);
+    // 挂了 VkPhysicalDeviceVulkan1xFeatures 之后，提升进这个版本的单独 feature 结构体就不能再挂，各模块要避开
+    void* chainFeatures(void* pNext);
+    const FeatureFlags& flags() const { return enabledFlags; }
+
+    // 对照 VP_KHR_roadmap_2022 检查一遍，只打印结果，不影响打开哪些特性
+    void checkProfile(VkInstance instance, VkPhysicalDevice physicalDevice) const;
+
+private:
+    FeatureFlags enabledFlags;
+    // query 之后只留下要打开的位
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+};
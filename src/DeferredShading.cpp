@@ -0,0 +1,469 @@
+#include "DeferredShading.h"
+#include "VulkanDispatch.h"
+
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+static const VkFormat AlbedoFormat = VK_FORMAT_R8G8B8A8_UNORM;
+static const VkFormat NormalFormat = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+
+static VkAttachmentDescription attachmentDescription(VkFormat format, VkAttachmentLoadOp loadOp, VkAttachmentStoreOp storeOp,
+    VkImageLayout initialLayout, VkImageLayout finalLayout)
+{
+    VkAttachmentDescription attachment{};
+    attachment.format = format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = loadOp;
+    attachment.storeOp = storeOp;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = initialLayout;
+    attachment.finalLayout = finalLayout;
+    return attachment;
+}
+
+void DeferredShading::createRenderPasses(VkDevice device, VkFormat colorFormat, VkFormat depthFormat)
+{
+    // 光照覆盖每个像素，交换链图像不需要 clear
+    VkAttachmentDescription swapChainAttachment = attachmentDescription(colorFormat, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    VkAttachmentDescription depthAttachment = attachmentDescription(depthFormat, VK_ATTACHMENT_LOAD_OP_CLEAR,
+        VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+    // 上一帧的深度写入和 G-buffer 读取完成之后才能 clear
+    VkSubpassDependency geometryDependency{};
+    geometryDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    geometryDependency.dstSubpass = 0;
+    geometryDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    geometryDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    geometryDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    geometryDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // G-buffer 写完之后光照才能读；subpass 之间只依赖同一个像素，可以 by region
+    VkSubpassDependency lightingDependency{};
+    lightingDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    lightingDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    lightingDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    lightingDependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+
+    // 交换链图像的布局转换要等 acquire 的 semaphore
+    VkSubpassDependency swapChainDependency{};
+    swapChainDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    swapChainDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    swapChainDependency.srcAccessMask = 0;
+    swapChainDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    swapChainDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+
+    if (!multiPass)
+    {
+        // 0 交换链，1 albedo，2 normal，3 深度
+        VkAttachmentDescription gbufferAttachment = attachmentDescription(AlbedoFormat, VK_ATTACHMENT_LOAD_OP_CLEAR,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        std::array<VkAttachmentDescription, 4> attachments = { swapChainAttachment, gbufferAttachment, gbufferAttachment, depthAttachment };
+        attachments[2].format = NormalFormat;
+
+        VkAttachmentReference gbufferRefs[] = {
+            { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+            { 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+        };
+        VkAttachmentReference depthRef{ 3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+        VkAttachmentReference inputRefs[] = {
+            { 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+            { 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+        };
+        VkAttachmentReference colorRef{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+        std::array<VkSubpassDescription, 2> subpasses{};
+        subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpasses[0].colorAttachmentCount = 2;
+        subpasses[0].pColorAttachments = gbufferRefs;
+        subpasses[0].pDepthStencilAttachment = &depthRef;
+        subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpasses[1].inputAttachmentCount = 2;
+        subpasses[1].pInputAttachments = inputRefs;
+        subpasses[1].colorAttachmentCount = 1;
+        subpasses[1].pColorAttachments = &colorRef;
+
+        lightingDependency.srcSubpass = 0;
+        lightingDependency.dstSubpass = 1;
+        lightingDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        swapChainDependency.dstSubpass = 1;
+        std::array<VkSubpassDependency, 3> dependencies = { geometryDependency, lightingDependency, swapChainDependency };
+
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+        renderPassInfo.pSubpasses = subpasses.data();
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+        if (vkd.vkCreateRenderPass(device, &renderPassInfo, nullptr, &geometryPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass!");
+        }
+        return;
+    }
+
+    // G-buffer pass：0 albedo，1 normal，2 深度。G-buffer 必须 store，光照 pass 再 load 回来
+    VkAttachmentDescription gbufferAttachment = attachmentDescription(AlbedoFormat, VK_ATTACHMENT_LOAD_OP_CLEAR,
+        VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    std::array<VkAttachmentDescription, 3> geometryAttachments = { gbufferAttachment, gbufferAttachment, depthAttachment };
+    geometryAttachments[1].format = NormalFormat;
+    VkAttachmentReference gbufferRefs[] = {
+        { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+        { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+    };
+    VkAttachmentReference depthRef{ 2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription geometrySubpass{};
+    geometrySubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    geometrySubpass.colorAttachmentCount = 2;
+    geometrySubpass.pColorAttachments = gbufferRefs;
+    geometrySubpass.pDepthStencilAttachment = &depthRef;
+
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(geometryAttachments.size());
+    renderPassInfo.pAttachments = geometryAttachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &geometrySubpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &geometryDependency;
+    if (vkd.vkCreateRenderPass(device, &renderPassInfo, nullptr, &geometryPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass!");
+    }
+
+    // 光照 pass：0 交换链，1 albedo，2 normal
+    VkAttachmentDescription inputAttachment = attachmentDescription(AlbedoFormat, VK_ATTACHMENT_LOAD_OP_LOAD,
+        VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    std::array<VkAttachmentDescription, 3> lightingAttachments = { swapChainAttachment, inputAttachment, inputAttachment };
+    lightingAttachments[2].format = NormalFormat;
+    VkAttachmentReference inputRefs[] = {
+        { 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+        { 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+    };
+    VkAttachmentReference colorRef{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription lightingSubpassDesc{};
+    lightingSubpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    lightingSubpassDesc.inputAttachmentCount = 2;
+    lightingSubpassDesc.pInputAttachments = inputRefs;
+    lightingSubpassDesc.colorAttachmentCount = 1;
+    lightingSubpassDesc.pColorAttachments = &colorRef;
+
+    // 跨 render pass 的依赖不能 by region；G-buffer 是 LOAD_OP_LOAD 读回来的，load 算颜色附件读
+    lightingDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    lightingDependency.dstStageMask |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    lightingDependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    lightingDependency.dstSubpass = 0;
+    swapChainDependency.dstSubpass = 0;
+    std::array<VkSubpassDependency, 2> dependencies = { lightingDependency, swapChainDependency };
+
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(lightingAttachments.size());
+    renderPassInfo.pAttachments = lightingAttachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &lightingSubpassDesc;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+    if (vkd.vkCreateRenderPass(device, &renderPassInfo, nullptr, &lightingPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass!");
+    }
+}
+
+void DeferredShading::createAttachment(VkDevice device, const DeviceCapabilities& capabilities, VkFormat format,
+    Attachment& attachment)
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = { extent.width, extent.height, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // multi-pass 的 G-buffer 要在两个 render pass 之间保存，不能是 transient
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+        (multiPass ? 0 : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkd.vkCreateImage(device, &imageInfo, nullptr, &attachment.image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create G-buffer image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkd.vkGetImageMemoryRequirements(device, attachment.image, &memRequirements);
+    uint32_t memoryType = multiPass ? ~0u : capabilities.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    attachment.lazilyAllocated = memoryType != ~0u;
+    if (!attachment.lazilyAllocated)
+    {
+        memoryType = capabilities.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    if (memoryType == ~0u)
+    {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryType;
+    if (vkd.vkAllocateMemory(device, &allocInfo, nullptr, &attachment.memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate G-buffer memory!");
+    }
+    vkd.vkBindImageMemory(device, attachment.image, attachment.memory, 0);
+    attachment.size = memRequirements.size;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = attachment.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    if (vkd.vkCreateImageView(device, &viewInfo, nullptr, &attachment.view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create G-buffer image view!");
+    }
+}
+
+void DeferredShading::createAttachments(const DeviceCapabilities& capabilities, VkDevice device, VkExtent2D swapChainExtent)
+{
+    extent = swapChainExtent;
+    createAttachment(device, capabilities, AlbedoFormat, albedo);
+    createAttachment(device, capabilities, NormalFormat, normal);
+}
+
+void DeferredShading::createFramebuffers(VkDevice device, const std::vector<VkImageView>& swapChainImageViews, VkImageView depthView)
+{
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+
+    if (multiPass)
+    {
+        VkImageView geometryAttachments[] = { albedo.view, normal.view, depthView };
+        framebufferInfo.renderPass = geometryPass;
+        framebufferInfo.attachmentCount = 3;
+        framebufferInfo.pAttachments = geometryAttachments;
+        if (vkd.vkCreateFramebuffer(device, &framebufferInfo, nullptr, &geometryFramebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+
+    framebuffers.resize(swapChainImageViews.size());
+    for (size_t i = 0; i < swapChainImageViews.size(); i++)
+    {
+        std::vector<VkImageView> attachments = { swapChainImageViews[i], albedo.view, normal.view };
+        if (!multiPass)
+        {
+            attachments.push_back(depthView);
+        }
+        framebufferInfo.renderPass = lightingRenderPass();
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        if (vkd.vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+}
+
+void DeferredShading::createDescriptorSet(VkDevice device, VkDescriptorSetLayout setLayout)
+{
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    poolSize.descriptorCount = 2;
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkd.vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    if (vkd.vkAllocateDescriptorSets(device, &allocInfo, &lightingSet) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+
+    VkDescriptorImageInfo imageInfos[2]{};
+    imageInfos[0].imageView = albedo.view;
+    imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfos[1].imageView = normal.view;
+    imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkWriteDescriptorSet writes[2]{};
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = lightingSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        writes[i].pImageInfo = &imageInfos[i];
+    }
+    vkd.vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+}
+
+void DeferredShading::createQueries(const DeviceCapabilities& capabilities, VkDevice device, uint32_t frameCount)
+{
+    if (!capabilities.limits().timestampComputeAndGraphics)
+    {
+        return;
+    }
+    timestampPeriod = capabilities.limits().timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = frameCount * 2;
+    if (vkd.vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create query pool!");
+    }
+    pending.assign(frameCount, false);
+}
+
+void DeferredShading::cmdBeginGeometry(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t frame)
+{
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkd.vkCmdResetQueryPool(commandBuffer, queryPool, frame * 2, 2);
+        vkd.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, frame * 2);
+    }
+
+    // 背景的 albedo alpha 为 0，光照时据此保持清屏颜色
+    std::array<VkClearValue, 4> clearValues{};
+    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    clearValues[1].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+    clearValues[2].color = { {0.5f, 0.5f, 1.0f, 0.0f} };
+    clearValues[3].depthStencil = { 1.0f, 0 };
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = geometryPass;
+    renderPassInfo.framebuffer = multiPass ? geometryFramebuffer : framebuffers[imageIndex];
+    renderPassInfo.renderArea = { { 0, 0 }, extent };
+    // multi-pass 的 G-buffer pass 没有交换链 attachment
+    renderPassInfo.clearValueCount = multiPass ? 3 : 4;
+    renderPassInfo.pClearValues = multiPass ? &clearValues[1] : clearValues.data();
+    vkd.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void DeferredShading::cmdBeginLighting(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+    if (!multiPass)
+    {
+        vkd.vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+        return;
+    }
+    vkd.vkCmdEndRenderPass(commandBuffer);
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = lightingPass;
+    renderPassInfo.framebuffer = framebuffers[imageIndex];
+    renderPassInfo.renderArea = { { 0, 0 }, extent };
+    vkd.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void DeferredShading::cmdEnd(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    vkd.vkCmdEndRenderPass(commandBuffer);
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkd.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, frame * 2 + 1);
+        pending[frame] = true;
+    }
+}
+
+void DeferredShading::collect(VkDevice device, uint32_t frame)
+{
+    if (queryPool == VK_NULL_HANDLE || !pending[frame])
+    {
+        return;
+    }
+    uint64_t results[4] = {};
+    VkResult result = vkd.vkGetQueryPoolResults(device, queryPool, frame * 2, 2, sizeof(results), results, 2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result == VK_SUCCESS && results[1] != 0 && results[3] != 0)
+    {
+        gpuMs += (results[2] - results[0]) * timestampPeriod / 1e6;
+        gpuFrames++;
+    }
+    pending[frame] = false;
+}
+
+void DeferredShading::printReport(VkDevice device) const
+{
+    if (geometryPass == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    std::cout << "deferred shading (" << (multiPass ? "multi-pass" : "subpass") << "):" << std::endl;
+
+    VkDeviceSize committed = 0;
+    for (const Attachment* attachment : { &albedo, &normal })
+    {
+        VkDeviceSize bytes = attachment->size;
+        if (attachment->lazilyAllocated)
+        {
+            vkd.vkGetDeviceMemoryCommitment(device, attachment->memory, &bytes);
+        }
+        committed += bytes;
+    }
+    std::cout << "  G-buffer " << (albedo.size + normal.size) / 1024 << " KB requested, " << committed / 1024 << " KB committed"
+        << (albedo.lazilyAllocated ? " (lazily allocated)" : " (device local)") << std::endl;
+
+    // 没有厂商计数器可用，按 attachment 的 load/store op 估算每帧读写显存的字节数：
+    // subpass 方式只有交换链图像 store；multi-pass 还要把 G-buffer store 一遍再 load 一遍
+    VkDeviceSize swapChainBytes = (VkDeviceSize)extent.width * extent.height * 4;
+    VkDeviceSize gbufferBytes = albedo.size + normal.size;
+    std::cout << "  attachment traffic per frame: subpass " << swapChainBytes / 1024 << " KB, multi-pass "
+        << (swapChainBytes + 2 * gbufferBytes) / 1024 << " KB" << std::endl;
+    if (gpuFrames > 0)
+    {
+        std::cout << "  gpu time " << gpuMs / gpuFrames << " ms per frame over " << gpuFrames << " frames" << std::endl;
+    }
+}
+
+void DeferredShading::destroySwapChainResources(VkDevice device)
+{
+    for (VkFramebuffer framebuffer : framebuffers)
+    {
+        vkd.vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
+    framebuffers.clear();
+    vkd.vkDestroyFramebuffer(device, geometryFramebuffer, nullptr);
+    geometryFramebuffer = VK_NULL_HANDLE;
+    vkd.vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    descriptorPool = VK_NULL_HANDLE;
+    lightingSet = VK_NULL_HANDLE;
+    for (Attachment* attachment : { &albedo, &normal })
+    {
+        vkd.vkDestroyImageView(device, attachment->view, nullptr);
+        vkd.vkDestroyImage(device, attachment->image, nullptr);
+        vkd.vkFreeMemory(device, attachment->memory, nullptr);
+        *attachment = Attachment{};
+    }
+}
+
+void DeferredShading::destroy(VkDevice device)
+{
+    vkd.vkDestroyRenderPass(device, geometryPass, nullptr);
+    vkd.vkDestroyRenderPass(device, lightingPass, nullptr);
+    geometryPass = VK_NULL_HANDLE;
+    lightingPass = VK_NULL_HANDLE;
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkd.vkDestroyQueryPool(device, queryPool, nullptr);
+        queryPool = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// 基于 subpass 的 deferred shading。
+// subpass 0 把 albedo / normal 写进 G-buffer，subpass 1 把它们当 input attachment 读出来做光照，写到交换链图像。
+// G-buffer 用 TRANSIENT + LAZILY_ALLOCATED，store 是 DONT_CARE，tiler 上整个 G-buffer 只存在于片上内存。
+// multiPass 打开时换成等价的两个 render pass，G-buffer 要 store 再 load，用来对比带宽和内存占用
+class DeferredShading
+{
+public:
+    bool multiPass = false;
+
+    void createRenderPasses(VkDevice device, VkFormat colorFormat, VkFormat depthFormat);
+    VkRenderPass geometryRenderPass() const { return geometryPass; }
+    VkRenderPass lightingRenderPass() const { return multiPass ? lightingPass : geometryPass; }
+    uint32_t lightingSubpass() const { return multiPass ? 0 : 1; }
+
+    // 以下三个在 swapchain 重建时跟着重建
+    void createAttachments(const DeviceCapabilities& capabilities, VkDevice device, VkExtent2D extent);
+    void createFramebuffers(VkDevice device, const std::vector<VkImageView>& swapChainImageViews, VkImageView depthView);
+    // setLayout 从 lighting.frag 反射出来
+    void createDescriptorSet(VkDevice device, VkDescriptorSetLayout setLayout);
+    VkDescriptorSet descriptorSet() const { return lightingSet; }
+
+    // 每个 frame in flight 两个 timestamp，量整帧 G-buffer + 光照的 GPU 时间
+    void createQueries(const DeviceCapabilities& capabilities, VkDevice device, uint32_t frameCount);
+    void cmdBeginGeometry(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t frame);
+    // subpass 方式是 next subpass，multi-pass 方式是结束 G-buffer pass 再开始光照 pass
+    void cmdBeginLighting(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void cmdEnd(VkCommandBuffer commandBuffer, uint32_t frame);
+    // 等到这一帧的 fence 之后调用
+    void collect(VkDevice device, uint32_t frame);
+
+    void printReport(VkDevice device) const;
+    void destroySwapChainResources(VkDevice device);
+    void destroy(VkDevice device);
+
+private:
+    struct Attachment
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        bool lazilyAllocated = false;
+    };
+
+    void createAttachment(VkDevice device, const DeviceCapabilities& capabilities, VkFormat format, Attachment& attachment);
+
+    VkExtent2D extent{};
+    VkRenderPass geometryPass = VK_NULL_HANDLE;
+    VkRenderPass lightingPass = VK_NULL_HANDLE;
+    Attachment albedo;
+    Attachment normal;
+    // subpass 方式每张交换链图像一个；multi-pass 方式 geometryFramebuffer 只有一个，这里是光照 pass 的
+    std::vector<VkFramebuffer> framebuffers;
+    VkFramebuffer geometryFramebuffer = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet lightingSet = VK_NULL_HANDLE;
+
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    float timestampPeriod = 0.0f;
+    std::vector<bool> pending;
+    double gpuMs = 0.0;
+    uint64_t gpuFrames = 0;
+};
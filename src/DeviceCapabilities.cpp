@@ -0,0 +1,136 @@
+#include "DeviceCapabilities.h"
+
+#include <algorithm>
+#include <iostream>
+
+static const VkMemoryPropertyFlags IndexedMemoryFlags = 0x1F;
+
+void DeviceCapabilities::gather(VkPhysicalDevice device, VkSurfaceKHR targetSurface, uint32_t instanceApiVersion)
+{
+    physicalDevice = device;
+    surface = targetSurface;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    apiVersion = std::min(properties.apiVersion, instanceApiVersion);
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, nullptr);
+    queueFamilies.resize(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, queueFamilies.data());
+    graphicsFamily.reset();
+    presentFamily.reset();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!graphicsFamily && (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            graphicsFamily = i;
+        }
+        VkBool32 surfaceSupport = VK_FALSE;
+        if (!presentFamily && vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &surfaceSupport) == VK_SUCCESS &&
+            surfaceSupport == VK_TRUE)
+        {
+            presentFamily = i;
+        }
+    }
+
+    count = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> available(count);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, available.data());
+    extensions.clear();
+    for (auto& extension : available)
+    {
+        extensions.push_back(extension.extensionName);
+    }
+    std::sort(extensions.begin(), extensions.end());
+
+    count = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &count, nullptr);
+    surfaceFormats.resize(count);
+    if (count > 0)
+    {
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &count, surfaceFormats.data());
+    }
+    count = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, nullptr);
+    presentModes.resize(count);
+    if (count > 0)
+    {
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, presentModes.data());
+    }
+
+    for (uint32_t flags = 0; flags <= IndexedMemoryFlags; flags++)
+    {
+        memoryTypesByFlags[flags] = 0;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            if ((memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+            {
+                memoryTypesByFlags[flags] |= 1u << i;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(formatMutex);
+    formats.clear();
+}
+
+bool DeviceCapabilities::hasExtension(const char* name) const
+{
+    return std::binary_search(extensions.begin(), extensions.end(), name,
+        [](const std::string& a, const std::string& b) { return a < b; });
+}
+
+uint32_t DeviceCapabilities::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags flags) const
+{
+    uint32_t candidates = 0;
+    if ((flags & ~IndexedMemoryFlags) == 0)
+    {
+        candidates = memoryTypesByFlags[flags] & typeFilter;
+    }
+    else
+    {
+        // PROTECTED 或厂商扩展的属性不在表里，直接扫一遍
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            if ((memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+            {
+                candidates |= 1u << i;
+            }
+        }
+        candidates &= typeFilter;
+    }
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+    {
+        if (candidates & (1u << i))
+        {
+            return i;
+        }
+    }
+    return ~0u;
+}
+
+VkFormatProperties DeviceCapabilities::formatProperties(VkFormat format) const
+{
+    std::lock_guard<std::mutex> lock(formatMutex);
+    auto it = formats.find(format);
+    if (it != formats.end())
+    {
+        return it->second;
+    }
+    VkFormatProperties result;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &result);
+    formats[format] = result;
+    return result;
+}
+
+VkSurfaceCapabilitiesKHR DeviceCapabilities::surfaceCapabilities() const
+{
+    VkSurfaceCapabilitiesKHR capabilities{};
+    if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities) != VK_SUCCESS)
+    {
+        std::cerr << "query swap chain capabilities failed" << std::endl;
+    }
+    return capabilities;
+}
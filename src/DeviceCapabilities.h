@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// 物理设备的能力快照：properties、features、内存属性、队列族、扩展和交换链格式在 gather 时查一次，
+// 之后所有地方都查这里，不再调驱动。内存类型按属性组合预先算好，查找是一次位运算
+class DeviceCapabilities
+{
+public:
+    // 换设备时重新调用；surface 用来确定 present 队列族和交换链格式，instanceApiVersion 是创建 instance 时的版本
+    void gather(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t instanceApiVersion);
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    // 实际能用的版本：instance 和 device 版本取小
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    VkPhysicalDeviceFeatures features{};
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    std::optional<uint32_t> graphicsFamily;
+    std::optional<uint32_t> presentFamily;
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
+
+    const VkPhysicalDeviceLimits& limits() const { return properties.limits; }
+    bool apiVersionAtLeast(uint32_t version) const { return apiVersion >= version; }
+    bool hasExtension(const char* name) const;
+
+    // typeFilter 里第一个包含全部 flags 的内存类型（驱动按性能排序，第一个就是最好的），没有返回 ~0u
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags flags) const;
+    // 第一次查某个格式时调驱动，之后走缓存；可以在多个线程上调用
+    VkFormatProperties formatProperties(VkFormat format) const;
+    // currentExtent 跟着窗口大小变，这个每次都查
+    VkSurfaceCapabilitiesKHR surfaceCapabilities() const;
+
+private:
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    std::vector<std::string> extensions;
+    // 下标是 DEVICE_LOCAL / HOST_VISIBLE / HOST_COHERENT / HOST_CACHED / LAZILY_ALLOCATED 五位的组合，值是满足的内存类型位掩码
+    uint32_t memoryTypesByFlags[32] = {};
+    mutable std::mutex formatMutex;
+    mutable std::map<VkFormat, VkFormatProperties> formats;
+};
@@ -0,0 +1,309 @@
+#include "DynamicRendering.h"
+#include "VulkanDispatch.h"
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+template <typename T>
+static void loadDeviceProc(VkDevice device, T& fn, const char* name)
+{
+    fn = reinterpret_cast<T>(vkGetDeviceProcAddr(device, name));
+    if (fn == nullptr)
+    {
+        throw std::runtime_error(std::string("missing device function ") + name);
+    }
+}
+
+void DynamicRendering::query(const DeviceCapabilities& capabilities, const FeatureFlags& coreFeatures)
+{
+    supported = false;
+    core = false;
+
+    if (!capabilities.apiVersionAtLeast(VK_API_VERSION_1_1))
+    {
+        return;
+    }
+
+    // VkPhysicalDeviceVulkan13Features 和扩展的 feature 结构体不能同时挂，1.3 上只看核心的
+    if (capabilities.apiVersionAtLeast(VK_API_VERSION_1_3))
+    {
+        core = true;
+        supported = coreFeatures.dynamicRendering;
+        std::cout << "dynamic rendering: " << (supported ? "enabled (core)" : "feature off") << std::endl;
+        return;
+    }
+
+    // dynamic rendering 依赖 depth stencil resolve，后者又依赖 create renderpass 2
+    if (!capabilities.hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) || !capabilities.hasExtension(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) ||
+        !capabilities.hasExtension(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME))
+    {
+        std::cout << "dynamic rendering: not supported" << std::endl;
+        return;
+    }
+
+    dynamicRenderingFeatures = {};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &dynamicRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(capabilities.physicalDevice, &features);
+
+    supported = dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+    std::cout << "dynamic rendering: " << (supported ? "enabled" : "feature off") << std::endl;
+}
+
+void DynamicRendering::appendDeviceExtensions(std::vector<const char*>& extensions) const
+{
+    if (supported && !core)
+    {
+        extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        extensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+        extensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+    }
+}
+
+void* DynamicRendering::chainFeatures(void* pNext)
+{
+    if (!supported || core)
+    {
+        return pNext;
+    }
+    dynamicRenderingFeatures.pNext = pNext;
+    return &dynamicRenderingFeatures;
+}
+
+void DynamicRendering::load(VkDevice device)
+{
+    if (!supported)
+    {
+        return;
+    }
+    loadDeviceProc(device, cmdBeginRendering, core ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+    loadDeviceProc(device, cmdEndRendering, core ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+}
+
+void DynamicRendering::transitionTargets(VkCommandBuffer commandBuffer, BarrierBatch& barrierBatch, const RenderTargets& targets)
+{
+    // 没有 render pass 帮忙做布局转换，手动加 barrier。所有目标的内容都不要了，每次从 UNDEFINED 重新登记：
+    // 交换链图像要等 acquire semaphore 的 wait stage，多重采样和深度图像要等上一帧的写入完成之后才能 clear
+    barrierBatch.registerImage(targets.color, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+    barrierBatch.useImage(targets.color, ResourceUsage::ColorAttachmentWrite);
+
+    if (targets.msaaColorView != VK_NULL_HANDLE)
+    {
+        barrierBatch.registerImage(targets.msaaColor, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1, VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+        barrierBatch.useImage(targets.msaaColor, ResourceUsage::ColorAttachmentWrite);
+    }
+
+    if (targets.depthView != VK_NULL_HANDLE)
+    {
+        barrierBatch.registerImage(targets.depth, targets.depthAspect, 1, 1, VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+        barrierBatch.useImage(targets.depth, ResourceUsage::DepthStencilAttachmentWrite);
+    }
+    barrierBatch.flush(commandBuffer);
+}
+
+void DynamicRendering::beginRendering(VkCommandBuffer commandBuffer, const RenderTargets& targets, VkExtent2D extent, VkClearValue clearValue)
+{
+    VkRenderingAttachmentInfoKHR colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    colorAttachment.imageView = targets.colorView;
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.clearValue = clearValue;
+    if (targets.msaaColorView != VK_NULL_HANDLE)
+    {
+        // 多重采样数据留在片上，只有 resolve 的结果写回交换链图像
+        colorAttachment.imageView = targets.msaaColorView;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+        colorAttachment.resolveImageView = targets.colorView;
+        colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
+    VkRenderingAttachmentInfoKHR depthAttachment{};
+    depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    depthAttachment.imageView = targets.depthView;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.loadOp = targets.loadDepth ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = targets.storeDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+    VkRenderingInfoKHR renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+    renderingInfo.renderArea = { { 0, 0 }, extent };
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = targets.colorView != VK_NULL_HANDLE ? 1 : 0;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.pDepthAttachment = targets.depthView != VK_NULL_HANDLE ? &depthAttachment : nullptr;
+    cmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void DynamicRendering::endRendering(VkCommandBuffer commandBuffer)
+{
+    cmdEndRendering(commandBuffer);
+}
+
+void DynamicRendering::transitionToPresent(VkCommandBuffer commandBuffer, BarrierBatch& barrierBatch, VkImage image)
+{
+    barrierBatch.useImage(image, ResourceUsage::Present);
+    barrierBatch.flush(commandBuffer);
+}
+
+void DynamicRendering::recordResize(bool usesRenderPass, double ms)
+{
+    PathStats& stats = usesRenderPass ? renderPassStats : dynamicStats;
+    stats.resizeMs += ms;
+    stats.resizeCount++;
+}
+
+void DynamicRendering::recordFrame(bool usesRenderPass, double us)
+{
+    PathStats& stats = usesRenderPass ? renderPassStats : dynamicStats;
+    stats.frameUs += us;
+    stats.frameCount++;
+}
+
+void DynamicRendering::benchmark(VkDevice device, VkCommandPool commandPool, BarrierBatch& barrierBatch, VkFormat format, VkImage image,
+    VkImageView imageView, VkExtent2D extent, uint32_t imageCount, uint32_t iterations)
+{
+    if (!supported)
+    {
+        return;
+    }
+
+    // 和 createRenderPass 里的一样：一个 color attachment，clear + store，最后转成 present
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = format;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkAttachmentReference colorAttachmentRef{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    VkRenderPass renderPass;
+    if (vkd.vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass!");
+    }
+
+    // resize 时 render pass 路径比 dynamic rendering 多出来的就是这些 framebuffer
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &imageView;
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+    std::vector<VkFramebuffer> framebuffers(imageCount);
+    auto framebufferStart = std::chrono::steady_clock::now();
+    for (auto& framebuffer : framebuffers)
+    {
+        if (vkd.vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+    framebufferCreateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - framebufferStart).count();
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (vkd.vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkd.vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+    VkRenderPassBeginInfo renderPassBegin{};
+    renderPassBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBegin.renderPass = renderPass;
+    renderPassBegin.framebuffer = framebuffers[0];
+    renderPassBegin.renderArea = { { 0, 0 }, extent };
+    renderPassBegin.clearValueCount = 1;
+    renderPassBegin.pClearValues = &clearColor;
+
+    RenderTargets targets;
+    targets.color = image;
+    targets.colorView = imageView;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        vkd.vkCmdBeginRenderPass(commandBuffer, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+        vkd.vkCmdEndRenderPass(commandBuffer);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        transitionTargets(commandBuffer, barrierBatch, targets);
+        beginRendering(commandBuffer, targets, extent, clearColor);
+        endRendering(commandBuffer);
+        transitionToPresent(commandBuffer, barrierBatch, image);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    vkd.vkEndCommandBuffer(commandBuffer);
+    vkd.vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    barrierBatch.forgetImage(image);
+    for (VkFramebuffer framebuffer : framebuffers)
+    {
+        vkd.vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
+    vkd.vkDestroyRenderPass(device, renderPass, nullptr);
+
+    benchmarkIterations = iterations;
+    renderPassRecordUs = std::chrono::duration<double, std::micro>(middle - start).count() / iterations;
+    dynamicRecordUs = std::chrono::duration<double, std::micro>(end - middle).count() / iterations;
+}
+
+void DynamicRendering::printReport() const
+{
+    if (!supported)
+    {
+        return;
+    }
+    std::cout << "dynamic rendering vs render pass:" << std::endl;
+    for (int i = 0; i < 2; i++)
+    {
+        const PathStats& stats = i == 0 ? renderPassStats : dynamicStats;
+        if (stats.resizeCount == 0 && stats.frameCount == 0)
+        {
+            continue;
+        }
+        std::cout << "  " << (i == 0 ? "render pass" : "dynamic rendering") << ": "
+            << stats.resizeCount << " resizes, " << (stats.resizeCount ? stats.resizeMs / stats.resizeCount : 0.0) << " ms each, "
+            << stats.frameCount << " frames, record " << (stats.frameCount ? stats.frameUs / stats.frameCount : 0.0) << " us each" << std::endl;
+    }
+    if (benchmarkIterations > 0)
+    {
+        std::cout << "  framebuffers per resize " << framebufferCreateMs << " ms (dynamic rendering: none)" << std::endl;
+        std::cout << "  begin/end per frame: render pass " << renderPassRecordUs << " us, dynamic rendering + barriers "
+            << dynamicRecordUs << " us" << std::endl;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "BarrierBatch.h"
+#include "CoreFeatures.h"
+#include "DeviceCapabilities.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// VK_KHR_dynamic_rendering（1.3 里是核心）。
+// 不再创建 VkRenderPass / VkFramebuffer，录制时直接拿 image view 开始渲染，
+// 布局转换用显式 barrier 完成；swapchain 重建时只需要重建 image view。
+// shader object 路径也走这里。1.3 的设备上直接用核心版本，feature 由 CoreFeatures 打开，不再加扩展。
+
+// 一帧的渲染目标。msaaColorView 不为空时画到多重采样图像上，结束时 resolve 到 color，
+// 多重采样图像本身不保存；depthView 不为空时深度 clear 成 1.0，同样不保存。
+// colorView 为空时只有深度（depth pre-pass）；loadDepth / storeDepth 用在深度要跨 pass 传下去的时候
+struct RenderTargets
+{
+    VkImage color = VK_NULL_HANDLE;
+    VkImageView colorView = VK_NULL_HANDLE;
+    VkImage msaaColor = VK_NULL_HANDLE;
+    VkImageView msaaColorView = VK_NULL_HANDLE;
+    VkImage depth = VK_NULL_HANDLE;
+    VkImageView depthView = VK_NULL_HANDLE;
+    VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    bool loadDepth = false;
+    bool storeDepth = false;
+};
+
+class DynamicRendering
+{
+public:
+    void query(const DeviceCapabilities& capabilities, const FeatureFlags& coreFeatures);
+    void appendDeviceExtensions(std::vector<const char*>& extensions) const;
+    void* chainFeatures(void* pNext);
+    void load(VkDevice device);
+
+    bool enabled() const { return supported; }
+
+    // begin/end 本身不做布局转换，帧里由 RenderGraph 统一加 barrier；
+    // 单独使用时用 transitionTargets（所有目标 UNDEFINED -> attachment 布局）和 transitionToPresent，
+    // 都通过 barrierBatch 按用途算 barrier，并在返回前 flush
+    void transitionTargets(VkCommandBuffer commandBuffer, BarrierBatch& barrierBatch, const RenderTargets& targets);
+    // clear 所有目标，只有交换链图像（或 resolve 的结果）store
+    void beginRendering(VkCommandBuffer commandBuffer, const RenderTargets& targets, VkExtent2D extent, VkClearValue clearValue);
+    void endRendering(VkCommandBuffer commandBuffer);
+    // COLOR_ATTACHMENT_OPTIMAL -> PRESENT_SRC_KHR，image 要先经过 transitionTargets
+    void transitionToPresent(VkCommandBuffer commandBuffer, BarrierBatch& barrierBatch, VkImage image);
+
+    // 运行时的实际开销，usesRenderPass 表示当前走的是哪条路径
+    void recordResize(bool usesRenderPass, double ms);
+    void recordFrame(bool usesRenderPass, double us);
+    // 用一个等价的单 attachment render pass 对比两条路径：
+    // 重建 imageCount 个 framebuffer 的耗时，以及 iterations 次 begin/end 的录制耗时。command buffer 不提交
+    void benchmark(VkDevice device, VkCommandPool commandPool, BarrierBatch& barrierBatch, VkFormat format, VkImage image,
+        VkImageView imageView, VkExtent2D extent, uint32_t imageCount, uint32_t iterations);
+    void printReport() const;
+
+private:
+    struct PathStats
+    {
+        double resizeMs = 0.0;
+        uint32_t resizeCount = 0;
+        double frameUs = 0.0;
+        uint32_t frameCount = 0;
+    };
+
+    bool supported = false;
+    // 走 1.3 核心版本
+    bool core = false;
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+
+    PathStats renderPassStats;
+    PathStats dynamicStats;
+    double framebufferCreateMs = 0.0;
+    double renderPassRecordUs = 0.0;
+    double dynamicRecordUs = 0.0;
+    uint32_t benchmarkIterations = 0;
+
+    PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+};
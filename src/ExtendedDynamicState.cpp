@@ -0,0 +1,323 @@
+#include "ExtendedDynamicState.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+
+static VkPrimitiveTopology topologyClass(VkPrimitiveTopology topology)
+{
+    switch (topology)
+    {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+        return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+        return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+        return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+    default:
+        return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    }
+}
+
+static uint32_t stateBit(VkDynamicState state)
+{
+    return 1u << dynamicStateBit(state);
+}
+
+void ExtendedDynamicState::query(const DeviceCapabilities& capabilities)
+{
+    eds1 = eds2 = false;
+    eds3Mask = 0;
+
+    if (!capabilities.apiVersionAtLeast(VK_API_VERSION_1_1))
+    {
+        // 没有 vkGetPhysicalDeviceFeatures2，查不了 feature
+        return;
+    }
+
+    eds1Features = {};
+    eds1Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+    eds2Features = {};
+    eds2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+    eds3Features = {};
+    eds3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    void** ppNext = &features.pNext;
+    bool hasEds1 = capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+    bool hasEds2 = capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+    bool hasEds3 = capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+    if (hasEds1)
+    {
+        *ppNext = &eds1Features;
+        ppNext = &eds1Features.pNext;
+    }
+    if (hasEds2)
+    {
+        *ppNext = &eds2Features;
+        ppNext = &eds2Features.pNext;
+    }
+    if (hasEds3)
+    {
+        *ppNext = &eds3Features;
+        ppNext = &eds3Features.pNext;
+    }
+    vkGetPhysicalDeviceFeatures2(capabilities.physicalDevice, &features);
+
+    eds1 = hasEds1 && eds1Features.extendedDynamicState;
+    eds2 = hasEds2 && eds2Features.extendedDynamicState2;
+    if (hasEds3)
+    {
+        if (eds3Features.extendedDynamicState3DepthClampEnable)
+            eds3Mask |= stateBit(VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT);
+        if (eds3Features.extendedDynamicState3PolygonMode)
+            eds3Mask |= stateBit(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+        if (eds3Features.extendedDynamicState3LogicOpEnable)
+            eds3Mask |= stateBit(VK_DYNAMIC_STATE_LOGIC_OP_ENABLE_EXT);
+        if (eds3Features.extendedDynamicState3ColorBlendEnable)
+            eds3Mask |= stateBit(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+        if (eds3Features.extendedDynamicState3ColorBlendEquation)
+            eds3Mask |= stateBit(VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT);
+        if (eds3Features.extendedDynamicState3ColorWriteMask)
+            eds3Mask |= stateBit(VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT);
+    }
+
+    std::cout << "extended dynamic state: eds1 " << eds1 << ", eds2 " << eds2
+        << ", eds3 states 0x" << std::hex << eds3Mask << std::dec << std::endl;
+}
+
+void ExtendedDynamicState::appendDeviceExtensions(std::vector<const char*>& extensions) const
+{
+    if (eds1)
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+    if (eds2)
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+    if (eds3Mask != 0)
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+}
+
+void* ExtendedDynamicState::chainFeatures(void* pNext)
+{
+    // 查询到的 feature 原样打开
+    if (eds1)
+    {
+        eds1Features.pNext = pNext;
+        pNext = &eds1Features;
+    }
+    if (eds2)
+    {
+        eds2Features.pNext = pNext;
+        pNext = &eds2Features;
+    }
+    if (eds3Mask != 0)
+    {
+        eds3Features.pNext = pNext;
+        pNext = &eds3Features;
+    }
+    return pNext;
+}
+
+void ExtendedDynamicState::load(VkDevice device)
+{
+    if (eds1)
+    {
+        cmdSetCullMode = (PFN_vkCmdSetCullModeEXT)vkGetDeviceProcAddr(device, "vkCmdSetCullModeEXT");
+        cmdSetFrontFace = (PFN_vkCmdSetFrontFaceEXT)vkGetDeviceProcAddr(device, "vkCmdSetFrontFaceEXT");
+        cmdSetPrimitiveTopology = (PFN_vkCmdSetPrimitiveTopologyEXT)vkGetDeviceProcAddr(device, "vkCmdSetPrimitiveTopologyEXT");
+        cmdSetDepthTestEnable = (PFN_vkCmdSetDepthTestEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthTestEnableEXT");
+        cmdSetDepthWriteEnable = (PFN_vkCmdSetDepthWriteEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthWriteEnableEXT");
+        cmdSetDepthCompareOp = (PFN_vkCmdSetDepthCompareOpEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthCompareOpEXT");
+        eds1 = cmdSetCullMode && cmdSetFrontFace && cmdSetPrimitiveTopology &&
+            cmdSetDepthTestEnable && cmdSetDepthWriteEnable && cmdSetDepthCompareOp;
+    }
+    if (eds2)
+    {
+        cmdSetRasterizerDiscardEnable = (PFN_vkCmdSetRasterizerDiscardEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetRasterizerDiscardEnableEXT");
+        cmdSetDepthBiasEnable = (PFN_vkCmdSetDepthBiasEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthBiasEnableEXT");
+        cmdSetPrimitiveRestartEnable = (PFN_vkCmdSetPrimitiveRestartEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetPrimitiveRestartEnableEXT");
+        eds2 = cmdSetRasterizerDiscardEnable && cmdSetDepthBiasEnable && cmdSetPrimitiveRestartEnable;
+    }
+    if (eds3Mask != 0)
+    {
+        cmdSetDepthClampEnable = (PFN_vkCmdSetDepthClampEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthClampEnableEXT");
+        cmdSetPolygonMode = (PFN_vkCmdSetPolygonModeEXT)vkGetDeviceProcAddr(device, "vkCmdSetPolygonModeEXT");
+        cmdSetLogicOpEnable = (PFN_vkCmdSetLogicOpEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetLogicOpEnableEXT");
+        cmdSetColorBlendEnable = (PFN_vkCmdSetColorBlendEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetColorBlendEnableEXT");
+        cmdSetColorBlendEquation = (PFN_vkCmdSetColorBlendEquationEXT)vkGetDeviceProcAddr(device, "vkCmdSetColorBlendEquationEXT");
+        cmdSetColorWriteMask = (PFN_vkCmdSetColorWriteMaskEXT)vkGetDeviceProcAddr(device, "vkCmdSetColorWriteMaskEXT");
+        if (!cmdSetDepthClampEnable) eds3Mask &= ~stateBit(VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT);
+        if (!cmdSetPolygonMode) eds3Mask &= ~stateBit(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+        if (!cmdSetLogicOpEnable) eds3Mask &= ~stateBit(VK_DYNAMIC_STATE_LOGIC_OP_ENABLE_EXT);
+        if (!cmdSetColorBlendEnable) eds3Mask &= ~stateBit(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT);
+        if (!cmdSetColorBlendEquation) eds3Mask &= ~stateBit(VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT);
+        if (!cmdSetColorWriteMask) eds3Mask &= ~stateBit(VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT);
+    }
+}
+
+uint32_t ExtendedDynamicState::dynamicMask() const
+{
+    uint32_t mask = eds3Mask;
+    if (eds1)
+    {
+        mask |= stateBit(VK_DYNAMIC_STATE_CULL_MODE_EXT) | stateBit(VK_DYNAMIC_STATE_FRONT_FACE_EXT) |
+            stateBit(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT) | stateBit(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT) |
+            stateBit(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT) | stateBit(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT);
+    }
+    if (eds2)
+    {
+        mask |= stateBit(VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE_EXT) |
+            stateBit(VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT) | stateBit(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT);
+    }
+    return mask;
+}
+
+PipelineStateKey ExtendedDynamicState::collapse(const PipelineStateKey& baked)
+{
+    PipelineStateKey key = baked;
+    key.dynamicStateMask |= dynamicMask();
+    if (eds1)
+    {
+        key.cullMode = VK_CULL_MODE_NONE;
+        key.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        // 只有 topology 的大类是 dynamic，pipeline 里要烘焙同一类里的代表
+        key.topology = topologyClass(static_cast<VkPrimitiveTopology>(baked.topology));
+        key.depthTestEnable = VK_FALSE;
+        key.depthWriteEnable = VK_FALSE;
+        key.depthCompareOp = VK_COMPARE_OP_LESS;
+    }
+    if (eds2)
+    {
+        key.rasterizerDiscardEnable = VK_FALSE;
+        key.depthBiasEnable = VK_FALSE;
+        key.primitiveRestartEnable = VK_FALSE;
+    }
+    if (eds3Mask & stateBit(VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT))
+        key.depthClampEnable = VK_FALSE;
+    if (eds3Mask & stateBit(VK_DYNAMIC_STATE_POLYGON_MODE_EXT))
+        key.polygonMode = VK_POLYGON_MODE_FILL;
+    if (eds3Mask & stateBit(VK_DYNAMIC_STATE_LOGIC_OP_ENABLE_EXT))
+        key.logicOpEnable = VK_FALSE;
+    if (eds3Mask & stateBit(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT))
+        key.blendEnable = VK_FALSE;
+    if (eds3Mask & stateBit(VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT))
+        key.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    if (eds3Mask & stateBit(VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT))
+    {
+        PipelineStateKey defaults{};
+        key.srcColorBlendFactor = defaults.srcColorBlendFactor;
+        key.dstColorBlendFactor = defaults.dstColorBlendFactor;
+        key.colorBlendOp = defaults.colorBlendOp;
+        key.srcAlphaBlendFactor = defaults.srcAlphaBlendFactor;
+        key.dstAlphaBlendFactor = defaults.dstAlphaBlendFactor;
+        key.alphaBlendOp = defaults.alphaBlendOp;
+    }
+    key.finalize();
+
+    requestedKeys.insert(baked.hash);
+    collapsedKeys.insert(key.hash);
+    return key;
+}
+
+void ExtendedDynamicState::cmdSetState(VkCommandBuffer commandBuffer, const PipelineStateKey& baked, const PipelineStateKey& pipelineKey) const
+{
+    auto isDynamic = [&](VkDynamicState state) { return (pipelineKey.dynamicStateMask & stateBit(state)) != 0; };
+
+    if (isDynamic(VK_DYNAMIC_STATE_CULL_MODE_EXT))
+        cmdSetCullMode(commandBuffer, baked.cullMode);
+    if (isDynamic(VK_DYNAMIC_STATE_FRONT_FACE_EXT))
+        cmdSetFrontFace(commandBuffer, static_cast<VkFrontFace>(baked.frontFace));
+    if (isDynamic(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT))
+        cmdSetPrimitiveTopology(commandBuffer, static_cast<VkPrimitiveTopology>(baked.topology));
+    if (isDynamic(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT))
+        cmdSetDepthTestEnable(commandBuffer, baked.depthTestEnable);
+    if (isDynamic(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT))
+        cmdSetDepthWriteEnable(commandBuffer, baked.depthWriteEnable);
+    if (isDynamic(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT))
+        cmdSetDepthCompareOp(commandBuffer, static_cast<VkCompareOp>(baked.depthCompareOp));
+    if (isDynamic(VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE_EXT))
+        cmdSetRasterizerDiscardEnable(commandBuffer, baked.rasterizerDiscardEnable);
+    if (isDynamic(VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT))
+        cmdSetDepthBiasEnable(commandBuffer, baked.depthBiasEnable);
+    if (isDynamic(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT))
+        cmdSetPrimitiveRestartEnable(commandBuffer, baked.primitiveRestartEnable);
+    if (isDynamic(VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT))
+        cmdSetDepthClampEnable(commandBuffer, baked.depthClampEnable);
+    if (isDynamic(VK_DYNAMIC_STATE_POLYGON_MODE_EXT))
+        cmdSetPolygonMode(commandBuffer, static_cast<VkPolygonMode>(baked.polygonMode));
+    if (isDynamic(VK_DYNAMIC_STATE_LOGIC_OP_ENABLE_EXT))
+        cmdSetLogicOpEnable(commandBuffer, baked.logicOpEnable);
+    // 每个颜色附件都要设，G-buffer 有两个；只有深度的 pipeline 没有颜色附件，不用设
+    uint32_t attachmentCount = baked.colorAttachmentCount;
+    if (attachmentCount > 0 && isDynamic(VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT))
+    {
+        VkBool32 blendEnable[MaxColorAttachments];
+        std::fill_n(blendEnable, attachmentCount, static_cast<VkBool32>(baked.blendEnable));
+        cmdSetColorBlendEnable(commandBuffer, 0, attachmentCount, blendEnable);
+    }
+    if (attachmentCount > 0 && isDynamic(VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT))
+    {
+        VkColorBlendEquationEXT equation{};
+        equation.srcColorBlendFactor = static_cast<VkBlendFactor>(baked.srcColorBlendFactor);
+        equation.dstColorBlendFactor = static_cast<VkBlendFactor>(baked.dstColorBlendFactor);
+        equation.colorBlendOp = static_cast<VkBlendOp>(baked.colorBlendOp);
+        equation.srcAlphaBlendFactor = static_cast<VkBlendFactor>(baked.srcAlphaBlendFactor);
+        equation.dstAlphaBlendFactor = static_cast<VkBlendFactor>(baked.dstAlphaBlendFactor);
+        equation.alphaBlendOp = static_cast<VkBlendOp>(baked.alphaBlendOp);
+        VkColorBlendEquationEXT equations[MaxColorAttachments];
+        std::fill_n(equations, attachmentCount, equation);
+        cmdSetColorBlendEquation(commandBuffer, 0, attachmentCount, equations);
+    }
+    if (attachmentCount > 0 && isDynamic(VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT))
+    {
+        VkColorComponentFlags writeMask[MaxColorAttachments];
+        std::fill_n(writeMask, attachmentCount, static_cast<VkColorComponentFlags>(baked.colorWriteMask));
+        cmdSetColorWriteMask(commandBuffer, 0, attachmentCount, writeMask);
+    }
+}
+
+void ExtendedDynamicState::printPermutationReport() const
+{
+    // 每个状态可取值的个数，乘起来就是只差这些状态时最坏情况下的 pipeline 数
+    struct StateRange { VkDynamicState state; double values; double dynamicValues; };
+    const double blendFactors = VK_BLEND_FACTOR_ONE_MINUS_SRC1_ALPHA + 1;
+    const double blendOps = VK_BLEND_OP_MAX + 1;
+    const double blendEquations = blendFactors * blendFactors * blendOps * blendFactors * blendFactors * blendOps;
+    const StateRange ranges[] = {
+        { VK_DYNAMIC_STATE_CULL_MODE_EXT, 4, 1 },
+        { VK_DYNAMIC_STATE_FRONT_FACE_EXT, 2, 1 },
+        // 剩下 point/line/triangle/patch 四类
+        { VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT, VK_PRIMITIVE_TOPOLOGY_PATCH_LIST + 1, 4 },
+        { VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT, VK_COMPARE_OP_ALWAYS + 1, 1 },
+        { VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_POLYGON_MODE_EXT, VK_POLYGON_MODE_POINT + 1, 1 },
+        { VK_DYNAMIC_STATE_LOGIC_OP_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT, 2, 1 },
+        { VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT, blendEquations, 1 },
+        { VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT, 16, 1 },
+    };
+
+    uint32_t mask = dynamicMask();
+    double baked = 1.0;
+    double dynamic = 1.0;
+    for (auto& range : ranges)
+    {
+        baked *= range.values;
+        dynamic *= (mask & stateBit(range.state)) ? range.dynamicValues : range.values;
+    }
+
+    std::cout << "pipeline permutations per shader/render pass (worst case): baked " << baked
+        << ", with extended dynamic state " << dynamic << " (" << baked / dynamic << "x fewer)" << std::endl;
+    std::cout << "pipeline states requested: " << requestedKeys.size()
+        << ", pipelines compiled after collapsing: " << collapsedKeys.size() << std::endl;
+}
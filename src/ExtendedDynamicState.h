@@ -0,0 +1,63 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+#include "PipelineStateCache.h"
+#include "VulkanExtCompat.h"
+
+#include <unordered_set>
+#include <vector>
+
+// VK_EXT_extended_dynamic_state 1/2/3 的支持情况。
+// 设备支持的状态改成 dynamic，pipeline key 里对应字段归一化，
+// 这样只差这些状态的 pipeline 会合并成一个，绘制时再用 vkCmdSet* 设置。
+// 设备不支持时什么都不做，pipeline 还是把状态烘焙进去。
+class ExtendedDynamicState
+{
+public:
+    // 在 isPhysicalDeviceSuitable 之后、创建 device 之前调用
+    void query(const DeviceCapabilities& capabilities);
+    // 把需要的扩展和 feature 结构挂到 device create info 上，返回新的 pNext 链头
+    void appendDeviceExtensions(std::vector<const char*>& extensions) const;
+    void* chainFeatures(void* pNext);
+    void load(VkDevice device);
+
+    bool enabled() const { return dynamicMask() != 0; }
+    // 会被改成 dynamic 的状态在 PipelineStateKey::dynamicStateMask 里的位
+    uint32_t dynamicMask() const;
+
+    // 返回烘焙状态对应的 pipeline key：能 dynamic 的状态加入 mask 并恢复默认值
+    PipelineStateKey collapse(const PipelineStateKey& baked);
+    // 把 key 里 dynamic 的那些状态设置到 command buffer 上，每次 bind pipeline 后调用
+    void cmdSetState(VkCommandBuffer commandBuffer, const PipelineStateKey& baked, const PipelineStateKey& pipelineKey) const;
+
+    // 打印每个 shader/pass 组合最坏情况下的 pipeline 数量，以及实际请求/编译的数量
+    void printPermutationReport() const;
+
+private:
+    bool eds1 = false;
+    bool eds2 = false;
+    uint32_t eds3Mask = 0;
+
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT eds1Features{};
+    VkPhysicalDeviceExtendedDynamicState2FeaturesEXT eds2Features{};
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT eds3Features{};
+
+    PFN_vkCmdSetCullModeEXT cmdSetCullMode = nullptr;
+    PFN_vkCmdSetFrontFaceEXT cmdSetFrontFace = nullptr;
+    PFN_vkCmdSetPrimitiveTopologyEXT cmdSetPrimitiveTopology = nullptr;
+    PFN_vkCmdSetDepthTestEnableEXT cmdSetDepthTestEnable = nullptr;
+    PFN_vkCmdSetDepthWriteEnableEXT cmdSetDepthWriteEnable = nullptr;
+    PFN_vkCmdSetDepthCompareOpEXT cmdSetDepthCompareOp = nullptr;
+    PFN_vkCmdSetRasterizerDiscardEnableEXT cmdSetRasterizerDiscardEnable = nullptr;
+    PFN_vkCmdSetDepthBiasEnableEXT cmdSetDepthBiasEnable = nullptr;
+    PFN_vkCmdSetPrimitiveRestartEnableEXT cmdSetPrimitiveRestartEnable = nullptr;
+    PFN_vkCmdSetDepthClampEnableEXT cmdSetDepthClampEnable = nullptr;
+    PFN_vkCmdSetPolygonModeEXT cmdSetPolygonMode = nullptr;
+    PFN_vkCmdSetLogicOpEnableEXT cmdSetLogicOpEnable = nullptr;
+    PFN_vkCmdSetColorBlendEnableEXT cmdSetColorBlendEnable = nullptr;
+    PFN_vkCmdSetColorBlendEquationEXT cmdSetColorBlendEquation = nullptr;
+    PFN_vkCmdSetColorWriteMaskEXT cmdSetColorWriteMask = nullptr;
+
+    std::unordered_set<uint64_t> requestedKeys;
+    std::unordered_set<uint64_t> collapsedKeys;
+};
@@ -0,0 +1,209 @@
+#include "FrameBottleneck.h"
+#include "VulkanDispatch.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+// GPU 忙的时间超过帧时间的这个比例就认为是 GPU-bound，即使 CPU 没在 fence 上等
+static const double GpuBusyThreshold = 0.9;
+
+const char* frameBoundName(FrameBound bound)
+{
+    switch (bound)
+    {
+    case CpuBound: return "CPU-bound";
+    case GpuBound: return "GPU-bound";
+    case AcquireBound: return "acquire-bound";
+    case PresentBound: return "present-bound";
+    default: return "unknown";
+    }
+}
+
+void FrameBottleneck::createQueries(const DeviceCapabilities& capabilities, VkDevice device, uint32_t frameCount)
+{
+    pending.assign(frameCount, PendingFrame{});
+    if (!capabilities.limits().timestampComputeAndGraphics)
+    {
+        std::cout << "frame bottleneck: no graphics timestamps, classifying from CPU timings only" << std::endl;
+        return;
+    }
+    timestampPeriod = capabilities.limits().timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = frameCount * 2;
+    if (vkd.vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create query pool!");
+    }
+}
+
+void FrameBottleneck::cmdBegin(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkd.vkCmdResetQueryPool(commandBuffer, queryPool, frame * 2, 2);
+        vkd.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, frame * 2);
+    }
+}
+
+void FrameBottleneck::cmdEnd(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkd.vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, frame * 2 + 1);
+        pending[frame].queried = true;
+    }
+}
+
+void FrameBottleneck::recordFrame(uint32_t frame, const FrameTimings& timings)
+{
+    pending[frame].valid = true;
+    pending[frame].timings = timings;
+}
+
+void FrameBottleneck::collect(VkDevice device, uint32_t frame)
+{
+    if (pending.empty())
+    {
+        return;
+    }
+    PendingFrame& entry = pending[frame];
+    double gpuMs = -1.0;
+    if (entry.queried)
+    {
+        uint64_t results[4] = {};
+        VkResult result = vkd.vkGetQueryPoolResults(device, queryPool, frame * 2, 2, sizeof(results), results, 2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result == VK_SUCCESS && results[1] != 0 && results[3] != 0)
+        {
+            gpuMs = (results[2] - results[0]) * timestampPeriod / 1e6;
+        }
+        entry.queried = false;
+    }
+    if (entry.valid)
+    {
+        classify(entry.timings, gpuMs);
+        entry.valid = false;
+    }
+}
+
+void FrameBottleneck::classify(const FrameTimings& timings, double gpuMs)
+{
+    FrameBoundSample sample;
+    sample.cpuWorkMs = std::max(0.0, timings.cpuMs - timings.acquireMs - timings.presentMs);
+    sample.gpuMs = gpuMs;
+    sample.fenceWaitMs = timings.fenceWaitMs;
+    sample.acquireMs = timings.acquireMs;
+    sample.presentMs = timings.presentMs;
+
+    double spans[FrameBoundCount] = { sample.cpuWorkMs, sample.fenceWaitMs, sample.acquireMs, sample.presentMs };
+    sample.bound = static_cast<FrameBound>(std::max_element(spans, spans + FrameBoundCount) - spans);
+    double frameMs = timings.cpuMs + timings.fenceWaitMs;
+    if (gpuMs > GpuBusyThreshold * frameMs)
+    {
+        sample.bound = GpuBound;
+    }
+
+    if (window.size() < windowFrames)
+    {
+        window.push_back(sample);
+    }
+    else
+    {
+        FrameBoundSample& slot = window[classified % windowFrames];
+        windowCounts[slot.bound]--;
+        slot = sample;
+    }
+    windowCounts[sample.bound]++;
+    totalCounts[sample.bound]++;
+    classified++;
+
+    auto now = std::chrono::steady_clock::now();
+    if (classified == 1)
+    {
+        lastLog = now;
+    }
+    else if (std::chrono::duration<double>(now - lastLog).count() >= logSeconds)
+    {
+        logWindow();
+        lastLog = now;
+    }
+}
+
+bool FrameBottleneck::lastFrame(FrameBoundSample& sample) const
+{
+    if (classified == 0)
+    {
+        return false;
+    }
+    sample = window[(classified - 1) % windowFrames];
+    return true;
+}
+
+FrameBound FrameBottleneck::windowBound() const
+{
+    return static_cast<FrameBound>(std::max_element(windowCounts, windowCounts + FrameBoundCount) - windowCounts);
+}
+
+double FrameBottleneck::windowShare(FrameBound bound) const
+{
+    return window.empty() ? 0.0 : static_cast<double>(windowCounts[bound]) / window.size();
+}
+
+void FrameBottleneck::logWindow() const
+{
+    double cpuWork = 0.0, gpu = 0.0, fenceWait = 0.0, acquire = 0.0, present = 0.0;
+    uint32_t gpuSamples = 0;
+    for (const FrameBoundSample& sample : window)
+    {
+        cpuWork += sample.cpuWorkMs;
+        fenceWait += sample.fenceWaitMs;
+        acquire += sample.acquireMs;
+        present += sample.presentMs;
+        if (sample.gpuMs >= 0.0)
+        {
+            gpu += sample.gpuMs;
+            gpuSamples++;
+        }
+    }
+    double n = static_cast<double>(window.size());
+    FrameBound bound = windowBound();
+    std::cout << "bottleneck: " << frameBoundName(bound) << " (" << static_cast<int>(windowShare(bound) * 100.0 + 0.5)
+        << "% of last " << window.size() << " frames; cpu " << cpuWork / n << " ms, gpu ";
+    if (gpuSamples > 0)
+    {
+        std::cout << gpu / gpuSamples << " ms";
+    }
+    else
+    {
+        std::cout << "n/a";
+    }
+    std::cout << ", fence wait " << fenceWait / n << " ms, acquire " << acquire / n << " ms, present " << present / n << " ms)" << std::endl;
+}
+
+void FrameBottleneck::printReport() const
+{
+    if (classified == 0)
+    {
+        return;
+    }
+    std::cout << "frame bottleneck (" << classified << " frames):";
+    for (uint32_t i = 0; i < FrameBoundCount; i++)
+    {
+        std::cout << " " << frameBoundName(static_cast<FrameBound>(i)) << " " << totalCounts[i] * 100 / classified << "%";
+    }
+    std::cout << std::endl;
+    logWindow();
+}
+
+void FrameBottleneck::destroy(VkDevice device)
+{
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkd.vkDestroyQueryPool(device, queryPool, nullptr);
+        queryPool = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+#include "FrameStatistics.h"
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+enum FrameBound : uint32_t
+{
+    CpuBound = 0,
+    GpuBound = 1,
+    AcquireBound = 2,
+    PresentBound = 3,
+    FrameBoundCount = 4,
+};
+
+const char* frameBoundName(FrameBound bound);
+
+// 一帧的归类结果和用到的时间，gpuMs < 0 表示没有 GPU 时间
+struct FrameBoundSample
+{
+    FrameBound bound = CpuBound;
+    double cpuWorkMs = 0.0;
+    double gpuMs = -1.0;
+    double fenceWaitMs = 0.0;
+    double acquireMs = 0.0;
+    double presentMs = 0.0;
+};
+
+// 判断每帧慢在哪里：CPU 自己在干活、等 fence（GPU 没跑完）、等 acquire（没有空闲的交换链图像）还是阻塞在 present。
+// 取这四段里最长的一段；GPU 时间（整个 command buffer 前后两个 timestamp）占到帧时间 90% 以上时直接算 GPU-bound。
+// GPU 时间要等同一个 frame in flight 的 fence 才能读回，所以一帧的归类晚 MAX_FRAMES_IN_FLIGHT 帧出来。
+// 最近 windowFrames 帧里最多的归类作为当前瓶颈，每 logSeconds 秒打印一行
+class FrameBottleneck
+{
+public:
+    uint32_t windowFrames = 120;
+    double logSeconds = 2.0;
+
+    // 设备不支持 graphics 队列的 timestamp 时只用 CPU 时间归类
+    void createQueries(const DeviceCapabilities& capabilities, VkDevice device, uint32_t frameCount);
+    // command buffer 的开头和结尾，都在 render pass 外面
+    void cmdBegin(VkCommandBuffer commandBuffer, uint32_t frame);
+    void cmdEnd(VkCommandBuffer commandBuffer, uint32_t frame);
+    // 等到这一帧的 fence 之后调用，归类这个 slot 上一次提交的帧
+    void collect(VkDevice device, uint32_t frame);
+    // present 之后调用，CPU 时间先存着，等 collect 时和 GPU 时间一起用
+    void recordFrame(uint32_t frame, const FrameTimings& timings);
+
+    // 最近归类的一帧，还没有时返回 false
+    bool lastFrame(FrameBoundSample& sample) const;
+    FrameBound windowBound() const;
+    // 滑动窗口里某种归类占的比例，0~1
+    double windowShare(FrameBound bound) const;
+
+    void printReport() const;
+    void destroy(VkDevice device);
+
+private:
+    struct PendingFrame
+    {
+        bool valid = false;
+        bool queried = false;
+        FrameTimings timings;
+    };
+
+    void classify(const FrameTimings& timings, double gpuMs);
+    void logWindow() const;
+
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    float timestampPeriod = 0.0f;
+    std::vector<PendingFrame> pending;
+
+    // 滑动窗口，环形覆盖
+    std::vector<FrameBoundSample> window;
+    uint64_t classified = 0;
+    uint32_t windowCounts[FrameBoundCount] = {};
+    uint64_t totalCounts[FrameBoundCount] = {};
+    std::chrono::steady_clock::time_point lastLog;
+};
@@ -0,0 +1,265 @@
+#include "FrameStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+// 前 128 格每格 1us，之后每个 2 的幂区间 64 格，最高到 2^37us
+static const uint32_t LinearBuckets = 128;
+static const uint32_t SubBuckets = 64;
+static const uint32_t MaxBit = 36;
+static const uint32_t BucketCount = LinearBuckets + (MaxBit - 6) * SubBuckets;
+// 窗口里样本太少时中位数没意义，不判卡顿
+static const uint64_t MinStutterSamples = 30;
+
+LatencyHistogram::LatencyHistogram()
+    : buckets(BucketCount, 0)
+{
+}
+
+uint32_t LatencyHistogram::bucketIndex(uint64_t us)
+{
+    if (us < LinearBuckets)
+    {
+        return static_cast<uint32_t>(us);
+    }
+    us = std::min<uint64_t>(us, (1ull << (MaxBit + 1)) - 1);
+    uint32_t msb = 63;
+    while ((us >> msb) == 0)
+    {
+        msb--;
+    }
+    uint32_t shift = msb - 6;
+    uint32_t sub = static_cast<uint32_t>(us >> shift);
+    return LinearBuckets + (shift - 1) * SubBuckets + (sub - SubBuckets);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(uint32_t index)
+{
+    if (index < LinearBuckets)
+    {
+        return index;
+    }
+    uint32_t offset = index - LinearBuckets;
+    uint32_t shift = offset / SubBuckets + 1;
+    uint64_t sub = offset % SubBuckets + SubBuckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+static uint64_t toMicroseconds(double ms)
+{
+    return ms <= 0.0 ? 0 : static_cast<uint64_t>(std::llround(ms * 1000.0));
+}
+
+void LatencyHistogram::add(double ms)
+{
+    buckets[bucketIndex(toMicroseconds(ms))]++;
+    total++;
+}
+
+void LatencyHistogram::remove(double ms)
+{
+    buckets[bucketIndex(toMicroseconds(ms))]--;
+    total--;
+}
+
+void LatencyHistogram::clear()
+{
+    std::fill(buckets.begin(), buckets.end(), 0);
+    total = 0;
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+    if (total == 0)
+    {
+        return 0.0;
+    }
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * total)));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BucketCount; i++)
+    {
+        seen += buckets[i];
+        if (seen >= target)
+        {
+            return bucketUpperBound(i) / 1000.0;
+        }
+    }
+    return bucketUpperBound(BucketCount - 1) / 1000.0;
+}
+
+void FrameStatistics::Percentiles::clampToMax()
+{
+    p50 = std::min(p50, max);
+    p90 = std::min(p90, max);
+    p99 = std::min(p99, max);
+    p999 = std::min(p999, max);
+}
+
+void FrameStatistics::Metric::add(double ms, uint32_t windowFrames)
+{
+    if (samples.size() < windowFrames)
+    {
+        samples.push_back(ms);
+    }
+    else
+    {
+        double& slot = samples[added % windowFrames];
+        window.remove(slot);
+        slot = ms;
+    }
+    window.add(ms);
+    lifetime.add(ms);
+    lifetimeMax = std::max(lifetimeMax, ms);
+    added++;
+}
+
+FrameStatistics::Percentiles FrameStatistics::Metric::windowPercentiles() const
+{
+    Percentiles result;
+    result.p50 = window.percentile(50.0);
+    result.p90 = window.percentile(90.0);
+    result.p99 = window.percentile(99.0);
+    result.p999 = window.percentile(99.9);
+    // max 用原始样本，不受格子精度影响
+    for (double sample : samples)
+    {
+        result.max = std::max(result.max, sample);
+    }
+    result.clampToMax();
+    return result;
+}
+
+FrameStatistics::Percentiles FrameStatistics::Metric::lifetimePercentiles() const
+{
+    Percentiles result;
+    result.p50 = lifetime.percentile(50.0);
+    result.p90 = lifetime.percentile(90.0);
+    result.p99 = lifetime.percentile(99.0);
+    result.p999 = lifetime.percentile(99.9);
+    result.max = lifetimeMax;
+    result.clampToMax();
+    return result;
+}
+
+void FrameStatistics::recordFrame(const FrameTimings& timings)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (frames == 0)
+    {
+        startTime = now;
+        lastReport = now;
+    }
+
+    cpu.add(timings.cpuMs, windowFrames);
+    fenceWait.add(timings.fenceWaitMs, windowFrames);
+    if (frames > 0)
+    {
+        double interval = std::chrono::duration<double, std::milli>(now - lastPresent).count();
+        // 和加入这一帧之前的窗口中位数比
+        if (presentInterval.window.count() >= MinStutterSamples)
+        {
+            double median = presentInterval.window.percentile(50.0);
+            if (interval > stutterFactor * median)
+            {
+                stutters++;
+                reportStutters++;
+                if (interval > worstStutterMs)
+                {
+                    worstStutterMs = interval;
+                    worstStutterFrame = frames;
+                }
+                std::cout << "stutter: frame " << frames << " present interval " << interval << " ms ("
+                    << interval / median << "x median " << median << " ms)" << std::endl;
+            }
+        }
+        presentInterval.add(interval, windowFrames);
+    }
+    lastPresent = now;
+    frames++;
+
+    double sinceReport = std::chrono::duration<double>(now - lastReport).count();
+    if (sinceReport >= reportSeconds)
+    {
+        writeReport(std::chrono::duration<double>(now - startTime).count());
+        lastReport = now;
+        reportStutters = 0;
+    }
+}
+
+void FrameStatistics::writeReport(double seconds)
+{
+    const Metric* metrics[] = { &cpu, &presentInterval, &fenceWait };
+
+    if (!csvPath.empty())
+    {
+        if (!csv.is_open())
+        {
+            csv.open(csvPath, std::ios::trunc);
+            if (!csv.is_open())
+            {
+                std::cerr << "failed to write frame statistics " << csvPath << std::endl;
+                csvPath.clear();
+                return;
+            }
+            csv << "time_s,frames,stutters";
+            for (const Metric* metric : metrics)
+            {
+                csv << "," << metric->name << "_p50," << metric->name << "_p90," << metric->name << "_p99,"
+                    << metric->name << "_p999," << metric->name << "_max";
+            }
+            csv << std::endl;
+        }
+        csv << std::fixed << std::setprecision(3) << seconds << "," << frames << "," << reportStutters;
+        for (const Metric* metric : metrics)
+        {
+            Percentiles p = metric->windowPercentiles();
+            csv << "," << p.p50 << "," << p.p90 << "," << p.p99 << "," << p.p999 << "," << p.max;
+        }
+        csv << std::endl;
+    }
+
+    // JSON 每次整个覆盖，只放最新的窗口
+    if (!jsonPath.empty())
+    {
+        std::ofstream json(jsonPath, std::ios::trunc);
+        if (!json.is_open())
+        {
+            std::cerr << "failed to write frame statistics " << jsonPath << std::endl;
+            return;
+        }
+        json << std::fixed << std::setprecision(3) << "{\"time_s\":" << seconds << ",\"frames\":" << frames
+            << ",\"window_frames\":" << windowFrames << ",\"stutters\":" << stutters << ",\"stutters_since_last\":" << reportStutters;
+        for (const Metric* metric : metrics)
+        {
+            Percentiles p = metric->windowPercentiles();
+            json << ",\"" << metric->name << "_ms\":{\"p50\":" << p.p50 << ",\"p90\":" << p.p90 << ",\"p99\":" << p.p99
+                << ",\"p99.9\":" << p.p999 << ",\"max\":" << p.max << "}";
+        }
+        json << "}" << std::endl;
+    }
+}
+
+void FrameStatistics::printReport() const
+{
+    if (frames == 0)
+    {
+        return;
+    }
+    std::cout << "frame statistics (" << frames << " frames, " << stutters << " stutters over " << stutterFactor << "x median";
+    if (stutters > 0)
+    {
+        std::cout << ", worst " << worstStutterMs << " ms at frame " << worstStutterFrame;
+    }
+    std::cout << "):" << std::endl;
+    const Metric* metrics[] = { &cpu, &presentInterval, &fenceWait };
+    for (const Metric* metric : metrics)
+    {
+        Percentiles all = metric->lifetimePercentiles();
+        Percentiles recent = metric->windowPercentiles();
+        std::cout << "  " << metric->name << ": p50 " << all.p50 << " / p90 " << all.p90 << " / p99 " << all.p99
+            << " / p99.9 " << all.p999 << " / max " << all.max << " ms (last " << metric->samples.size()
+            << " frames: p99 " << recent.p99 << ", max " << recent.max << " ms)" << std::endl;
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// HDR histogram 式的对数-线性直方图，单位微秒。
+// 每个 2 的幂区间分成 64 格，相对误差不超过 1/64；小于 128us 的值精确记录，上限约 68 秒
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void add(double ms);
+    // 只能移除之前 add 过的值，用来维护滑动窗口
+    void remove(double ms);
+    void clear();
+
+    uint64_t count() const { return total; }
+    // p 取 0~100，返回所在格子的上界（毫秒）
+    double percentile(double p) const;
+
+private:
+    static uint32_t bucketIndex(uint64_t us);
+    static uint64_t bucketUpperBound(uint32_t index);
+
+    std::vector<uint64_t> buckets;
+    uint64_t total = 0;
+};
+
+// drawFrame 每帧测到的时间
+struct FrameTimings
+{
+    // drawFrame 里除去等 fence 的时间，包括 acquire 和 present 里阻塞的时间
+    double cpuMs = 0.0;
+    double fenceWaitMs = 0.0;
+    double acquireMs = 0.0;
+    double recordMs = 0.0;
+    double presentMs = 0.0;
+};
+
+// 每帧的 CPU 时间、present 到 present 的间隔和 fence 等待时间，在最近 windowFrames 帧的滑动窗口和整个运行期间上
+// 算 p50 / p90 / p99 / p99.9 / max。present 间隔超过窗口中位数 stutterFactor 倍的帧记为卡顿。
+// 每隔 reportSeconds 秒往 CSV 追加一行、把最新的快照写成 JSON，给 dashboard 用
+class FrameStatistics
+{
+public:
+    uint32_t windowFrames = 1000;
+    double stutterFactor = 2.0;
+    double reportSeconds = 5.0;
+    // 为空则不写对应的文件
+    std::string csvPath;
+    std::string jsonPath;
+
+    // present 之后调用，present 间隔在这里量
+    void recordFrame(const FrameTimings& timings);
+
+    uint64_t frameCount() const { return frames; }
+    uint64_t stutterCount() const { return stutters; }
+
+    void printReport() const;
+
+private:
+    struct Percentiles
+    {
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+        double p999 = 0.0;
+        double max = 0.0;
+
+        // 格子上界可能比实际最大值还大，报告里的分位数不超过 max
+        void clampToMax();
+    };
+
+    struct Metric
+    {
+        explicit Metric(const char* name) : name(name) {}
+
+        const char* name;
+        LatencyHistogram window;
+        LatencyHistogram lifetime;
+        // 窗口里的原始样本，环形覆盖，出窗口时从 window 里减掉
+        std::vector<double> samples;
+        uint64_t added = 0;
+        double lifetimeMax = 0.0;
+
+        void add(double ms, uint32_t windowFrames);
+        Percentiles windowPercentiles() const;
+        Percentiles lifetimePercentiles() const;
+    };
+
+    void writeReport(double seconds);
+
+    Metric cpu{ "cpu" };
+    Metric presentInterval{ "present_interval" };
+    Metric fenceWait{ "fence_wait" };
+
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point lastPresent;
+    std::chrono::steady_clock::time_point lastReport;
+    uint64_t frames = 0;
+    uint64_t stutters = 0;
+    uint64_t reportStutters = 0;
+    double worstStutterMs = 0.0;
+    uint64_t worstStutterFrame = 0;
+    std::ofstream csv;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// FNV-1a 64 位哈希，pipeline key、SPIR-V 等都用它
+constexpr uint64_t FnvOffsetBasis = 0xcbf29ce484222325ull;
+constexpr uint64_t FnvPrime = 0x100000001b3ull;
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = FnvOffsetBasis)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FnvPrime;
+    }
+    return hash;
+}
+
+constexpr uint64_t hashString(const char* str, uint64_t seed = FnvOffsetBasis)
+{
+    uint64_t hash = seed;
+    while (*str) {
+        hash ^= static_cast<uint8_t>(*str++);
+        hash *= FnvPrime;
+    }
+    return hash;
+}
+
+inline uint64_t hashCombine(uint64_t seed, uint64_t value)
+{
+    return hashBytes(&value, sizeof(value), seed);
+}
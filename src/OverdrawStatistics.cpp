@@ -0,0 +1,51 @@
+#include "OverdrawStatistics.h"
+
+#include <iostream>
+
+void OverdrawStatistics::setMode(uint64_t frame, uint32_t mode)
+{
+    PendingFrame& pending = pendingFrames[frame % MaxPendingFrames];
+    pending.frame = frame;
+    pending.mode = mode;
+}
+
+void OverdrawStatistics::collect(const PipelineStatistics& statistics, uint64_t pixels)
+{
+    for (PendingFrame& pending : pendingFrames)
+    {
+        PipelineStatisticsResult result;
+        if (pending.frame == ~0ull || !statistics.resultsForFrame(pending.frame, result))
+        {
+            continue;
+        }
+        ModeStats& stats = modes[pending.mode];
+        stats.frames++;
+        stats.vertexInvocations += result.vertexShaderInvocations;
+        stats.fragmentInvocations += result.fragmentShaderInvocations;
+        stats.pixels += pixels;
+        pending.frame = ~0ull;
+    }
+}
+
+void OverdrawStatistics::printReport() const
+{
+    bool header = false;
+    for (uint32_t mode = 0; mode < OverdrawModeCount; mode++)
+    {
+        const ModeStats& stats = modes[mode];
+        if (stats.frames == 0)
+        {
+            continue;
+        }
+        if (!header)
+        {
+            std::cout << "overdraw (pipeline statistics):" << std::endl;
+            header = true;
+        }
+        std::cout << "  " << ((mode & OverdrawFrontToBack) ? "front-to-back" : "submission order")
+            << ((mode & OverdrawDepthPrePass) ? " + depth pre-pass" : "") << ((mode & OverdrawDeferred) ? " + deferred lighting" : "")
+            << ": " << stats.frames << " frames, vertex invocations " << stats.vertexInvocations / stats.frames
+            << ", fragment invocations " << stats.fragmentInvocations / stats.frames
+            << ", shaded fragments per pixel " << (double)stats.fragmentInvocations / stats.pixels << std::endl;
+    }
+}
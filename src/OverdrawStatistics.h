@@ -0,0 +1,50 @@
+#pragma once
+
+#include "PipelineStatistics.h"
+
+#include <array>
+#include <cstdint>
+
+// 绘制方式，几项可以组合
+enum OverdrawMode : uint32_t
+{
+    OverdrawFrontToBack = 1,
+    OverdrawDepthPrePass = 2,
+    OverdrawDeferred = 4,
+    OverdrawModeCount = 8,
+};
+
+// 用 PipelineStatistics 读回来的 vertex / fragment shader 调用次数，
+// 按绘制方式（是否排序、是否有 depth pre-pass）分别累计，用来比较 overdraw
+class OverdrawStatistics
+{
+public:
+    // 记录第 frame 帧（PipelineStatistics::currentFrame）的绘制方式，mode 是 OverdrawMode 的组合。每帧调用，不分配内存
+    void setMode(uint64_t frame, uint32_t mode);
+    // 把已经读回来的帧按绘制方式累计；pixels 是渲染目标的像素数
+    void collect(const PipelineStatistics& statistics, uint64_t pixels);
+
+    void printReport() const;
+
+private:
+    struct ModeStats
+    {
+        uint64_t frames = 0;
+        uint64_t vertexInvocations = 0;
+        uint64_t fragmentInvocations = 0;
+        uint64_t pixels = 0;
+    };
+
+    struct PendingFrame
+    {
+        uint64_t frame = ~0ull;
+        uint32_t mode = 0;
+    };
+
+    // 超过这么多帧还没有结果的就不再等了，槽位被新的帧覆盖
+    static const uint32_t MaxPendingFrames = 16;
+
+    // 按帧号取模放，结果读回来之前一直留着
+    std::array<PendingFrame, MaxPendingFrames> pendingFrames;
+    std::array<ModeStats, OverdrawModeCount> modes;
+};
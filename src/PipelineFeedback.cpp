@@ -0,0 +1,113 @@
+#include "PipelineFeedback.h"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+static const char* stageName(VkShaderStageFlagBits stage)
+{
+    switch (stage)
+    {
+    case VK_SHADER_STAGE_VERTEX_BIT: return "vert";
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return "tesc";
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return "tese";
+    case VK_SHADER_STAGE_GEOMETRY_BIT: return "geom";
+    case VK_SHADER_STAGE_FRAGMENT_BIT: return "frag";
+    default: return "other";
+    }
+}
+
+void PipelineFeedback::query(const DeviceCapabilities& capabilities)
+{
+    supported = capabilities.hasExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    std::cout << "pipeline creation feedback: " << (supported ? "enabled" : "not supported") << std::endl;
+}
+
+void PipelineFeedback::appendDeviceExtensions(std::vector<const char*>& extensions) const
+{
+    if (supported)
+    {
+        extensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    }
+}
+
+void PipelineFeedback::attach(Capture& capture, VkGraphicsPipelineCreateInfo& pipelineInfo) const
+{
+    if (!supported)
+    {
+        return;
+    }
+    capture.stages.assign(pipelineInfo.stageCount, VkPipelineCreationFeedbackEXT{});
+    capture.info = {};
+    capture.info.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+    capture.info.pNext = pipelineInfo.pNext;
+    capture.info.pPipelineCreationFeedback = &capture.pipeline;
+    capture.info.pipelineStageCreationFeedbackCount = pipelineInfo.stageCount;
+    capture.info.pPipelineStageCreationFeedbacks = capture.stages.empty() ? nullptr : capture.stages.data();
+    pipelineInfo.pNext = &capture.info;
+}
+
+void PipelineFeedback::record(const std::string& name, const Capture& capture, const VkGraphicsPipelineCreateInfo& pipelineInfo)
+{
+    if (!supported)
+    {
+        return;
+    }
+
+    Record record{};
+    record.name = name;
+    record.valid = (capture.pipeline.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) != 0;
+    record.cacheHit = (capture.pipeline.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) != 0;
+    record.basePipelineAcceleration = (capture.pipeline.flags & VK_PIPELINE_CREATION_FEEDBACK_BASE_PIPELINE_ACCELERATION_BIT_EXT) != 0;
+    record.ms = capture.pipeline.duration / 1e6;
+    for (size_t i = 0; i < capture.stages.size(); i++)
+    {
+        const auto& stage = capture.stages[i];
+        record.stages.push_back({ pipelineInfo.pStages[i].stage, (stage.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) != 0,
+            stage.duration / 1e6 });
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    records.push_back(std::move(record));
+}
+
+void PipelineFeedback::printReport() const
+{
+    if (!supported)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t valid = 0;
+    uint32_t hits = 0;
+    double totalMs = 0.0;
+    std::cout << "pipeline creation feedback:" << std::endl;
+    // 表格用 std::left 对齐名字，打完恢复，不影响后面的输出
+    std::ios_base::fmtflags coutFlags = std::cout.flags();
+    for (auto& record : records)
+    {
+        std::cout << "  " << std::left << std::setw(28) << record.name;
+        if (!record.valid)
+        {
+            std::cout << "no feedback from driver" << std::endl;
+            continue;
+        }
+        valid++;
+        hits += record.cacheHit ? 1 : 0;
+        totalMs += record.ms;
+        std::cout << record.ms << " ms" << (record.cacheHit ? ", cache hit" : ", cache miss")
+            << (record.basePipelineAcceleration ? ", base pipeline" : "");
+        for (auto& stage : record.stages)
+        {
+            if (stage.valid)
+            {
+                std::cout << ", " << stageName(stage.stage) << " " << stage.ms << " ms";
+            }
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "  " << records.size() << " pipelines, " << valid << " with feedback, cache hits " << hits << "/" << valid
+        << ", total " << totalMs << " ms" << std::endl;
+    std::cout.flags(coutFlags);
+}
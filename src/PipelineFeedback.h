@@ -0,0 +1,59 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// VK_EXT_pipeline_creation_feedback。
+// 每次 vkCreateGraphicsPipelines 之前 attach 一个 Capture，创建完 record，
+// 记下总耗时、每个阶段的耗时以及是否命中应用的 VkPipelineCache。
+// 扩展不支持时 attach/record 什么都不做，调用方不用判断
+class PipelineFeedback
+{
+public:
+    struct Capture
+    {
+        VkPipelineCreationFeedbackEXT pipeline{};
+        std::vector<VkPipelineCreationFeedbackEXT> stages;
+        VkPipelineCreationFeedbackCreateInfoEXT info{};
+    };
+
+    void query(const DeviceCapabilities& capabilities);
+    void appendDeviceExtensions(std::vector<const char*>& extensions) const;
+    bool enabled() const { return supported; }
+
+    // 把 capture 挂到 pipelineInfo 的 pNext 链最前面，capture 要活到 create 调用结束
+    void attach(Capture& capture, VkGraphicsPipelineCreateInfo& pipelineInfo) const;
+    // create 返回后调用，可以在任何线程
+    void record(const std::string& name, const Capture& capture, const VkGraphicsPipelineCreateInfo& pipelineInfo);
+
+    // 随时可以调用，cleanUp 里也会打印一次
+    void printReport() const;
+
+private:
+    struct StageRecord
+    {
+        VkShaderStageFlagBits stage;
+        bool valid;
+        double ms;
+    };
+
+    struct Record
+    {
+        std::string name;
+        bool valid;
+        bool cacheHit;
+        bool basePipelineAcceleration;
+        double ms;
+        std::vector<StageRecord> stages;
+    };
+
+    bool supported = false;
+    mutable std::mutex mutex;
+    std::vector<Record> records;
+};
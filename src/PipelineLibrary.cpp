@@ -0,0 +1,436 @@
+#include "PipelineLibrary.h"
+#include "Profiler.h"
+#include "VulkanDispatch.h"
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+enum LibraryPart
+{
+    VertexInputPart = 0,
+    PreRasterizationPart = 1,
+    FragmentShaderPart = 2,
+    FragmentOutputPart = 3,
+};
+
+static const VkGraphicsPipelineLibraryFlagsEXT libraryPartFlags[4] = {
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+};
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 每个 library 只依赖 key 里的一部分字段，只对这部分求哈希
+static uint64_t libraryHash(uint32_t part, const PipelineStateKey& key, const std::vector<ShaderStage>& stages)
+{
+    uint64_t hash = hashCombine(FnvOffsetBasis, part);
+    hash = hashCombine(hash, key.dynamicStateMask);
+    switch (part)
+    {
+    case VertexInputPart:
+        hash = hashBytes(key.bindings, sizeof(key.bindings), hash);
+        hash = hashBytes(key.attributes, sizeof(key.attributes), hash);
+        hash = hashBytes(&key.bindingCount, 2, hash);
+        hash = hashBytes(&key.topology, 2, hash);
+        break;
+    case PreRasterizationPart:
+        for (auto& stage : stages)
+        {
+            if (stage.stage != VK_SHADER_STAGE_FRAGMENT_BIT)
+                hash = hashCombine(hash, stage.hash);
+        }
+        hash = hashCombine(hash, key.layout);
+        hash = hashCombine(hash, key.renderPass);
+        hash = hashCombine(hash, key.subpass);
+        // polygonMode 到 depthBiasEnable 是连续的 6 个字节
+        hash = hashBytes(&key.polygonMode, 6, hash);
+        hash = hashCombine(hash, key.lineWidthBits);
+        hash = hashCombine(hash, key.patchControlPoints);
+        break;
+    case FragmentShaderPart:
+        for (auto& stage : stages)
+        {
+            if (stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT)
+                hash = hashCombine(hash, stage.hash);
+        }
+        hash = hashCombine(hash, key.layout);
+        hash = hashCombine(hash, key.renderPass);
+        hash = hashCombine(hash, key.subpass);
+        hash = hashCombine(hash, key.depthFormat);
+        hash = hashCombine(hash, key.rasterizationSamples);
+        hash = hashBytes(&key.depthTestEnable, 3, hash);
+        break;
+    case FragmentOutputPart:
+        hash = hashCombine(hash, key.renderPass);
+        hash = hashCombine(hash, key.subpass);
+        hash = hashCombine(hash, key.colorFormat);
+        hash = hashCombine(hash, key.depthFormat);
+        hash = hashCombine(hash, key.colorAttachmentCount);
+        hash = hashCombine(hash, key.rasterizationSamples);
+        hash = hashBytes(&key.blendEnable, 3, hash);
+        hash = hashBytes(&key.srcColorBlendFactor, 6, hash);
+        break;
+    }
+    return hash;
+}
+
+void GraphicsPipelineLibrary::query(const DeviceCapabilities& capabilities)
+{
+    supported = false;
+
+    if (!capabilities.apiVersionAtLeast(VK_API_VERSION_1_1))
+    {
+        return;
+    }
+
+    if (!capabilities.hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) || !capabilities.hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME))
+    {
+        std::cout << "graphics pipeline library: not supported" << std::endl;
+        return;
+    }
+
+    gplFeatures = {};
+    gplFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &gplFeatures;
+    vkGetPhysicalDeviceFeatures2(capabilities.physicalDevice, &features);
+
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT gplProperties{};
+    gplProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &gplProperties;
+    vkGetPhysicalDeviceProperties2(capabilities.physicalDevice, &properties2);
+
+    supported = gplFeatures.graphicsPipelineLibrary == VK_TRUE;
+    fastLinking = gplProperties.graphicsPipelineLibraryFastLinking == VK_TRUE;
+    std::cout << "graphics pipeline library: " << (supported ? "enabled" : "feature off")
+        << ", fast linking " << fastLinking << std::endl;
+}
+
+void GraphicsPipelineLibrary::appendDeviceExtensions(std::vector<const char*>& extensions) const
+{
+    if (supported)
+    {
+        extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    }
+}
+
+void* GraphicsPipelineLibrary::chainFeatures(void* pNext)
+{
+    if (!supported)
+    {
+        return pNext;
+    }
+    gplFeatures.pNext = pNext;
+    return &gplFeatures;
+}
+
+VkResult GraphicsPipelineLibrary::createPipeline(VkDevice device, VkPipelineCache cache, VkGraphicsPipelineCreateInfo& pipelineInfo,
+    const std::string& name, VkPipeline& pipeline)
+{
+    if (!feedback)
+    {
+        return vkd.vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+    }
+    PipelineFeedback::Capture capture;
+    feedback->attach(capture, pipelineInfo);
+    VkResult result = vkd.vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+    if (result == VK_SUCCESS)
+    {
+        feedback->record(name, capture, pipelineInfo);
+    }
+    return result;
+}
+
+VkPipeline GraphicsPipelineLibrary::getOrCreateLibrary(VkDevice device, uint32_t part, uint64_t hash,
+    const PipelineStateKey& key, const std::vector<ShaderStage>& stages)
+{
+    auto it = libraries[part].find(hash);
+    if (it != libraries[part].end())
+    {
+        return it->second;
+    }
+
+    PipelineStateCreateInfo state(key);
+
+    // graphicsPipelineLibrary 打开时可以不建 VkShaderModule，直接把 SPIR-V 挂到 stage 的 pNext 上
+    std::vector<VkShaderModuleCreateInfo> moduleInfos;
+    std::vector<VkPipelineShaderStageCreateInfo> stageInfos;
+    std::vector<VkSpecializationInfo> specInfos;
+    moduleInfos.reserve(stages.size());
+    specInfos.reserve(stages.size());
+    for (auto& stage : stages)
+    {
+        bool isFragment = stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+        if ((part == PreRasterizationPart && !isFragment) || (part == FragmentShaderPart && isFragment))
+        {
+            VkShaderModuleCreateInfo moduleInfo{};
+            moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            moduleInfo.codeSize = stage.code.size();
+            moduleInfo.pCode = reinterpret_cast<const uint32_t*>(stage.code.data());
+            moduleInfos.push_back(moduleInfo);
+
+            VkPipelineShaderStageCreateInfo stageInfo{};
+            stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stageInfo.pNext = &moduleInfos.back();
+            stageInfo.stage = stage.stage;
+            stageInfo.module = VK_NULL_HANDLE;
+            stageInfo.pName = "main";
+            applySpecialization(stage, stageInfo, specInfos);
+            stageInfos.push_back(stageInfo);
+        }
+    }
+
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = libraryPartFlags[part];
+    // 没有 render pass 时，除了 vertex input 都要带上 attachment 格式
+    if (key.renderPass == 0 && part != VertexInputPart)
+    {
+        libraryInfo.pNext = &state.rendering;
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &libraryInfo;
+    pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    pipelineInfo.pDynamicState = &state.dynamicState;
+    switch (part)
+    {
+    case VertexInputPart:
+        pipelineInfo.pVertexInputState = &state.vertexInput;
+        pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+        break;
+    case PreRasterizationPart:
+        pipelineInfo.stageCount = static_cast<uint32_t>(stageInfos.size());
+        pipelineInfo.pStages = stageInfos.data();
+        pipelineInfo.pViewportState = &state.viewportState;
+        pipelineInfo.pRasterizationState = &state.rasterizer;
+        pipelineInfo.pTessellationState = key.patchControlPoints ? &state.tessellation : nullptr;
+        pipelineInfo.layout = (VkPipelineLayout)key.layout;
+        pipelineInfo.renderPass = (VkRenderPass)key.renderPass;
+        pipelineInfo.subpass = key.subpass;
+        break;
+    case FragmentShaderPart:
+        pipelineInfo.stageCount = static_cast<uint32_t>(stageInfos.size());
+        pipelineInfo.pStages = stageInfos.data();
+        pipelineInfo.pDepthStencilState = &state.depthStencil;
+        pipelineInfo.pMultisampleState = &state.multisampling;
+        pipelineInfo.layout = (VkPipelineLayout)key.layout;
+        pipelineInfo.renderPass = (VkRenderPass)key.renderPass;
+        pipelineInfo.subpass = key.subpass;
+        break;
+    case FragmentOutputPart:
+        pipelineInfo.pColorBlendState = &state.colorBlending;
+        pipelineInfo.pMultisampleState = &state.multisampling;
+        pipelineInfo.renderPass = (VkRenderPass)key.renderPass;
+        pipelineInfo.subpass = key.subpass;
+        break;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline library;
+    if (createPipeline(device, pipelineCache, pipelineInfo, "library part " + std::to_string(part), library) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline library!");
+    }
+    libraryMs += elapsedMs(start);
+    libraryCount++;
+
+    libraries[part][hash] = library;
+    return library;
+}
+
+VkPipeline GraphicsPipelineLibrary::linkLibraries(VkDevice device, const PipelineStateKey& key,
+    const LinkedLibraries& parts, bool optimize)
+{
+    VkPipelineLibraryCreateInfoKHR linkInfo{};
+    linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkInfo.libraryCount = 4;
+    linkInfo.pLibraries = parts.libraries;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &linkInfo;
+    pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineInfo.layout = (VkPipelineLayout)key.layout;
+
+    VkPipeline pipeline;
+    if (createPipeline(device, pipelineCache, pipelineInfo, optimize ? "link (optimized)" : "link", pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to link graphics pipeline libraries!");
+    }
+    return pipeline;
+}
+
+VkPipeline GraphicsPipelineLibrary::link(VkDevice device, const PipelineStateKey& key, const std::vector<ShaderStage>& stages)
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    LinkedLibraries parts;
+    for (uint32_t part = 0; part < 4; part++)
+    {
+        parts.libraries[part] = getOrCreateLibrary(device, part, libraryHash(part, key, stages), key, stages);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = linkLibraries(device, key, parts, false);
+    linkMs += elapsedMs(start);
+    linkCount++;
+
+    linked[key.hash] = parts;
+    return pipeline;
+}
+
+void GraphicsPipelineLibrary::optimizeInBackground(VkDevice device, const PipelineStateKey& key, PipelineStateCache& cache)
+{
+    OptimizeJob job{ device, key, {}, &cache };
+    {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        auto it = linked.find(key.hash);
+        if (it == linked.end())
+        {
+            return;
+        }
+        job.libraries = it->second;
+        linked.erase(it);
+    }
+
+    std::lock_guard<std::mutex> lock(jobMutex);
+    if (!worker.joinable())
+    {
+        worker = std::thread(&GraphicsPipelineLibrary::workerLoop, this);
+    }
+    jobs.push_back(job);
+    jobCondition.notify_one();
+}
+
+void GraphicsPipelineLibrary::workerLoop()
+{
+    PROFILE_THREAD("pipeline optimizer");
+    for (;;)
+    {
+        OptimizeJob job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        PROFILE_ZONE("optimizePipeline");
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline optimized = linkLibraries(job.device, job.key, job.libraries, true);
+        double ms = elapsedMs(start);
+        if (!job.cache->replace(job.key, optimized))
+        {
+            vkd.vkDestroyPipeline(job.device, optimized, nullptr);
+        }
+
+        std::lock_guard<std::mutex> lock(jobMutex);
+        optimizedMs += ms;
+        optimizedCount++;
+    }
+}
+
+void GraphicsPipelineLibrary::measureMonolithic(VkDevice device, const PipelineStateKey& key, const std::vector<ShaderStage>& stages)
+{
+    std::vector<VkShaderModule> modules;
+    std::vector<VkPipelineShaderStageCreateInfo> stageInfos;
+    std::vector<VkSpecializationInfo> specInfos;
+    specInfos.reserve(stages.size());
+    for (auto& stage : stages)
+    {
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = stage.code.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(stage.code.data());
+        VkShaderModule module;
+        if (vkd.vkCreateShaderModule(device, &moduleInfo, nullptr, &module) != VK_SUCCESS)
+        {
+            throw std::runtime_error("can't create shader module!");
+        }
+        modules.push_back(module);
+
+        VkPipelineShaderStageCreateInfo stageInfo{};
+        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage = stage.stage;
+        stageInfo.module = module;
+        stageInfo.pName = "main";
+        applySpecialization(stage, stageInfo, specInfos);
+        stageInfos.push_back(stageInfo);
+    }
+
+    PipelineStateCreateInfo state(key);
+    VkGraphicsPipelineCreateInfo pipelineInfo = state.info(stageInfos.data(), static_cast<uint32_t>(stageInfos.size()));
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline;
+    if (createPipeline(device, VK_NULL_HANDLE, pipelineInfo, "monolithic (uncached)", pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+    monolithicMs += elapsedMs(start);
+    monolithicCount++;
+
+    vkd.vkDestroyPipeline(device, pipeline, nullptr);
+    for (VkShaderModule module : modules)
+    {
+        vkd.vkDestroyShaderModule(device, module, nullptr);
+    }
+}
+
+void GraphicsPipelineLibrary::printReport() const
+{
+    if (!supported)
+    {
+        return;
+    }
+    auto average = [](double ms, uint32_t count) { return count ? ms / count : 0.0; };
+    std::lock_guard<std::mutex> libraryLock(libraryMutex);
+    std::lock_guard<std::mutex> jobLock(jobMutex);
+    std::cout << "graphics pipeline library (fast linking " << fastLinking << "):" << std::endl;
+    std::cout << "  libraries compiled: " << libraryCount << ", avg " << average(libraryMs, libraryCount) << " ms" << std::endl;
+    std::cout << "  fast links: " << linkCount << ", avg " << average(linkMs, linkCount) << " ms" << std::endl;
+    std::cout << "  optimized links: " << optimizedCount << ", avg " << average(optimizedMs, optimizedCount) << " ms" << std::endl;
+    if (monolithicCount > 0)
+    {
+        std::cout << "  monolithic compiles: " << monolithicCount << ", avg " << average(monolithicMs, monolithicCount) << " ms" << std::endl;
+    }
+}
+
+void GraphicsPipelineLibrary::destroy(VkDevice device)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+        jobCondition.notify_all();
+    }
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+    jobs.clear();
+
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    for (auto& partLibraries : libraries)
+    {
+        for (auto& entry : partLibraries)
+        {
+            vkd.vkDestroyPipeline(device, entry.second, nullptr);
+        }
+        partLibraries.clear();
+    }
+    linked.clear();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+#include "PipelineFeedback.h"
+#include "PipelineStateCache.h"
+#include "ShaderStage.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// VK_EXT_graphics_pipeline_library。
+// 一个 pipeline 拆成 vertex input / pre-rasterization / fragment shader / fragment output
+// 四个 library，各自按相关状态的哈希缓存，新组合只需要快速 link。
+// link 出来的 pipeline 先直接用，后台线程再做 link time optimization，完成后替换进 PipelineStateCache。
+class GraphicsPipelineLibrary
+{
+public:
+    void query(const DeviceCapabilities& capabilities);
+    void appendDeviceExtensions(std::vector<const char*>& extensions) const;
+    void* chainFeatures(void* pNext);
+
+    bool enabled() const { return supported; }
+    // library 和 link 都走应用的 VkPipelineCache；measureMonolithic 不用，测的是冷编译
+    void setPipelineCache(VkPipelineCache cache) { pipelineCache = cache; }
+    // 每次创建 library / link / 完整编译都记到 feedback 里
+    void setFeedback(PipelineFeedback* pipelineFeedback) { feedback = pipelineFeedback; }
+
+    // 在 PipelineStateCache 的创建回调里调用，返回未优化的 link 结果
+    VkPipeline link(VkDevice device, const PipelineStateKey& key, const std::vector<ShaderStage>& stages);
+    // key 插入 cache 之后调用，后台生成优化版本并替换
+    void optimizeInBackground(VkDevice device, const PipelineStateKey& key, PipelineStateCache& cache);
+    // 同样的状态完整编译一次，记录耗时用来和 link 对比，结果直接销毁
+    void measureMonolithic(VkDevice device, const PipelineStateKey& key, const std::vector<ShaderStage>& stages);
+
+    void printReport() const;
+    void destroy(VkDevice device);
+
+private:
+    struct LinkedLibraries
+    {
+        VkPipeline libraries[4];
+    };
+
+    struct OptimizeJob
+    {
+        VkDevice device;
+        PipelineStateKey key;
+        LinkedLibraries libraries;
+        PipelineStateCache* cache;
+    };
+
+    VkPipeline getOrCreateLibrary(VkDevice device, uint32_t part, uint64_t hash, const PipelineStateKey& key,
+        const std::vector<ShaderStage>& stages);
+    VkPipeline linkLibraries(VkDevice device, const PipelineStateKey& key, const LinkedLibraries& libraries, bool optimize);
+    VkResult createPipeline(VkDevice device, VkPipelineCache cache, VkGraphicsPipelineCreateInfo& pipelineInfo, const std::string& name,
+        VkPipeline& pipeline);
+    void workerLoop();
+
+    bool supported = false;
+    bool fastLinking = false;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    PipelineFeedback* feedback = nullptr;
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gplFeatures{};
+
+    mutable std::mutex libraryMutex;
+    std::unordered_map<uint64_t, VkPipeline> libraries[4];
+    std::unordered_map<uint64_t, LinkedLibraries> linked;
+
+    std::thread worker;
+    mutable std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    std::deque<OptimizeJob> jobs;
+    bool stopping = false;
+
+    // 耗时统计，单位毫秒
+    uint32_t libraryCount = 0;
+    double libraryMs = 0.0;
+    uint32_t linkCount = 0;
+    double linkMs = 0.0;
+    uint32_t optimizedCount = 0;
+    double optimizedMs = 0.0;
+    uint32_t monolithicCount = 0;
+    double monolithicMs = 0.0;
+};
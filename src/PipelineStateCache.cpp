@@ -0,0 +1,383 @@
+#include "PipelineStateCache.h"
+#include "Hash.h"
+#include "VulkanDispatch.h"
+#include "VulkanExtCompat.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+void PipelineStateKey::setVertexInput(const VkVertexInputBindingDescription* pBindings, uint32_t count,
+    const VkVertexInputAttributeDescription* pAttributes, uint32_t attrCount)
+{
+    if (count > MaxVertexBindings || attrCount > MaxVertexAttributes)
+    {
+        throw std::runtime_error("too many vertex bindings or attributes for pipeline state key!");
+    }
+    bindingCount = static_cast<uint8_t>(count);
+    attributeCount = static_cast<uint8_t>(attrCount);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        bindings[i].binding = static_cast<uint8_t>(pBindings[i].binding);
+        bindings[i].inputRate = static_cast<uint8_t>(pBindings[i].inputRate);
+        bindings[i].stride = static_cast<uint16_t>(pBindings[i].stride);
+    }
+    for (uint32_t i = 0; i < attrCount; i++)
+    {
+        attributes[i].location = static_cast<uint8_t>(pAttributes[i].location);
+        attributes[i].binding = static_cast<uint8_t>(pAttributes[i].binding);
+        attributes[i].offset = static_cast<uint16_t>(pAttributes[i].offset);
+        attributes[i].format = pAttributes[i].format;
+    }
+}
+
+// 核心 dynamic state 占 0-8 位，extended dynamic state 1/2/3 依次排在后面，正好 32 位
+static const VkDynamicState extendedDynamicStates[] = {
+    VK_DYNAMIC_STATE_CULL_MODE_EXT,
+    VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+    VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT,
+    VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT_EXT,
+    VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT_EXT,
+    VK_DYNAMIC_STATE_VERTEX_INPUT_BINDING_STRIDE_EXT,
+    VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+    VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+    VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT,
+    VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE_EXT,
+    VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE_EXT,
+    VK_DYNAMIC_STATE_STENCIL_OP_EXT,
+    VK_DYNAMIC_STATE_PATCH_CONTROL_POINTS_EXT,
+    VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE_EXT,
+    VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT,
+    VK_DYNAMIC_STATE_LOGIC_OP_EXT,
+    VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT,
+    VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT,
+    VK_DYNAMIC_STATE_POLYGON_MODE_EXT,
+    VK_DYNAMIC_STATE_LOGIC_OP_ENABLE_EXT,
+    VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT,
+    VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT,
+    VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT,
+};
+constexpr int FirstExtendedDynamicStateBit = VK_DYNAMIC_STATE_STENCIL_REFERENCE + 1;
+static_assert(FirstExtendedDynamicStateBit + sizeof(extendedDynamicStates) / sizeof(extendedDynamicStates[0]) <= 32,
+    "dynamic states do not fit into PipelineStateKey::dynamicStateMask");
+
+int dynamicStateBit(VkDynamicState state)
+{
+    if (state >= VK_DYNAMIC_STATE_VIEWPORT && state <= VK_DYNAMIC_STATE_STENCIL_REFERENCE)
+    {
+        return static_cast<int>(state);
+    }
+    for (int i = 0; i < static_cast<int>(sizeof(extendedDynamicStates) / sizeof(extendedDynamicStates[0])); i++)
+    {
+        if (extendedDynamicStates[i] == state)
+        {
+            return FirstExtendedDynamicStateBit + i;
+        }
+    }
+    return -1;
+}
+
+VkDynamicState dynamicStateFromBit(int bit)
+{
+    if (bit < FirstExtendedDynamicStateBit)
+    {
+        return static_cast<VkDynamicState>(bit);
+    }
+    return extendedDynamicStates[bit - FirstExtendedDynamicStateBit];
+}
+
+void PipelineStateKey::setDynamicStates(const VkDynamicState* pStates, uint32_t count)
+{
+    dynamicStateMask = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int bit = dynamicStateBit(pStates[i]);
+        if (bit < 0)
+        {
+            throw std::runtime_error("dynamic state is not supported by pipeline state key!");
+        }
+        dynamicStateMask |= 1u << bit;
+    }
+}
+
+void PipelineStateKey::setLineWidth(float width)
+{
+    std::memcpy(&lineWidthBits, &width, sizeof(width));
+}
+
+float PipelineStateKey::getLineWidth() const
+{
+    float width;
+    std::memcpy(&width, &lineWidthBits, sizeof(width));
+    return width;
+}
+
+bool PipelineStateKey::hasDynamicState(VkDynamicState state) const
+{
+    int bit = dynamicStateBit(state);
+    return bit >= 0 && (dynamicStateMask & (1u << bit)) != 0;
+}
+
+void PipelineStateKey::finalize()
+{
+    hash = hashBytes(this, offsetof(PipelineStateKey, hash));
+}
+
+bool PipelineStateKey::operator==(const PipelineStateKey& other) const
+{
+    return hash == other.hash && std::memcmp(this, &other, sizeof(PipelineStateKey)) == 0;
+}
+
+PipelineStateCreateInfo::PipelineStateCreateInfo(const PipelineStateKey& key)
+    : colorFormat(static_cast<VkFormat>(key.colorFormat)), layout((VkPipelineLayout)key.layout), renderPass((VkRenderPass)key.renderPass), subpass(key.subpass)
+{
+    for (uint32_t i = 0; i < key.bindingCount; i++)
+    {
+        bindings[i].binding = key.bindings[i].binding;
+        bindings[i].stride = key.bindings[i].stride;
+        bindings[i].inputRate = static_cast<VkVertexInputRate>(key.bindings[i].inputRate);
+    }
+    for (uint32_t i = 0; i < key.attributeCount; i++)
+    {
+        attributes[i].location = key.attributes[i].location;
+        attributes[i].binding = key.attributes[i].binding;
+        attributes[i].format = static_cast<VkFormat>(key.attributes[i].format);
+        attributes[i].offset = key.attributes[i].offset;
+    }
+    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInput.vertexBindingDescriptionCount = key.bindingCount;
+    vertexInput.pVertexBindingDescriptions = bindings;
+    vertexInput.vertexAttributeDescriptionCount = key.attributeCount;
+    vertexInput.pVertexAttributeDescriptions = attributes;
+
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = static_cast<VkPrimitiveTopology>(key.topology);
+    inputAssembly.primitiveRestartEnable = key.primitiveRestartEnable;
+
+    tessellation.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+    tessellation.patchControlPoints = key.patchControlPoints;
+
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = key.depthClampEnable;
+    rasterizer.rasterizerDiscardEnable = key.rasterizerDiscardEnable;
+    rasterizer.polygonMode = static_cast<VkPolygonMode>(key.polygonMode);
+    rasterizer.lineWidth = key.getLineWidth();
+    rasterizer.cullMode = key.cullMode;
+    rasterizer.frontFace = static_cast<VkFrontFace>(key.frontFace);
+    rasterizer.depthBiasEnable = key.depthBiasEnable;
+
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = static_cast<VkSampleCountFlagBits>(key.rasterizationSamples);
+
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = key.depthTestEnable;
+    depthStencil.depthWriteEnable = key.depthWriteEnable;
+    depthStencil.depthCompareOp = static_cast<VkCompareOp>(key.depthCompareOp);
+    depthStencil.minDepthBounds = 0.0f;
+    depthStencil.maxDepthBounds = 1.0f;
+
+    for (uint32_t i = 0; i < key.colorAttachmentCount; i++)
+    {
+        VkPipelineColorBlendAttachmentState& colorBlendAttachment = colorBlendAttachments[i];
+        colorBlendAttachment.colorWriteMask = key.colorWriteMask;
+        colorBlendAttachment.blendEnable = key.blendEnable;
+        colorBlendAttachment.srcColorBlendFactor = static_cast<VkBlendFactor>(key.srcColorBlendFactor);
+        colorBlendAttachment.dstColorBlendFactor = static_cast<VkBlendFactor>(key.dstColorBlendFactor);
+        colorBlendAttachment.colorBlendOp = static_cast<VkBlendOp>(key.colorBlendOp);
+        colorBlendAttachment.srcAlphaBlendFactor = static_cast<VkBlendFactor>(key.srcAlphaBlendFactor);
+        colorBlendAttachment.dstAlphaBlendFactor = static_cast<VkBlendFactor>(key.dstAlphaBlendFactor);
+        colorBlendAttachment.alphaBlendOp = static_cast<VkBlendOp>(key.alphaBlendOp);
+    }
+
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = key.logicOpEnable;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = key.colorAttachmentCount;
+    colorBlending.pAttachments = colorBlendAttachments;
+
+    for (int bit = 0; bit < 32; bit++)
+    {
+        if (key.dynamicStateMask & (1u << bit))
+        {
+            dynamicStates.push_back(dynamicStateFromBit(bit));
+        }
+    }
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    rendering.colorAttachmentCount = colorFormat == VK_FORMAT_UNDEFINED ? 0 : 1;
+    rendering.pColorAttachmentFormats = &colorFormat;
+    rendering.depthAttachmentFormat = static_cast<VkFormat>(key.depthFormat);
+}
+
+VkGraphicsPipelineCreateInfo PipelineStateCreateInfo::info(const VkPipelineShaderStageCreateInfo* pStages, uint32_t stageCount) const
+{
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = renderPass == VK_NULL_HANDLE ? &rendering : nullptr;
+    pipelineInfo.stageCount = stageCount;
+    pipelineInfo.pStages = pStages;
+    pipelineInfo.pVertexInputState = &vertexInput;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pTessellationState = tessellation.patchControlPoints ? &tessellation : nullptr;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = layout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    return pipelineInfo;
+}
+
+PipelineStateCache::PipelineStateCache(uint32_t initialCapacity)
+{
+    uint32_t capacity = 16;
+    while (capacity < initialCapacity)
+    {
+        capacity <<= 1;
+    }
+    tables.push_back(std::make_unique<Table>(capacity));
+    current.store(tables.back().get(), std::memory_order_release);
+}
+
+VkPipeline PipelineStateCache::probe(const Table* table, const PipelineStateKey& key)
+{
+    for (uint32_t i = static_cast<uint32_t>(key.hash) & table->mask;; i = (i + 1) & table->mask)
+    {
+        const Slot& slot = table->slots[i];
+        VkPipeline pipeline = slot.pipeline.load(std::memory_order_acquire);
+        if (pipeline == VK_NULL_HANDLE)
+        {
+            return VK_NULL_HANDLE;
+        }
+        if (slot.key == key)
+        {
+            return pipeline;
+        }
+    }
+}
+
+VkPipeline PipelineStateCache::find(const PipelineStateKey& key) const
+{
+    return probe(current.load(std::memory_order_acquire), key);
+}
+
+VkPipeline PipelineStateCache::getOrCreate(const PipelineStateKey& key, const CreateFn& create)
+{
+    VkPipeline pipeline = find(key);
+    if (pipeline != VK_NULL_HANDLE)
+    {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return pipeline;
+    }
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    // 拿锁期间可能已经有别的线程建好了
+    pipeline = probe(current.load(std::memory_order_relaxed), key);
+    if (pipeline != VK_NULL_HANDLE)
+    {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return pipeline;
+    }
+
+    pipeline = create(key);
+    if (pipeline == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("failed to create pipeline for pipeline state cache!");
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+
+    // 负载因子保持在 1/2 以下，探测链足够短
+    Table* table = current.load(std::memory_order_relaxed);
+    if ((count.load(std::memory_order_relaxed) + 1) * 2 > table->mask + 1)
+    {
+        grow();
+        table = current.load(std::memory_order_relaxed);
+    }
+    insert(table, key, pipeline);
+    count.fetch_add(1, std::memory_order_relaxed);
+    return pipeline;
+}
+
+bool PipelineStateCache::replace(const PipelineStateKey& key, VkPipeline pipeline)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    Table* table = current.load(std::memory_order_relaxed);
+    for (uint32_t i = static_cast<uint32_t>(key.hash) & table->mask;; i = (i + 1) & table->mask)
+    {
+        Slot& slot = table->slots[i];
+        VkPipeline old = slot.pipeline.load(std::memory_order_relaxed);
+        if (old == VK_NULL_HANDLE)
+        {
+            return false;
+        }
+        if (slot.key == key)
+        {
+            slot.pipeline.store(pipeline, std::memory_order_release);
+            retired.push_back(old);
+            return true;
+        }
+    }
+}
+
+void PipelineStateCache::insert(Table* table, const PipelineStateKey& key, VkPipeline pipeline)
+{
+    uint32_t i = static_cast<uint32_t>(key.hash) & table->mask;
+    while (table->slots[i].pipeline.load(std::memory_order_relaxed) != VK_NULL_HANDLE)
+    {
+        i = (i + 1) & table->mask;
+    }
+    // 先写 key，再 release 发布句柄，读线程看到句柄时 key 一定完整
+    table->slots[i].key = key;
+    table->slots[i].pipeline.store(pipeline, std::memory_order_release);
+}
+
+void PipelineStateCache::grow()
+{
+    Table* old = current.load(std::memory_order_relaxed);
+    auto bigger = std::make_unique<Table>((old->mask + 1) * 2);
+    for (uint32_t i = 0; i <= old->mask; i++)
+    {
+        VkPipeline pipeline = old->slots[i].pipeline.load(std::memory_order_relaxed);
+        if (pipeline != VK_NULL_HANDLE)
+        {
+            insert(bigger.get(), old->slots[i].key, pipeline);
+        }
+    }
+    current.store(bigger.get(), std::memory_order_release);
+    tables.push_back(std::move(bigger));
+}
+
+void PipelineStateCache::destroy(VkDevice device)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    Table* table = current.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i <= table->mask; i++)
+    {
+        VkPipeline pipeline = table->slots[i].pipeline.load(std::memory_order_relaxed);
+        if (pipeline != VK_NULL_HANDLE)
+        {
+            vkd.vkDestroyPipeline(device, pipeline, nullptr);
+        }
+    }
+    for (VkPipeline pipeline : retired)
+    {
+        vkd.vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    retired.clear();
+    tables.clear();
+    tables.push_back(std::make_unique<Table>(16));
+    current.store(tables.back().get(), std::memory_order_release);
+    count.store(0, std::memory_order_relaxed);
+}
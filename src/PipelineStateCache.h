@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+constexpr uint32_t MaxVertexBindings = 4;
+constexpr uint32_t MaxVertexAttributes = 8;
+constexpr uint32_t MaxColorAttachments = 4;
+
+template <typename Handle>
+inline uint64_t handleBits(Handle handle)
+{
+    return (uint64_t)handle;
+}
+
+struct VertexBindingKey
+{
+    uint8_t binding;
+    uint8_t inputRate;
+    uint16_t stride;
+};
+
+struct VertexAttributeKey
+{
+    uint8_t location;
+    uint8_t binding;
+    uint16_t offset;
+    uint32_t format;
+};
+
+// 一个 graphics pipeline 的全部固定管线状态，紧凑排列、没有 padding，
+// 可以直接按字节比较和哈希。枚举值只支持核心版本里能放进 uint8_t 的那部分。
+// viewport/scissor 数量固定为 1，而且必须是 dynamic state。
+struct PipelineStateKey
+{
+    // 着色器和 pipeline 以外的对象
+    uint64_t shaderHash = 0;
+    uint64_t layout = 0;
+    uint64_t renderPass = 0;
+
+    // input assembly + rasterizer
+    uint8_t topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    uint8_t primitiveRestartEnable = VK_FALSE;
+    uint8_t polygonMode = VK_POLYGON_MODE_FILL;
+    uint8_t cullMode = VK_CULL_MODE_NONE;
+    uint8_t frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    uint8_t depthClampEnable = VK_FALSE;
+    uint8_t rasterizerDiscardEnable = VK_FALSE;
+    uint8_t depthBiasEnable = VK_FALSE;
+
+    // multisample + depth + blend
+    uint8_t rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    uint8_t subpass = 0;
+    uint8_t depthTestEnable = VK_FALSE;
+    uint8_t depthWriteEnable = VK_FALSE;
+    uint8_t depthCompareOp = VK_COMPARE_OP_LESS;
+    uint8_t blendEnable = VK_FALSE;
+    uint8_t colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    uint8_t logicOpEnable = VK_FALSE;
+
+    uint8_t srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    uint8_t dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    uint8_t colorBlendOp = VK_BLEND_OP_ADD;
+    uint8_t srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    uint8_t dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    uint8_t alphaBlendOp = VK_BLEND_OP_ADD;
+    uint8_t bindingCount = 0;
+    uint8_t attributeCount = 0;
+
+    uint32_t dynamicStateMask = 0;
+    uint32_t lineWidthBits = 0x3f800000; // 1.0f
+    // renderPass 为 0 时走 dynamic rendering，attachment 格式只能从这里拿
+    uint32_t colorFormat = VK_FORMAT_UNDEFINED;
+    uint32_t depthFormat = VK_FORMAT_UNDEFINED;
+    // subpass 里 color attachment 的个数，共用上面同一组 blend 状态
+    uint32_t colorAttachmentCount = 1;
+    // topology 为 PATCH_LIST 时每个 patch 的控制点数，其余为 0；同时让 hash 保持 8 字节对齐
+    uint32_t patchControlPoints = 0;
+
+    VertexBindingKey bindings[MaxVertexBindings] = {};
+    VertexAttributeKey attributes[MaxVertexAttributes] = {};
+
+    // finalize() 之后才有效，比较时也会参与
+    uint64_t hash = 0;
+
+    void setVertexInput(const VkVertexInputBindingDescription* pBindings, uint32_t count,
+        const VkVertexInputAttributeDescription* pAttributes, uint32_t attributeCount);
+    void setDynamicStates(const VkDynamicState* pStates, uint32_t count);
+    void setLineWidth(float width);
+    float getLineWidth() const;
+    bool hasDynamicState(VkDynamicState state) const;
+
+    // 修改完所有字段后调用一次，哈希只算一次
+    void finalize();
+
+    bool operator==(const PipelineStateKey& other) const;
+    bool operator!=(const PipelineStateKey& other) const { return !(*this == other); }
+};
+
+static_assert(std::has_unique_object_representations_v<PipelineStateKey>,
+    "PipelineStateKey must not contain padding, it is hashed and compared bytewise");
+
+// dynamic state 在 PipelineStateKey::dynamicStateMask 中对应的位，不支持的返回 -1
+int dynamicStateBit(VkDynamicState state);
+VkDynamicState dynamicStateFromBit(int bit);
+
+// 把 key 展开成创建 pipeline 需要的各个 create info，内部有指针互相引用，不能拷贝
+class PipelineStateCreateInfo
+{
+public:
+    explicit PipelineStateCreateInfo(const PipelineStateKey& key);
+    PipelineStateCreateInfo(const PipelineStateCreateInfo&) = delete;
+    PipelineStateCreateInfo& operator=(const PipelineStateCreateInfo&) = delete;
+
+    VkGraphicsPipelineCreateInfo info(const VkPipelineShaderStageCreateInfo* pStages, uint32_t stageCount) const;
+
+    VkVertexInputBindingDescription bindings[MaxVertexBindings]{};
+    VkVertexInputAttributeDescription attributes[MaxVertexAttributes]{};
+    std::vector<VkDynamicState> dynamicStates;
+    VkPipelineVertexInputStateCreateInfo vertexInput{};
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    // patchControlPoints 为 0 时不挂到 create info 上
+    VkPipelineTessellationStateCreateInfo tessellation{};
+    VkPipelineViewportStateCreateInfo viewportState{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    VkPipelineColorBlendAttachmentState colorBlendAttachments[MaxColorAttachments]{};
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    // 只有 renderPass 为空时 info() 才会挂到 pNext 上
+    VkPipelineRenderingCreateInfoKHR rendering{};
+
+private:
+    VkFormat colorFormat;
+    VkPipelineLayout layout;
+    VkRenderPass renderPass;
+    uint32_t subpass;
+};
+
+// PipelineStateKey -> VkPipeline 的开放寻址哈希表。
+// 读（find）不加锁：槽位在 pipeline 句柄写入（release）之后就不再改动，
+// 扩容时旧表保留到 destroy，正在读旧表的线程不受影响。写入之间用 mutex 串行。
+class PipelineStateCache
+{
+public:
+    using CreateFn = std::function<VkPipeline(const PipelineStateKey&)>;
+
+    explicit PipelineStateCache(uint32_t initialCapacity = 64);
+
+    // key 必须已经 finalize。只查不计数，每帧绑定时用；命中率只统计 getOrCreate
+    VkPipeline find(const PipelineStateKey& key) const;
+    VkPipeline getOrCreate(const PipelineStateKey& key, const CreateFn& create);
+    // 用更好的版本（比如 link time optimization 之后的）替换已有的 pipeline。
+    // 旧句柄可能还在 command buffer 里，保留到 destroy 时再销毁
+    bool replace(const PipelineStateKey& key, VkPipeline pipeline);
+    void destroy(VkDevice device);
+
+    uint32_t size() const { return count.load(std::memory_order_relaxed); }
+    uint64_t hitCount() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t missCount() const { return misses.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot
+    {
+        PipelineStateKey key;
+        std::atomic<VkPipeline> pipeline{ VK_NULL_HANDLE };
+    };
+
+    struct Table
+    {
+        explicit Table(uint32_t capacity) : mask(capacity - 1), slots(new Slot[capacity]) {}
+        uint32_t mask;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    static VkPipeline probe(const Table* table, const PipelineStateKey& key);
+    void insert(Table* table, const PipelineStateKey& key, VkPipeline pipeline);
+    void grow();
+
+    std::atomic<Table*> current{ nullptr };
+    std::vector<std::unique_ptr<Table>> tables;
+    std::vector<VkPipeline> retired;
+    std::mutex writeMutex;
+    std::atomic<uint32_t> count{ 0 };
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+};
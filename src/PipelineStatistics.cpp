@@ -0,0 +1,177 @@
+#include "PipelineStatistics.h"
+#include "VulkanDispatch.h"
+
+#include <iostream>
+#include <stdexcept>
+
+// 结果按统计位从低到高排列，最后是 availability；和 PipelineStatisticsResult 的字段顺序一致
+static const VkQueryPipelineStatisticFlags GraphicsStatisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_CONTROL_SHADER_PATCHES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT;
+static const uint32_t StatisticCount = 10;
+
+// 保留最近这么多帧的结果
+static const uint32_t HistorySize = 64;
+
+void PipelineStatistics::query(const DeviceCapabilities& capabilities)
+{
+    supported = capabilities.features.pipelineStatisticsQuery == VK_TRUE;
+    std::cout << "pipeline statistics query: " << (supported ? "enabled" : "not supported") << std::endl;
+}
+
+void PipelineStatistics::enableCoreFeatures(VkPhysicalDeviceFeatures& features) const
+{
+    if (supported)
+    {
+        features.pipelineStatisticsQuery = VK_TRUE;
+    }
+}
+
+void PipelineStatistics::create(VkDevice device, uint32_t ringSize)
+{
+    if (!supported)
+    {
+        return;
+    }
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    poolInfo.queryCount = 1;
+    poolInfo.pipelineStatistics = GraphicsStatisticFlags;
+    pools.resize(ringSize);
+    for (auto& pool : pools)
+    {
+        if (vkd.vkCreateQueryPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create query pool!");
+        }
+    }
+    poolFrames.assign(ringSize, ~0ull);
+    history.assign(HistorySize, PipelineStatisticsResult{});
+}
+
+void PipelineStatistics::readBack(VkDevice device, uint32_t slot)
+{
+    if (poolFrames[slot] == ~0ull)
+    {
+        return;
+    }
+    uint64_t values[StatisticCount + 1] = {};
+    VkResult result = vkd.vkGetQueryPoolResults(device, pools[slot], 0, 1, sizeof(values), values, sizeof(values),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS || values[StatisticCount] == 0)
+    {
+        // 还没完成的结果直接丢掉，不等
+        droppedFrames++;
+        poolFrames[slot] = ~0ull;
+        return;
+    }
+
+    PipelineStatisticsResult& entry = history[poolFrames[slot] % HistorySize];
+    entry.frame = poolFrames[slot];
+    entry.inputAssemblyVertices = values[0];
+    entry.inputAssemblyPrimitives = values[1];
+    entry.vertexShaderInvocations = values[2];
+    entry.geometryShaderInvocations = values[3];
+    entry.geometryShaderPrimitives = values[4];
+    entry.clippingInvocations = values[5];
+    entry.clippingPrimitives = values[6];
+    entry.fragmentShaderInvocations = values[7];
+    entry.tessellationControlPatches = values[8];
+    entry.tessellationEvaluationInvocations = values[9];
+
+    totals.inputAssemblyVertices += values[0];
+    totals.inputAssemblyPrimitives += values[1];
+    totals.vertexShaderInvocations += values[2];
+    totals.geometryShaderInvocations += values[3];
+    totals.geometryShaderPrimitives += values[4];
+    totals.clippingInvocations += values[5];
+    totals.clippingPrimitives += values[6];
+    totals.fragmentShaderInvocations += values[7];
+    totals.tessellationControlPatches += values[8];
+    totals.tessellationEvaluationInvocations += values[9];
+    collectedFrames++;
+    poolFrames[slot] = ~0ull;
+}
+
+void PipelineStatistics::cmdBegin(VkDevice device, VkCommandBuffer commandBuffer)
+{
+    if (pools.empty())
+    {
+        return;
+    }
+    frame++;
+    uint32_t slot = static_cast<uint32_t>(frame % pools.size());
+    readBack(device, slot);
+
+    vkd.vkCmdResetQueryPool(commandBuffer, pools[slot], 0, 1);
+    vkd.vkCmdBeginQuery(commandBuffer, pools[slot], 0, 0);
+    poolFrames[slot] = frame;
+    active = true;
+}
+
+void PipelineStatistics::cmdEnd(VkCommandBuffer commandBuffer)
+{
+    if (!active)
+    {
+        return;
+    }
+    vkd.vkCmdEndQuery(commandBuffer, pools[frame % pools.size()], 0);
+    active = false;
+}
+
+bool PipelineStatistics::results(uint32_t framesAgo, PipelineStatisticsResult& result) const
+{
+    if (frame == ~0ull || framesAgo > frame)
+    {
+        return false;
+    }
+    return resultsForFrame(frame - framesAgo, result);
+}
+
+bool PipelineStatistics::resultsForFrame(uint64_t frameNumber, PipelineStatisticsResult& result) const
+{
+    if (history.empty() || history[frameNumber % HistorySize].frame != frameNumber)
+    {
+        return false;
+    }
+    result = history[frameNumber % HistorySize];
+    return true;
+}
+
+void PipelineStatistics::printReport() const
+{
+    if (!supported || collectedFrames == 0)
+    {
+        return;
+    }
+    std::cout << "pipeline statistics (per frame over " << collectedFrames << " frames, " << droppedFrames << " not ready):" << std::endl;
+    std::cout << "  input assembly: " << totals.inputAssemblyVertices / collectedFrames << " vertices, "
+        << totals.inputAssemblyPrimitives / collectedFrames << " primitives" << std::endl;
+    std::cout << "  vertex shader: " << totals.vertexShaderInvocations / collectedFrames << " invocations" << std::endl;
+    std::cout << "  tessellation: " << totals.tessellationControlPatches / collectedFrames << " control patches, "
+        << totals.tessellationEvaluationInvocations / collectedFrames << " evaluation invocations" << std::endl;
+    std::cout << "  geometry shader: " << totals.geometryShaderInvocations / collectedFrames << " invocations, "
+        << totals.geometryShaderPrimitives / collectedFrames << " primitives" << std::endl;
+    std::cout << "  clipping: " << totals.clippingInvocations / collectedFrames << " invocations, "
+        << totals.clippingPrimitives / collectedFrames << " primitives" << std::endl;
+    std::cout << "  fragment shader: " << totals.fragmentShaderInvocations / collectedFrames << " invocations" << std::endl;
+}
+
+void PipelineStatistics::destroy(VkDevice device)
+{
+    for (VkQueryPool pool : pools)
+    {
+        vkd.vkDestroyQueryPool(device, pool, nullptr);
+    }
+    pools.clear();
+    poolFrames.clear();
+}
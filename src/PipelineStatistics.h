@@ -0,0 +1,65 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// 一帧的 pipeline statistics 计数
+struct PipelineStatisticsResult
+{
+    uint64_t frame = ~0ull;
+    uint64_t inputAssemblyVertices = 0;
+    uint64_t inputAssemblyPrimitives = 0;
+    uint64_t vertexShaderInvocations = 0;
+    uint64_t geometryShaderInvocations = 0;
+    uint64_t geometryShaderPrimitives = 0;
+    uint64_t clippingInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentShaderInvocations = 0;
+    uint64_t tessellationControlPatches = 0;
+    uint64_t tessellationEvaluationInvocations = 0;
+};
+
+// VK_QUERY_TYPE_PIPELINE_STATISTICS 包住每帧的全部绘制。
+// 每帧用 ring 里的一个 query pool，轮到同一个 pool 时（那一帧的 fence 已经等过）不带 WAIT 地读回上一次的结果，
+// 不会阻塞。设备不支持 pipelineStatisticsQuery 时所有调用都是空操作
+class PipelineStatistics
+{
+public:
+    void query(const DeviceCapabilities& capabilities);
+    void enableCoreFeatures(VkPhysicalDeviceFeatures& features) const;
+    bool enabled() const { return supported; }
+
+    // ringSize 不能小于 frame in flight 的数量
+    void create(VkDevice device, uint32_t ringSize);
+    // 在 render pass 外面调用，开始新的一帧
+    void cmdBegin(VkDevice device, VkCommandBuffer commandBuffer);
+    void cmdEnd(VkCommandBuffer commandBuffer);
+
+    // 正在录制的帧号，cmdBegin 之后有效
+    uint64_t currentFrame() const { return frame; }
+    // 第 N-framesAgo 帧的计数，还没读回来或者已经不在历史里时返回 false
+    bool results(uint32_t framesAgo, PipelineStatisticsResult& result) const;
+    bool resultsForFrame(uint64_t frameNumber, PipelineStatisticsResult& result) const;
+
+    void printReport() const;
+    void destroy(VkDevice device);
+
+private:
+    void readBack(VkDevice device, uint32_t slot);
+
+    bool supported = false;
+    std::vector<VkQueryPool> pools;
+    // 每个 pool 上一次录制的帧号，~0 表示没有待读的结果
+    std::vector<uint64_t> poolFrames;
+    uint64_t frame = ~0ull;
+    bool active = false;
+
+    std::vector<PipelineStatisticsResult> history;
+    PipelineStatisticsResult totals;
+    uint64_t collectedFrames = 0;
+    uint64_t droppedFrames = 0;
+};
@@ -0,0 +1,191 @@
+#include "Profiler.h"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// 每个线程最多 256 块、每块 4096 个事件，满了之后新的事件丢掉
+static const size_t EventsPerChunk = 4096;
+static const size_t MaxChunks = 256;
+
+// 只有所属线程写；count 用 release 发布，导出时 acquire 读，读到的事件都是写完整的。
+// 每次开始记录时 generation 加一，线程下一次记录时发现自己的 generation 旧了，就从头复用已经分配的块
+struct ThreadBuffer
+{
+    uint32_t id = 0;
+    std::atomic<uint64_t> generation{ 0 };
+    std::atomic<const char*> name{ nullptr };
+    std::array<std::atomic<ProfileEvent*>, MaxChunks> chunks;
+    std::atomic<size_t> count{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+
+    ThreadBuffer()
+    {
+        for (auto& chunk : chunks)
+        {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    ~ThreadBuffer()
+    {
+        for (auto& chunk : chunks)
+        {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+std::atomic<bool> Profiler::active{ false };
+
+static const auto processStart = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> captureStart{ 0 };
+static std::atomic<uint64_t> captureGeneration{ 0 };
+// 线程退出之后缓冲区还留着，导出时还能看到它的事件；只在线程第一次记录时加锁
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+static ThreadBuffer& threadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (buffer == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::make_unique<ThreadBuffer>());
+        buffer = registry.back().get();
+        buffer->id = static_cast<uint32_t>(registry.size());
+    }
+    return *buffer;
+}
+
+uint64_t Profiler::now()
+{
+    // 加 1，0 留给 ProfileZone 表示没有在记录
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - processStart).count() + 1;
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    if (enabled)
+    {
+        captureStart.store(now(), std::memory_order_relaxed);
+        captureGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+    active.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+    threadBuffer().name.store(name, std::memory_order_relaxed);
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    // 新的一次记录：上一次的事件不要了，块留着接着用。count 只有本线程写，在这里清零不用加锁
+    uint64_t generation = captureGeneration.load(std::memory_order_relaxed);
+    if (buffer.generation.load(std::memory_order_relaxed) != generation)
+    {
+        buffer.count.store(0, std::memory_order_release);
+        buffer.dropped.store(0, std::memory_order_relaxed);
+        buffer.generation.store(generation, std::memory_order_relaxed);
+    }
+    size_t index = buffer.count.load(std::memory_order_relaxed);
+    size_t chunkIndex = index / EventsPerChunk;
+    if (chunkIndex >= MaxChunks)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ProfileEvent* events = buffer.chunks[chunkIndex].load(std::memory_order_relaxed);
+    if (events == nullptr)
+    {
+        events = new ProfileEvent[EventsPerChunk];
+        buffer.chunks[chunkIndex].store(events, std::memory_order_release);
+    }
+    events[index % EventsPerChunk] = { name, start, end };
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+static void writeJsonString(std::ofstream& file, const char* text)
+{
+    file << '"';
+    for (const char* c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            file << '\\';
+        }
+        file << *c;
+    }
+    file << '"';
+}
+
+bool Profiler::exportChromeTrace(const std::string& path)
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "failed to write trace " << path << std::endl;
+        return false;
+    }
+
+    // ts / dur 的单位是微秒
+    uint64_t from = captureStart.load(std::memory_order_relaxed);
+    uint64_t generation = captureGeneration.load(std::memory_order_relaxed);
+    size_t written = 0;
+    uint64_t dropped = 0;
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[" << std::endl;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& buffer : registry)
+    {
+        const char* threadName = buffer->name.load(std::memory_order_relaxed);
+        if (threadName != nullptr)
+        {
+            file << (written++ ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+                << ",\"args\":{\"name\":";
+            writeJsonString(file, threadName);
+            file << "}}";
+        }
+
+        // 这次记录里还没写过事件的线程，缓冲区里还是上一次的
+        if (buffer->generation.load(std::memory_order_relaxed) != generation)
+        {
+            continue;
+        }
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
+        {
+            const ProfileEvent& event = buffer->chunks[i / EventsPerChunk].load(std::memory_order_acquire)[i % EventsPerChunk];
+            if (event.start < from)
+            {
+                continue;
+            }
+            file << (written++ ? ",\n" : "") << "{\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << event.start / 1000.0
+                << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    file << "\n]}" << std::endl;
+
+    std::cout << "profiler: wrote " << written << " events to " << path;
+    if (dropped > 0)
+    {
+        std::cout << " (" << dropped << " dropped, buffers full)";
+    }
+    std::cout << std::endl;
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// CPU 端按作用域计时。每个线程写自己的缓冲区，记录时不加锁，每 4096 个事件才分配一次内存；
+// 导出成 Chrome trace event JSON，可以直接在 Perfetto / chrome://tracing 里打开。
+// 没定义 ENABLE_PROFILER 时 PROFILE_ZONE 展开为空，不产生任何代码
+
+class Profiler
+{
+public:
+    // 运行时开关；打开时记下开始时间，导出只包含这之后的事件。每次打开各线程的缓冲区从头复用，
+    // 不会因为前几次记录占满了而丢事件
+    static void setEnabled(bool enabled);
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+    // 出现在 trace 里的线程名，name 必须一直有效
+    static void setThreadName(const char* name);
+    // 写出最近一次打开之后所有线程记录的事件
+    static bool exportChromeTrace(const std::string& path);
+
+    // 相对进程启动的纳秒数
+    static uint64_t now();
+    // name 必须一直有效（字符串字面量）
+    static void record(const char* name, uint64_t start, uint64_t end);
+
+private:
+    static std::atomic<bool> active;
+};
+
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name)
+        : name(name), start(Profiler::enabled() ? Profiler::now() : 0)
+    {
+    }
+    ~ProfileZone()
+    {
+        if (start != 0)
+        {
+            Profiler::record(name, start, Profiler::now());
+        }
+    }
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
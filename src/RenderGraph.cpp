@@ -0,0 +1,471 @@
+#include "RenderGraph.h"
+#include "VulkanDispatch.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+static const VkAccessFlags WriteAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+// 这些用途的图像内容可以只留在 tile 上
+static const VkImageUsageFlags AttachmentUsageMask =
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+RenderGraphResource RenderGraph::createImage(const std::string& name, const RenderGraphImageDesc& desc)
+{
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resources.push_back(resource);
+    return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, VkImageAspectFlags aspect, VkPipelineStageFlags initialStage,
+    VkImageLayout finalLayout)
+{
+    Resource resource;
+    resource.name = name;
+    resource.imported = true;
+    resource.desc.aspect = aspect;
+    resource.initialStage = initialStage;
+    resource.finalLayout = finalLayout;
+    resources.push_back(resource);
+    return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importBuffer(const std::string& name, VkBuffer buffer)
+{
+    Resource resource;
+    resource.name = name;
+    resource.imported = true;
+    resource.isBuffer = true;
+    resource.buffer = buffer;
+    resources.push_back(resource);
+    return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+void RenderGraph::setImportedImage(RenderGraphResource resource, VkImage image, VkImageView view)
+{
+    resources[resource].image = image;
+    resources[resource].view = view;
+}
+
+RenderGraphPass RenderGraph::addPass(const std::string& name, std::function<void(VkCommandBuffer)> record)
+{
+    Pass pass;
+    pass.name = name;
+    pass.record = std::move(record);
+    passes.push_back(std::move(pass));
+    cullDirty = true;
+    return static_cast<RenderGraphPass>(passes.size() - 1);
+}
+
+void RenderGraph::read(RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+    VkImageLayout layout)
+{
+    addAccess(pass, resource, stages, access, layout, false);
+}
+
+void RenderGraph::write(RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+    VkImageLayout layout)
+{
+    addAccess(pass, resource, stages, access, layout, true);
+}
+
+void RenderGraph::addAccess(RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+    VkImageLayout layout, bool isWrite)
+{
+    if (resource == RenderGraphNoResource)
+    {
+        return;
+    }
+    cullDirty = true;
+    for (auto& existing : passes[pass].accesses)
+    {
+        if (existing.resource == resource)
+        {
+            // 读写合并成一次访问，布局以写为准
+            existing.stages |= stages;
+            existing.access |= access;
+            existing.read = existing.read || !isWrite;
+            existing.write = existing.write || isWrite;
+            if (isWrite)
+            {
+                existing.layout = layout;
+            }
+            return;
+        }
+    }
+    passes[pass].accesses.push_back({ resource, stages, access, layout, !isWrite, isWrite });
+}
+
+void RenderGraph::setPassEnabled(RenderGraphPass pass, bool enabled)
+{
+    if (passes[pass].enabled != enabled)
+    {
+        passes[pass].enabled = enabled;
+        cullDirty = true;
+    }
+}
+
+std::vector<bool> RenderGraph::cull(bool respectEnabled) const
+{
+    // 从后往前：写外部资源，或者写了后面还要读的资源的 pass 才保留
+    std::vector<bool> kept(passes.size(), false);
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t i = passes.size(); i-- > 0;)
+    {
+        const Pass& pass = passes[i];
+        if (respectEnabled && !pass.enabled)
+        {
+            continue;
+        }
+        for (auto& access : pass.accesses)
+        {
+            if (access.write && (resources[access.resource].imported || needed[access.resource]))
+            {
+                kept[i] = true;
+            }
+        }
+        if (!kept[i])
+        {
+            continue;
+        }
+        // 整个覆盖掉的资源，更早的写入就没人要了
+        for (auto& access : pass.accesses)
+        {
+            if (access.write && !access.read)
+            {
+                needed[access.resource] = false;
+            }
+        }
+        for (auto& access : pass.accesses)
+        {
+            if (access.read)
+            {
+                needed[access.resource] = true;
+            }
+        }
+    }
+    return kept;
+}
+
+void RenderGraph::allocate(const DeviceCapabilities& capabilities, VkDevice device)
+{
+    std::vector<bool> kept = cull(false);
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        if (!kept[i])
+        {
+            continue;
+        }
+        for (auto& access : passes[i].accesses)
+        {
+            Resource& resource = resources[access.resource];
+            resource.firstPass = std::min(resource.firstPass, i);
+            resource.lastPass = std::max(resource.lastPass, i);
+        }
+    }
+
+    std::vector<RenderGraphResource> transients;
+    std::vector<uint32_t> memoryTypes(resources.size(), ~0u);
+    for (RenderGraphResource index = 0; index < resources.size(); index++)
+    {
+        Resource& resource = resources[index];
+        if (resource.imported || resource.firstPass == ~0u)
+        {
+            continue;
+        }
+        // 只在一个 pass 里当 attachment 用的图像不需要离开 tile，标成 transient 放进 lazily allocated 内存
+        bool transient = resource.firstPass == resource.lastPass && (resource.desc.usage & ~AttachmentUsageMask) == 0;
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = resource.desc.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = resource.desc.usage | (transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+        imageInfo.samples = resource.desc.samples;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkd.vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render graph image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkd.vkGetImageMemoryRequirements(device, resource.image, &memRequirements);
+        resource.size = memRequirements.size;
+        if (transient)
+        {
+            memoryTypes[index] = capabilities.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+        }
+        resource.lazilyAllocated = memoryTypes[index] != ~0u;
+        if (!resource.lazilyAllocated)
+        {
+            memoryTypes[index] = capabilities.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+        if (memoryTypes[index] == ~0u)
+        {
+            throw std::runtime_error("failed to find suitable memory type!");
+        }
+        transients.push_back(index);
+    }
+
+    // 从大到小放，放进第一块内存类型相同、里面所有图像生命周期都不重叠的块，块的大小取最大的那个
+    std::sort(transients.begin(), transients.end(),
+        [&](RenderGraphResource a, RenderGraphResource b) { return resources[a].size > resources[b].size; });
+    for (RenderGraphResource index : transients)
+    {
+        Resource& resource = resources[index];
+        for (uint32_t b = 0; b < blocks.size() && resource.block == ~0u; b++)
+        {
+            if (blocks[b].memoryType != memoryTypes[index])
+            {
+                continue;
+            }
+            bool overlaps = false;
+            for (RenderGraphResource other : blocks[b].resources)
+            {
+                overlaps = overlaps || (resource.firstPass <= resources[other].lastPass && resources[other].firstPass <= resource.lastPass);
+            }
+            if (!overlaps)
+            {
+                resource.block = b;
+            }
+        }
+        if (resource.block == ~0u)
+        {
+            Block block;
+            block.memoryType = memoryTypes[index];
+            blocks.push_back(block);
+            resource.block = static_cast<uint32_t>(blocks.size() - 1);
+        }
+        Block& block = blocks[resource.block];
+        block.size = std::max(block.size, resource.size);
+        block.resources.push_back(index);
+    }
+
+    transientBytes = 0;
+    aliasedBytes = 0;
+    allocationLines.clear();
+    for (Block& block : blocks)
+    {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = block.size;
+        allocInfo.memoryTypeIndex = block.memoryType;
+        if (vkd.vkAllocateMemory(device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate render graph memory!");
+        }
+        aliasedBytes += block.size;
+        for (RenderGraphResource index : block.resources)
+        {
+            Resource& resource = resources[index];
+            vkd.vkBindImageMemory(device, resource.image, block.memory, 0);
+            transientBytes += resource.size;
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.desc.format;
+            viewInfo.subresourceRange = { resource.desc.aspect, 0, 1, 0, 1 };
+            if (vkd.vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render graph image view!");
+            }
+
+            std::ostringstream line;
+            line << resource.name << ": " << resource.size / 1024 << " KB, passes " << resource.firstPass << "-" << resource.lastPass
+                << ", block " << resource.block << (resource.lazilyAllocated ? " (lazily allocated)" : "");
+            allocationLines.push_back(line.str());
+        }
+    }
+}
+
+VkImage RenderGraph::image(RenderGraphResource resource) const
+{
+    return resource == RenderGraphNoResource ? VK_NULL_HANDLE : resources[resource].image;
+}
+
+VkImageView RenderGraph::view(RenderGraphResource resource) const
+{
+    return resource == RenderGraphNoResource ? VK_NULL_HANDLE : resources[resource].view;
+}
+
+bool RenderGraph::aliased(RenderGraphResource a, RenderGraphResource b) const
+{
+    return resources[a].block != ~0u && resources[a].block == resources[b].block;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, BarrierBatch& barrierBatch)
+{
+    if (cullDirty)
+    {
+        keptPasses = cull(true);
+        cullDirty = false;
+    }
+
+    // 图像每帧从 UNDEFINED 开始，transient 图像要等同一块内存上一次的访问，到第一次访问时再取
+    for (Resource& resource : resources)
+    {
+        if (resource.isBuffer)
+        {
+            continue;
+        }
+        resource.state = State{};
+        if (resource.imported)
+        {
+            resource.state.writeStages = resource.initialStage;
+        }
+        resource.aliasPending = resource.block != ~0u;
+    }
+
+    // 每个 barrier 带自己的 stage，不再整批取并集
+    uint32_t batchSize = 0;
+    auto flush = [&]() {
+        if (batchSize == 0)
+        {
+            return;
+        }
+        barrierBatch.flush(commandBuffer);
+        barriers += batchSize;
+        barrierBatches++;
+        batchSize = 0;
+    };
+
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        Pass& pass = passes[i];
+        if (!keptPasses[i])
+        {
+            culledPasses++;
+            continue;
+        }
+
+        for (auto& access : pass.accesses)
+        {
+            Resource& resource = resources[access.resource];
+            State& state = resource.state;
+            if (resource.aliasPending)
+            {
+                state.writeStages = blocks[resource.block].stages;
+                state.writeAccess = blocks[resource.block].access;
+                resource.aliasPending = false;
+            }
+            bool layoutChange = !resource.isBuffer && access.layout != state.layout;
+
+            // 写、布局转换要等之前所有的读写；读只在还没看到上一次写入的阶段上等
+            VkPipelineStageFlags waitStages = 0;
+            VkAccessFlags waitAccess = 0;
+            bool needBarrier = false;
+            if (layoutChange || access.write)
+            {
+                waitStages = state.writeStages | state.readStages;
+                waitAccess = state.writeAccess;
+                needBarrier = layoutChange || waitStages != 0;
+            }
+            else if (state.writeStages != 0 && (state.readStages & access.stages) != access.stages)
+            {
+                waitStages = state.writeStages;
+                waitAccess = state.writeAccess;
+                needBarrier = true;
+            }
+
+            if (needBarrier)
+            {
+                if (resource.isBuffer)
+                {
+                    barrierBatch.bufferBarrier(resource.buffer, 0, VK_WHOLE_SIZE, waitStages, waitAccess, access.stages, access.access);
+                }
+                else
+                {
+                    barrierBatch.imageBarrier(resource.image, { resource.desc.aspect, 0, 1, 0, 1 }, state.layout, access.layout,
+                        waitStages, waitAccess, access.stages, access.access);
+                }
+                batchSize++;
+            }
+
+            if (layoutChange || access.write)
+            {
+                state.layout = resource.isBuffer ? state.layout : access.layout;
+                state.writeStages = access.stages;
+                state.writeAccess = access.write ? access.access & WriteAccessMask : 0;
+                state.readStages = access.write ? 0 : access.stages;
+            }
+            else
+            {
+                state.readStages |= access.stages;
+            }
+            if (resource.block != ~0u)
+            {
+                blocks[resource.block].stages = state.writeStages | state.readStages;
+                blocks[resource.block].access = state.writeAccess;
+            }
+        }
+        flush();
+
+        pass.record(commandBuffer);
+    }
+
+    // 外部图像转换到帧结束时要求的布局，之后由 semaphore 等待，不需要目标阶段
+    for (Resource& resource : resources)
+    {
+        if (!resource.imported || resource.isBuffer || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+            resource.finalLayout == resource.state.layout)
+        {
+            continue;
+        }
+        barrierBatch.imageBarrier(resource.image, { resource.desc.aspect, 0, 1, 0, 1 }, resource.state.layout, resource.finalLayout,
+            resource.state.writeStages | resource.state.readStages, resource.state.writeAccess, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+        batchSize++;
+    }
+    flush();
+
+    frames++;
+}
+
+void RenderGraph::printReport() const
+{
+    if (frames == 0)
+    {
+        return;
+    }
+    std::cout << "render graph:" << std::endl;
+    std::cout << "  " << frames << " frames, " << (double)barriers / frames << " barriers in " << (double)barrierBatches / frames
+        << " batches per frame, " << culledPasses << " pass executions culled" << std::endl;
+    for (auto& line : allocationLines)
+    {
+        std::cout << "  " << line << std::endl;
+    }
+    std::cout << "  peak transient memory " << transientBytes / 1024 << " KB without aliasing, " << aliasedBytes / 1024
+        << " KB with aliasing" << std::endl;
+}
+
+void RenderGraph::destroy(VkDevice device)
+{
+    for (Resource& resource : resources)
+    {
+        if (!resource.imported)
+        {
+            vkd.vkDestroyImageView(device, resource.view, nullptr);
+            vkd.vkDestroyImage(device, resource.image, nullptr);
+        }
+    }
+    for (Block& block : blocks)
+    {
+        vkd.vkFreeMemory(device, block.memory, nullptr);
+    }
+    resources.clear();
+    passes.clear();
+    blocks.clear();
+    keptPasses.clear();
+    cullDirty = true;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "BarrierBatch.h"
+#include "DeviceCapabilities.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// 一帧的 render graph。pass 按执行顺序声明，并声明自己读写哪些 image / buffer，graph 负责：
+//   - 每个 pass 前只加必要的 barrier，通过 BarrierBatch 合并成一次 vkCmdPipelineBarrier2
+//   - 剔除结果没有被用到的 pass（关掉的 pass 只被它用到的上游也会跟着剔除）
+//   - 生命周期不重叠的 transient image 共用同一块内存
+// 声明和分配在 swapchain 重建时做一次，每帧只 execute；剔除结果缓存起来，pass、访问声明或开关变了才重新算
+
+typedef uint32_t RenderGraphResource;
+typedef uint32_t RenderGraphPass;
+
+const RenderGraphResource RenderGraphNoResource = ~0u;
+
+// graph 自己创建的图像，只在一帧之内有效
+struct RenderGraphImageDesc
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent{};
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+class RenderGraph
+{
+public:
+    RenderGraphResource createImage(const std::string& name, const RenderGraphImageDesc& desc);
+    // 外部图像每帧从 UNDEFINED 开始，initialStage 是它在帧开始时要等的阶段（比如 acquire semaphore 的 wait stage），
+    // 帧结束时转换到 finalLayout。写它的 pass 不会被剔除
+    RenderGraphResource importImage(const std::string& name, VkImageAspectFlags aspect, VkPipelineStageFlags initialStage,
+        VkImageLayout finalLayout);
+    // 外部 buffer 的状态跨帧保留
+    RenderGraphResource importBuffer(const std::string& name, VkBuffer buffer);
+    // 交换链图像每帧不同，execute 之前设置
+    void setImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+
+    // pass 按添加的顺序执行；一个资源都不写的 pass 总是被剔除
+    RenderGraphPass addPass(const std::string& name, std::function<void(VkCommandBuffer)> record);
+    // 同一个 pass 对同一个资源既读又写时两次声明会合并；buffer 的 layout 忽略
+    void read(RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+    void write(RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+    // 每帧调用也没关系，值不变不会让剔除结果失效
+    void setPassEnabled(RenderGraphPass pass, bool enabled);
+
+    // 按所有 pass 都打开时的生命周期创建 transient image 并分配内存。
+    // 每帧关掉 pass 只会让生命周期变短，所以这里算出来的别名关系一直是安全的
+    void allocate(const DeviceCapabilities& capabilities, VkDevice device);
+    VkImage image(RenderGraphResource resource) const;
+    VkImageView view(RenderGraphResource resource) const;
+    // 两个 transient image 是否被放进了同一块内存
+    bool aliased(RenderGraphResource a, RenderGraphResource b) const;
+
+    void execute(VkCommandBuffer commandBuffer, BarrierBatch& barrierBatch);
+
+    void printReport() const;
+    // 释放图像、内存和所有声明，统计保留
+    void destroy(VkDevice device);
+
+private:
+    struct Access
+    {
+        RenderGraphResource resource;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+        bool read;
+        bool write;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::function<void(VkCommandBuffer)> record;
+        std::vector<Access> accesses;
+        bool enabled = true;
+    };
+
+    // 上一次写（或布局转换）发生在哪些阶段，以及之后已经对哪些阶段可见
+    struct State
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;
+    };
+
+    struct Resource
+    {
+        std::string name;
+        bool imported = false;
+        bool isBuffer = false;
+        RenderGraphImageDesc desc;
+        VkPipelineStageFlags initialStage = 0;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        // transient image 的生命周期（pass 下标）和所在的内存块
+        uint32_t firstPass = ~0u;
+        uint32_t lastPass = 0;
+        uint32_t block = ~0u;
+        VkDeviceSize size = 0;
+        bool lazilyAllocated = false;
+        State state;
+        // 这一帧还没访问过：第一次访问时才从所在内存块取状态，那时块上最后的访问可能是这一帧更早的别名图像
+        bool aliasPending = false;
+    };
+
+    // 一块内存上最后一次访问的阶段，别名到同一块内存的下一个图像要先等它
+    struct Block
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint32_t memoryType = 0;
+        VkDeviceSize size = 0;
+        std::vector<RenderGraphResource> resources;
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+    };
+
+    void addAccess(RenderGraphPass pass, RenderGraphResource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+        VkImageLayout layout, bool isWrite);
+    std::vector<bool> cull(bool respectEnabled) const;
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<Block> blocks;
+    // execute 用的剔除结果
+    std::vector<bool> keptPasses;
+    bool cullDirty = true;
+
+    // 统计
+    uint64_t frames = 0;
+    uint64_t barriers = 0;
+    uint64_t barrierBatches = 0;
+    uint64_t culledPasses = 0;
+    VkDeviceSize transientBytes = 0;
+    VkDeviceSize aliasedBytes = 0;
+    std::vector<std::string> allocationLines;
+};
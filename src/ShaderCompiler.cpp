@@ -0,0 +1,295 @@
+#include "ShaderCompiler.h"
+#include "Profiler.h"
+
+#include <shaderc/shaderc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+// 影响输出的编译选项，都要进磁盘缓存的 key
+static const shaderc_env_version TargetEnvironment = shaderc_env_version_vulkan_1_1;
+// 性能优化交给后面的 ShaderOptimizer
+static const shaderc_optimization_level OptimizationLevel = shaderc_optimization_level_zero;
+
+static bool readText(const fs::path& path, std::string& text)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    text = stream.str();
+    return true;
+}
+
+static shaderc_shader_kind shaderKind(VkShaderStageFlagBits stage)
+{
+    switch (stage)
+    {
+    case VK_SHADER_STAGE_VERTEX_BIT:
+        return shaderc_vertex_shader;
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+        return shaderc_tess_control_shader;
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+        return shaderc_tess_evaluation_shader;
+    case VK_SHADER_STAGE_GEOMETRY_BIT:
+        return shaderc_geometry_shader;
+    case VK_SHADER_STAGE_FRAGMENT_BIT:
+        return shaderc_fragment_shader;
+    case VK_SHADER_STAGE_COMPUTE_BIT:
+        return shaderc_compute_shader;
+    default:
+        throw std::runtime_error("unsupported shader stage for runtime compile");
+    }
+}
+
+static uint64_t elapsedUs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// #include "x" 先找包含它的文件所在目录，#include <x> 和找不到的情况再找 shaders 根目录
+class FileIncluder : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+    explicit FileIncluder(std::string sourceDir) : sourceDir(std::move(sourceDir)) {}
+
+    shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type type,
+        const char* requestingSource, size_t) override
+    {
+        auto* include = new Include();
+        std::vector<fs::path> candidates;
+        if (type == shaderc_include_type_relative)
+        {
+            candidates.push_back(fs::path(requestingSource).parent_path() / requestedSource);
+        }
+        candidates.push_back(fs::path(sourceDir) / requestedSource);
+
+        for (auto& candidate : candidates)
+        {
+            if (readText(candidate, include->content))
+            {
+                include->name = candidate.lexically_normal().string();
+                break;
+            }
+        }
+        if (include->name.empty())
+        {
+            // 失败时 source_name 为空，content 放错误信息
+            include->content = std::string("can't find include ") + requestedSource;
+        }
+
+        include->result.source_name = include->name.data();
+        include->result.source_name_length = include->name.size();
+        include->result.content = include->content.data();
+        include->result.content_length = include->content.size();
+        include->result.user_data = include;
+        return &include->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result* data) override
+    {
+        delete static_cast<Include*>(data->user_data);
+    }
+
+private:
+    struct Include
+    {
+        std::string name;
+        std::string content;
+        shaderc_include_result result;
+    };
+
+    std::string sourceDir;
+};
+
+ShaderCompiler::ShaderCompiler(std::string sourceDir, std::string cacheDir, uint32_t threadCount)
+    : sourceDir(std::move(sourceDir)), cacheDir(std::move(cacheDir))
+{
+    std::error_code error;
+    fs::create_directories(this->cacheDir, error);
+
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back(&ShaderCompiler::workerLoop, this);
+    }
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobCondition.notify_all();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ShaderCompiler::workerLoop()
+{
+    PROFILE_THREAD("shader compiler");
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        PROFILE_ZONE("compileShader");
+        job();
+    }
+}
+
+std::future<ShaderStage> ShaderCompiler::compileAsync(VkShaderStageFlagBits stage, const std::string& file, const Defines& defines)
+{
+    // packaged_task 不能拷贝，包一层 shared_ptr 放进 std::function
+    auto task = std::make_shared<std::packaged_task<ShaderStage()>>([this, stage, file, defines] {
+        return compile(stage, file, defines);
+    });
+    std::future<ShaderStage> result = task->get_future();
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.emplace_back([task] { (*task)(); });
+    }
+    jobCondition.notify_one();
+    return result;
+}
+
+ShaderStage ShaderCompiler::compile(VkShaderStageFlagBits stage, const std::string& file, const Defines& defines)
+{
+    const std::string path = (fs::path(sourceDir) / file).string();
+    std::string source;
+    if (!readText(path, source))
+    {
+        throw std::runtime_error("can't open shader source " + path);
+    }
+
+    shaderc::CompileOptions options;
+    options.SetSourceLanguage(shaderc_source_language_glsl);
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, TargetEnvironment);
+    options.SetOptimizationLevel(OptimizationLevel);
+    if (generateDebugInfo)
+    {
+        options.SetGenerateDebugInfo();
+    }
+    for (auto& define : defines)
+    {
+        options.AddMacroDefinition(define.first, define.second);
+    }
+    options.SetIncluder(std::make_unique<FileIncluder>(sourceDir));
+
+    // shaderc::Compiler 很轻，每次编译用自己的，线程之间不共享
+    shaderc::Compiler compiler;
+    const shaderc_shader_kind kind = shaderKind(stage);
+
+    auto start = std::chrono::steady_clock::now();
+    shaderc::PreprocessedSourceCompilationResult preprocessed = compiler.PreprocessGlsl(source, kind, path.c_str(), options);
+    if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+        throw std::runtime_error("failed to preprocess " + path + ":\n" + preprocessed.GetErrorMessage());
+    }
+    std::string text(preprocessed.cbegin(), preprocessed.cend());
+    preprocessUs += elapsedUs(start);
+
+    // 宏和 include 已经展开在预处理结果里，key 里再加上编译器版本和影响输出的选项。
+    // shaderc 没有自己的版本号，它和头文件来自同一个 SDK，用 SDK 头文件的版本代替
+    unsigned int spvVersion = 0;
+    unsigned int spvRevision = 0;
+    shaderc_get_spv_version(&spvVersion, &spvRevision);
+    uint64_t key = hashBytes(text.data(), text.size());
+    key = hashCombine(key, (uint64_t)spvVersion << 32 | spvRevision);
+    key = hashCombine(key, VK_HEADER_VERSION_COMPLETE);
+    key = hashCombine(key, TargetEnvironment);
+    key = hashCombine(key, OptimizationLevel);
+    key = hashCombine(key, kind);
+    key = hashCombine(key, generateDebugInfo ? 1 : 0);
+    for (auto& define : defines)
+    {
+        key = hashCombine(key, hashBytes(define.first.data(), define.first.size()));
+        key = hashCombine(key, hashBytes(define.second.data(), define.second.size()));
+    }
+
+    char cacheName[32];
+    std::snprintf(cacheName, sizeof(cacheName), "%016llx.spv", (unsigned long long)key);
+    const fs::path cachePath = fs::path(cacheDir) / cacheName;
+
+    std::string cached;
+    if (readText(cachePath, cached) && !cached.empty() && cached.size() % sizeof(uint32_t) == 0)
+    {
+        cachedCount++;
+        return ShaderStage(stage, std::vector<char>(cached.begin(), cached.end()));
+    }
+
+    std::vector<char> code;
+    std::string daemonError;
+    if (daemon && daemon->compileGlsl(text, kind, generateDebugInfo ? static_cast<uint32_t>(CompileFlagDebugInfo) : 0u, code, daemonError))
+    {
+        daemonCount++;
+    }
+    else if (!daemonError.empty())
+    {
+        throw std::runtime_error("failed to compile " + path + ":\n" + daemonError);
+    }
+    else
+    {
+        start = std::chrono::steady_clock::now();
+        shaderc::SpvCompilationResult compiled = compiler.CompileGlslToSpv(text, kind, path.c_str(), options);
+        if (compiled.GetCompilationStatus() != shaderc_compilation_status_success)
+        {
+            throw std::runtime_error("failed to compile " + path + ":\n" + compiled.GetErrorMessage());
+        }
+        compileUs += elapsedUs(start);
+        compiledCount++;
+        code.assign(reinterpret_cast<const char*>(compiled.cbegin()), reinterpret_cast<const char*>(compiled.cend()));
+    }
+
+    // 先写临时文件再改名，其他进程不会读到写了一半的缓存。
+    // 临时文件名加随机数：线程 id 只在进程内唯一，共用 shader_cache 的两个进程会撞名
+    fs::path tempPath = cachePath;
+    tempPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+        std::to_string(std::random_device{}()) + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary);
+        out.write(code.data(), code.size());
+    }
+    std::error_code error;
+    fs::rename(tempPath, cachePath, error);
+    if (error)
+    {
+        fs::remove(tempPath, error);
+    }
+
+    return ShaderStage(stage, std::move(code));
+}
+
+void ShaderCompiler::printReport() const
+{
+    std::cout << "shader compiler: " << compiledCount << " compiled (" << compileUs / 1000.0 << " ms), "
+        << cachedCount << " from disk cache, " << daemonCount << " from compile daemon, preprocess " << preprocessUs / 1000.0 << " ms, "
+        << workers.size() << " threads" << std::endl;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CompileDaemonClient.h"
+#include "ShaderStage.h"
+
+// 运行时用 shaderc 把 shaders/ 下的 GLSL 编成 SPIR-V，支持 #include 和宏定义。
+// 结果按 预处理后的源码 + 编译器版本 + 选项 的哈希缓存到磁盘，热启动时只做预处理，不再编译。
+// 编译在线程池上跑，initVulkan 里多个阶段可以同时编
+class ShaderCompiler
+{
+public:
+    using Defines = std::vector<std::pair<std::string, std::string>>;
+
+    ShaderCompiler(std::string sourceDir, std::string cacheDir, uint32_t threadCount = 0);
+    ~ShaderCompiler();
+
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+    // file 是相对 sourceDir 的路径，编译失败时 future 里带 std::runtime_error
+    std::future<ShaderStage> compileAsync(VkShaderStageFlagBits stage, const std::string& file, const Defines& defines = {});
+
+    // 调试信息属于编译选项，会进入缓存 key
+    bool generateDebugInfo = false;
+    // 本地缓存没命中时先问守护进程，守护进程不在再自己编
+    CompileDaemonClient* daemon = nullptr;
+
+    void printReport() const;
+
+private:
+    ShaderStage compile(VkShaderStageFlagBits stage, const std::string& file, const Defines& defines);
+    void workerLoop();
+
+    std::string sourceDir;
+    std::string cacheDir;
+
+    std::vector<std::thread> workers;
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+
+    std::atomic<uint32_t> compiledCount{ 0 };
+    std::atomic<uint32_t> cachedCount{ 0 };
+    std::atomic<uint32_t> daemonCount{ 0 };
+    // 单位微秒，方便用整数原子累加
+    std::atomic<uint64_t> preprocessUs{ 0 };
+    std::atomic<uint64_t> compileUs{ 0 };
+};
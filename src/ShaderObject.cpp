@@ -0,0 +1,444 @@
+#include "ShaderObject.h"
+#include "VulkanDispatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+const VkShaderStageFlagBits ShaderObjectBackend::stageOrder[StageCount] = {
+    VK_SHADER_STAGE_VERTEX_BIT,
+    VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+    VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+    VK_SHADER_STAGE_GEOMETRY_BIT,
+    VK_SHADER_STAGE_FRAGMENT_BIT,
+};
+
+// shader.tese 是 point_mode，shader.geom 要三角形输入，所以细分和几何不能同时绑定
+const VkShaderStageFlags ShaderObjectBackend::combinations[CombinationCount] = {
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+};
+
+template <typename T>
+static void loadDeviceProc(VkDevice device, T& fn, const char* name)
+{
+    fn = reinterpret_cast<T>(vkGetDeviceProcAddr(device, name));
+    if (fn == nullptr)
+    {
+        throw std::runtime_error(std::string("missing device function ") + name);
+    }
+}
+
+// 每个阶段后面可能接的阶段
+static VkShaderStageFlags nextStages(VkShaderStageFlagBits stage)
+{
+    switch (stage)
+    {
+    case VK_SHADER_STAGE_VERTEX_BIT:
+        return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+        return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+        return VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    case VK_SHADER_STAGE_GEOMETRY_BIT:
+        return VK_SHADER_STAGE_FRAGMENT_BIT;
+    default:
+        return 0;
+    }
+}
+
+void ShaderObjectBackend::query(const DeviceCapabilities& capabilities)
+{
+    supported = false;
+
+    if (!capabilities.apiVersionAtLeast(VK_API_VERSION_1_1))
+    {
+        return;
+    }
+
+    // 1.3 上 dynamic rendering 是核心的，不需要这几个扩展
+    bool dynamicRenderingCore = capabilities.apiVersionAtLeast(VK_API_VERSION_1_3);
+    if (!capabilities.hasExtension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME) || (!dynamicRenderingCore &&
+        (!capabilities.hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) ||
+        !capabilities.hasExtension(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) || !capabilities.hasExtension(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME))))
+    {
+        std::cout << "shader object: not supported" << std::endl;
+        return;
+    }
+
+    shaderObjectFeatures = {};
+    shaderObjectFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+    // dynamic rendering 只在这里检查，扩展和 feature 由 DynamicRendering 负责打开
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeatures.pNext = &shaderObjectFeatures;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &dynamicRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(capabilities.physicalDevice, &features);
+
+    supported = shaderObjectFeatures.shaderObject && dynamicRenderingFeatures.dynamicRendering;
+    tessellationShader = features.features.tessellationShader == VK_TRUE;
+    geometryShader = features.features.geometryShader == VK_TRUE;
+    std::cout << "shader object: " << (supported ? "enabled" : "feature off")
+        << ", tessellation " << tessellationShader << ", geometry " << geometryShader << std::endl;
+}
+
+void ShaderObjectBackend::appendDeviceExtensions(std::vector<const char*>& extensions) const
+{
+    if (supported)
+    {
+        extensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+    }
+}
+
+void* ShaderObjectBackend::chainFeatures(void* pNext)
+{
+    if (!supported)
+    {
+        return pNext;
+    }
+    shaderObjectFeatures.pNext = pNext;
+    return &shaderObjectFeatures;
+}
+
+void ShaderObjectBackend::enableCoreFeatures(VkPhysicalDeviceFeatures& features) const
+{
+    if (supported)
+    {
+        features.tessellationShader = tessellationShader;
+        features.geometryShader = geometryShader;
+    }
+}
+
+void ShaderObjectBackend::load(VkDevice device)
+{
+    if (!supported)
+    {
+        return;
+    }
+    // 打开 shaderObject 之后，这些 dynamic state 函数不依赖各自的扩展也可用
+    loadDeviceProc(device, createShadersEXT, "vkCreateShadersEXT");
+    loadDeviceProc(device, destroyShaderEXT, "vkDestroyShaderEXT");
+    loadDeviceProc(device, cmdBindShaders, "vkCmdBindShadersEXT");
+    loadDeviceProc(device, cmdSetViewportWithCount, "vkCmdSetViewportWithCountEXT");
+    loadDeviceProc(device, cmdSetScissorWithCount, "vkCmdSetScissorWithCountEXT");
+    loadDeviceProc(device, cmdSetRasterizerDiscardEnable, "vkCmdSetRasterizerDiscardEnableEXT");
+    loadDeviceProc(device, cmdSetPolygonMode, "vkCmdSetPolygonModeEXT");
+    loadDeviceProc(device, cmdSetRasterizationSamples, "vkCmdSetRasterizationSamplesEXT");
+    loadDeviceProc(device, cmdSetSampleMask, "vkCmdSetSampleMaskEXT");
+    loadDeviceProc(device, cmdSetAlphaToCoverageEnable, "vkCmdSetAlphaToCoverageEnableEXT");
+    loadDeviceProc(device, cmdSetCullMode, "vkCmdSetCullModeEXT");
+    loadDeviceProc(device, cmdSetFrontFace, "vkCmdSetFrontFaceEXT");
+    loadDeviceProc(device, cmdSetDepthTestEnable, "vkCmdSetDepthTestEnableEXT");
+    loadDeviceProc(device, cmdSetDepthWriteEnable, "vkCmdSetDepthWriteEnableEXT");
+    loadDeviceProc(device, cmdSetDepthCompareOp, "vkCmdSetDepthCompareOpEXT");
+    loadDeviceProc(device, cmdSetDepthBoundsTestEnable, "vkCmdSetDepthBoundsTestEnableEXT");
+    loadDeviceProc(device, cmdSetDepthBiasEnable, "vkCmdSetDepthBiasEnableEXT");
+    loadDeviceProc(device, cmdSetStencilTestEnable, "vkCmdSetStencilTestEnableEXT");
+    loadDeviceProc(device, cmdSetPrimitiveTopology, "vkCmdSetPrimitiveTopologyEXT");
+    loadDeviceProc(device, cmdSetPrimitiveRestartEnable, "vkCmdSetPrimitiveRestartEnableEXT");
+    loadDeviceProc(device, cmdSetPatchControlPoints, "vkCmdSetPatchControlPointsEXT");
+    loadDeviceProc(device, cmdSetVertexInput, "vkCmdSetVertexInputEXT");
+    loadDeviceProc(device, cmdSetColorBlendEnable, "vkCmdSetColorBlendEnableEXT");
+    loadDeviceProc(device, cmdSetColorBlendEquation, "vkCmdSetColorBlendEquationEXT");
+    loadDeviceProc(device, cmdSetColorWriteMask, "vkCmdSetColorWriteMaskEXT");
+}
+
+bool ShaderObjectBackend::supportsStage(VkShaderStageFlagBits stage) const
+{
+    switch (stage)
+    {
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+        return tessellationShader;
+    case VK_SHADER_STAGE_GEOMETRY_BIT:
+        return geometryShader;
+    default:
+        return true;
+    }
+}
+
+void ShaderObjectBackend::createShaders(VkDevice device, const std::vector<ShaderStage>& stages, const std::vector<VkPushConstantRange>& pushConstants)
+{
+    // 各阶段不 link，单独创建，这样任意组合都可以直接绑定
+    std::vector<VkShaderCreateInfoEXT> createInfos;
+    std::vector<VkSpecializationInfo> specInfos;
+    std::vector<uint32_t> slots;
+    specInfos.reserve(stages.size());
+    for (auto& stage : stages)
+    {
+        if (!supportsStage(stage.stage))
+        {
+            continue;
+        }
+        VkShaderCreateInfoEXT createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+        createInfo.stage = stage.stage;
+        createInfo.nextStage = nextStages(stage.stage);
+        if (stage.stage == VK_SHADER_STAGE_VERTEX_BIT && !tessellationShader)
+            createInfo.nextStage &= ~VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        if (!geometryShader)
+            createInfo.nextStage &= ~VK_SHADER_STAGE_GEOMETRY_BIT;
+        createInfo.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        createInfo.codeSize = stage.code.size();
+        createInfo.pCode = stage.code.data();
+        createInfo.pName = "main";
+        createInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+        createInfo.pPushConstantRanges = pushConstants.data();
+        if (stage.specialized())
+        {
+            specInfos.push_back(stage.specializationInfo());
+            createInfo.pSpecializationInfo = &specInfos.back();
+        }
+        createInfos.push_back(createInfo);
+
+        for (uint32_t i = 0; i < StageCount; i++)
+        {
+            if (stageOrder[i] == stage.stage)
+                slots.push_back(i);
+        }
+    }
+
+    std::vector<VkShaderEXT> created(createInfos.size());
+    auto start = std::chrono::steady_clock::now();
+    if (createShadersEXT(device, static_cast<uint32_t>(createInfos.size()), createInfos.data(), nullptr, created.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create shader objects!");
+    }
+    createMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    createCount += static_cast<uint32_t>(created.size());
+
+    for (size_t i = 0; i < created.size(); i++)
+    {
+        if (shaders[slots[i]] != VK_NULL_HANDLE)
+        {
+            destroyShaderEXT(device, shaders[slots[i]], nullptr);
+        }
+        shaders[slots[i]] = created[i];
+    }
+}
+
+bool ShaderObjectBackend::stageCombinationAvailable(VkShaderStageFlags stages) const
+{
+    if (std::find(std::begin(combinations), std::end(combinations), stages) == std::end(combinations))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < StageCount; i++)
+    {
+        if ((stages & stageOrder[i]) && shaders[i] == VK_NULL_HANDLE)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShaderObjectBackend::setStageCombination(VkShaderStageFlags stages)
+{
+    if (!stageCombinationAvailable(stages))
+    {
+        return false;
+    }
+    combination = stages;
+    return true;
+}
+
+void ShaderObjectBackend::cycleStageCombination()
+{
+    uint32_t current = static_cast<uint32_t>(std::find(std::begin(combinations), std::end(combinations), combination) - std::begin(combinations));
+    for (uint32_t i = 1; i <= CombinationCount; i++)
+    {
+        if (setStageCombination(combinations[(current + i) % CombinationCount]))
+        {
+            return;
+        }
+    }
+}
+
+std::string ShaderObjectBackend::stageCombinationName(VkShaderStageFlags stages)
+{
+    static const char* names[StageCount] = { "vert", "tesc", "tese", "geom", "frag" };
+    std::string name;
+    for (uint32_t i = 0; i < StageCount; i++)
+    {
+        if (stages & stageOrder[i])
+        {
+            name += name.empty() ? names[i] : std::string("+") + names[i];
+        }
+    }
+    return name;
+}
+
+void ShaderObjectBackend::bind(VkCommandBuffer commandBuffer, const PipelineStateKey& state, VkExtent2D extent)
+{
+    VkShaderStageFlagBits stages[StageCount];
+    VkShaderEXT bound[StageCount];
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < StageCount; i++)
+    {
+        if (!supportsStage(stageOrder[i]))
+        {
+            continue;
+        }
+        stages[count] = stageOrder[i];
+        bound[count] = (combination & stageOrder[i]) ? shaders[i] : VK_NULL_HANDLE;
+        count++;
+    }
+    cmdBindShaders(commandBuffer, count, stages, bound);
+
+    VkViewport viewport{ 0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f };
+    VkRect2D scissor{ { 0, 0 }, extent };
+    cmdSetViewportWithCount(commandBuffer, 1, &viewport);
+    cmdSetScissorWithCount(commandBuffer, 1, &scissor);
+
+    bool tessellation = (combination & VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT) != 0;
+    cmdSetPrimitiveTopology(commandBuffer, tessellation ? VK_PRIMITIVE_TOPOLOGY_PATCH_LIST : static_cast<VkPrimitiveTopology>(state.topology));
+    cmdSetPrimitiveRestartEnable(commandBuffer, state.primitiveRestartEnable);
+    if (tessellation)
+    {
+        // shader.tesc 输出 3 个控制点
+        cmdSetPatchControlPoints(commandBuffer, 3);
+    }
+
+    VkVertexInputBindingDescription2EXT bindings[MaxVertexBindings]{};
+    VkVertexInputAttributeDescription2EXT attributes[MaxVertexAttributes]{};
+    for (uint32_t i = 0; i < state.bindingCount; i++)
+    {
+        bindings[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+        bindings[i].binding = state.bindings[i].binding;
+        bindings[i].stride = state.bindings[i].stride;
+        bindings[i].inputRate = static_cast<VkVertexInputRate>(state.bindings[i].inputRate);
+        bindings[i].divisor = 1;
+    }
+    for (uint32_t i = 0; i < state.attributeCount; i++)
+    {
+        attributes[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+        attributes[i].location = state.attributes[i].location;
+        attributes[i].binding = state.attributes[i].binding;
+        attributes[i].format = static_cast<VkFormat>(state.attributes[i].format);
+        attributes[i].offset = state.attributes[i].offset;
+    }
+    cmdSetVertexInput(commandBuffer, state.bindingCount, bindings, state.attributeCount, attributes);
+
+    cmdSetRasterizerDiscardEnable(commandBuffer, state.rasterizerDiscardEnable);
+    cmdSetPolygonMode(commandBuffer, static_cast<VkPolygonMode>(state.polygonMode));
+    cmdSetCullMode(commandBuffer, state.cullMode);
+    cmdSetFrontFace(commandBuffer, static_cast<VkFrontFace>(state.frontFace));
+    cmdSetDepthBiasEnable(commandBuffer, state.depthBiasEnable);
+    vkd.vkCmdSetLineWidth(commandBuffer, state.getLineWidth());
+
+    VkSampleCountFlagBits samples = static_cast<VkSampleCountFlagBits>(state.rasterizationSamples);
+    VkSampleMask sampleMask = ~0u;
+    cmdSetRasterizationSamples(commandBuffer, samples);
+    cmdSetSampleMask(commandBuffer, samples, &sampleMask);
+    cmdSetAlphaToCoverageEnable(commandBuffer, VK_FALSE);
+
+    cmdSetDepthTestEnable(commandBuffer, state.depthTestEnable);
+    cmdSetDepthWriteEnable(commandBuffer, state.depthWriteEnable);
+    cmdSetDepthCompareOp(commandBuffer, static_cast<VkCompareOp>(state.depthCompareOp));
+    cmdSetDepthBoundsTestEnable(commandBuffer, VK_FALSE);
+    cmdSetStencilTestEnable(commandBuffer, VK_FALSE);
+
+    // 每个颜色附件都要设，G-buffer 有两个
+    uint32_t attachmentCount = state.colorAttachmentCount;
+    VkColorBlendEquationEXT equation{};
+    equation.srcColorBlendFactor = static_cast<VkBlendFactor>(state.srcColorBlendFactor);
+    equation.dstColorBlendFactor = static_cast<VkBlendFactor>(state.dstColorBlendFactor);
+    equation.colorBlendOp = static_cast<VkBlendOp>(state.colorBlendOp);
+    equation.srcAlphaBlendFactor = static_cast<VkBlendFactor>(state.srcAlphaBlendFactor);
+    equation.dstAlphaBlendFactor = static_cast<VkBlendFactor>(state.dstAlphaBlendFactor);
+    equation.alphaBlendOp = static_cast<VkBlendOp>(state.alphaBlendOp);
+    VkBool32 blendEnable[MaxColorAttachments];
+    VkColorComponentFlags writeMask[MaxColorAttachments];
+    VkColorBlendEquationEXT equations[MaxColorAttachments];
+    std::fill_n(blendEnable, attachmentCount, static_cast<VkBool32>(state.blendEnable));
+    std::fill_n(writeMask, attachmentCount, static_cast<VkColorComponentFlags>(state.colorWriteMask));
+    std::fill_n(equations, attachmentCount, equation);
+    cmdSetColorBlendEnable(commandBuffer, 0, attachmentCount, blendEnable);
+    cmdSetColorWriteMask(commandBuffer, 0, attachmentCount, writeMask);
+    cmdSetColorBlendEquation(commandBuffer, 0, attachmentCount, equations);
+}
+
+void ShaderObjectBackend::benchmarkBinds(VkDevice device, VkCommandPool commandPool, const std::function<void(VkCommandBuffer)>& bindPipeline,
+    const PipelineStateKey& state, VkExtent2D extent, uint32_t iterations)
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (vkd.vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkd.vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        bindPipeline(commandBuffer);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        bind(commandBuffer, state, extent);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // 工具视图里常见的情况：每次绑定都换一组阶段
+    VkShaderStageFlags selected = combination;
+    std::vector<VkShaderStageFlags> available;
+    for (VkShaderStageFlags stages : combinations)
+    {
+        if (stageCombinationAvailable(stages))
+            available.push_back(stages);
+    }
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        combination = available[i % available.size()];
+        bind(commandBuffer, state, extent);
+    }
+    auto switched = std::chrono::steady_clock::now();
+    combination = selected;
+
+    vkd.vkEndCommandBuffer(commandBuffer);
+    vkd.vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+
+    pipelineBindUs = std::chrono::duration<double, std::micro>(middle - start).count() / iterations;
+    shaderBindUs = std::chrono::duration<double, std::micro>(end - middle).count() / iterations;
+    switchBindUs = std::chrono::duration<double, std::micro>(switched - end).count() / iterations;
+    switchCombinations = static_cast<uint32_t>(available.size());
+}
+
+void ShaderObjectBackend::printReport() const
+{
+    if (!supported)
+    {
+        return;
+    }
+    std::cout << "shader object: " << createCount << " shaders created in " << createMs << " ms"
+        << ", pipeline compile " << pipelineCreateMs << " ms" << std::endl;
+    std::cout << "  bind + state per draw: pipeline " << pipelineBindUs << " us, shader object " << shaderBindUs << " us" << std::endl;
+}
+
+void ShaderObjectBackend::destroy(VkDevice device)
+{
+    for (auto& shader : shaders)
+    {
+        if (shader != VK_NULL_HANDLE)
+        {
+            destroyShaderEXT(device, shader, nullptr);
+            shader = VK_NULL_HANDLE;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "DeviceCapabilities.h"
+#include "PipelineStateCache.h"
+#include "ShaderStage.h"
+#include "VulkanExtCompat.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// VK_EXT_shader_object 后端：shaders/ 下每个阶段各自是一个 VkShaderEXT，
+// 单独绑定，所有固定管线状态都在绘制前用 vkCmdSet* 设置（状态来源还是 PipelineStateKey）。
+// shader object 只能配合 dynamic rendering 使用，begin/end rendering 交给 DynamicRendering。
+class ShaderObjectBackend
+{
+public:
+    void query(const DeviceCapabilities& capabilities);
+    void appendDeviceExtensions(std::vector<const char*>& extensions) const;
+    void* chainFeatures(void* pNext);
+    // 细分/几何着色器需要的核心 feature
+    void enableCoreFeatures(VkPhysicalDeviceFeatures& features) const;
+    void load(VkDevice device);
+
+    bool enabled() const { return supported; }
+    bool supportsStage(VkShaderStageFlagBits stage) const;
+
+    // 不支持的阶段会被跳过。同时绑定的 shader object 必须用同样的 push constant 范围创建
+    void createShaders(VkDevice device, const std::vector<ShaderStage>& stages, const std::vector<VkPushConstantRange>& pushConstants = {});
+    // 选择绑定哪些阶段，默认 vertex + fragment。组合不可用时返回 false，保持原来的组合
+    bool setStageCombination(VkShaderStageFlags stages);
+    bool stageCombinationAvailable(VkShaderStageFlags stages) const;
+    VkShaderStageFlags stageCombination() const { return combination; }
+    // 切到下一个可用的组合
+    void cycleStageCombination();
+    static std::string stageCombinationName(VkShaderStageFlags stages);
+
+    void bind(VkCommandBuffer commandBuffer, const PipelineStateKey& state, VkExtent2D extent);
+
+    // 在一个不提交的 command buffer 里分别录制 iterations 次 pipeline 绑定和 shader object 绑定，比较 CPU 开销，
+    // 再测一次每次绑定都换一个阶段组合的开销
+    void benchmarkBinds(VkDevice device, VkCommandPool commandPool, const std::function<void(VkCommandBuffer)>& bindPipeline,
+        const PipelineStateKey& state, VkExtent2D extent, uint32_t iterations);
+    // 记录 pipeline 路径的编译耗时，报告里和 shader object 的创建耗时放在一起比较
+    void recordPipelineCompile(double ms) { pipelineCreateMs += ms; }
+    void printReport() const;
+    void destroy(VkDevice device);
+
+private:
+    static constexpr uint32_t StageCount = 5;
+    static const VkShaderStageFlagBits stageOrder[StageCount];
+    static constexpr uint32_t CombinationCount = 3;
+    static const VkShaderStageFlags combinations[CombinationCount];
+
+    bool supported = false;
+    bool tessellationShader = false;
+    bool geometryShader = false;
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures{};
+
+    VkShaderEXT shaders[StageCount] = {};
+    VkShaderStageFlags combination = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    double createMs = 0.0;
+    uint32_t createCount = 0;
+    double pipelineCreateMs = 0.0;
+    double pipelineBindUs = 0.0;
+    double shaderBindUs = 0.0;
+    double switchBindUs = 0.0;
+    uint32_t switchCombinations = 0;
+
+    PFN_vkCreateShadersEXT createShadersEXT = nullptr;
+    PFN_vkDestroyShaderEXT destroyShaderEXT = nullptr;
+    PFN_vkCmdBindShadersEXT cmdBindShaders = nullptr;
+    PFN_vkCmdSetViewportWithCountEXT cmdSetViewportWithCount = nullptr;
+    PFN_vkCmdSetScissorWithCountEXT cmdSetScissorWithCount = nullptr;
+    PFN_vkCmdSetRasterizerDiscardEnableEXT cmdSetRasterizerDiscardEnable = nullptr;
+    PFN_vkCmdSetPolygonModeEXT cmdSetPolygonMode = nullptr;
+    PFN_vkCmdSetRasterizationSamplesEXT cmdSetRasterizationSamples = nullptr;
+    PFN_vkCmdSetSampleMaskEXT cmdSetSampleMask = nullptr;
+    PFN_vkCmdSetAlphaToCoverageEnableEXT cmdSetAlphaToCoverageEnable = nullptr;
+    PFN_vkCmdSetCullModeEXT cmdSetCullMode = nullptr;
+    PFN_vkCmdSetFrontFaceEXT cmdSetFrontFace = nullptr;
+    PFN_vkCmdSetDepthTestEnableEXT cmdSetDepthTestEnable = nullptr;
+    PFN_vkCmdSetDepthWriteEnableEXT cmdSetDepthWriteEnable = nullptr;
+    PFN_vkCmdSetDepthCompareOpEXT cmdSetDepthCompareOp = nullptr;
+    PFN_vkCmdSetDepthBoundsTestEnableEXT cmdSetDepthBoundsTestEnable = nullptr;
+    PFN_vkCmdSetDepthBiasEnableEXT cmdSetDepthBiasEnable = nullptr;
+    PFN_vkCmdSetStencilTestEnableEXT cmdSetStencilTestEnable = nullptr;
+    PFN_vkCmdSetPrimitiveTopologyEXT cmdSetPrimitiveTopology = nullptr;
+    PFN_vkCmdSetPrimitiveRestartEnableEXT cmdSetPrimitiveRestartEnable = nullptr;
+    PFN_vkCmdSetPatchControlPointsEXT cmdSetPatchControlPoints = nullptr;
+    PFN_vkCmdSetVertexInputEXT cmdSetVertexInput = nullptr;
+    PFN_vkCmdSetColorBlendEnableEXT cmdSetColorBlendEnable = nullptr;
+    PFN_vkCmdSetColorBlendEquationEXT cmdSetColorBlendEquation = nullptr;
+    PFN_vkCmdSetColorWriteMaskEXT cmdSetColorWriteMask = nullptr;
+};
@@ -0,0 +1,132 @@
+#include "ShaderOptimizer.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef SPIRV_OPTIMIZER_AVAILABLE
+#include <spirv-tools/optimizer.hpp>
+#endif
+
+size_t countSpirvInstructions(const std::vector<char>& code)
+{
+    const size_t wordCount = code.size() / sizeof(uint32_t);
+    size_t count = 0;
+    // 每条指令第一个字的高 16 位是这条指令的字数
+    for (size_t word = 5; word < wordCount; count++)
+    {
+        uint32_t first;
+        std::memcpy(&first, code.data() + word * sizeof(uint32_t), sizeof(first));
+        uint32_t length = first >> 16;
+        if (length == 0)
+        {
+            break;
+        }
+        word += length;
+    }
+    return count;
+}
+
+#ifdef SPIRV_OPTIMIZER_AVAILABLE
+static bool runOptimizer(const ShaderStage& stage, bool performancePasses, bool stripDebugInfo, bool foldSpecConstants,
+    std::vector<uint32_t>& optimized)
+{
+    spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_1);
+    optimizer.SetMessageConsumer([](spv_message_level_t level, const char*, const spv_position_t& position, const char* message) {
+        if (level <= SPV_MSG_ERROR)
+        {
+            std::cerr << "spirv-opt: " << position.index << ": " << message << std::endl;
+        }
+    });
+
+    if (foldSpecConstants && stage.specialized())
+    {
+        std::unordered_map<uint32_t, std::vector<uint32_t>> values;
+        for (size_t i = 0; i < stage.specEntries.size(); i++)
+        {
+            values[stage.specEntries[i].constantID] = { stage.specData[i] };
+        }
+        optimizer.RegisterPass(spvtools::CreateSetSpecConstantDefaultValuePass(values));
+        optimizer.RegisterPass(spvtools::CreateFreezeSpecConstantValuePass());
+        optimizer.RegisterPass(spvtools::CreateFoldSpecConstantOpAndCompositePass());
+    }
+    if (performancePasses)
+    {
+        optimizer.RegisterPerformancePasses();
+    }
+    if (stripDebugInfo)
+    {
+        optimizer.RegisterPass(spvtools::CreateStripDebugInfoPass());
+        optimizer.RegisterPass(spvtools::CreateStripNonSemanticInfoPass());
+    }
+
+    // descriptor binding 保持不变，这样反射出来的 layout 和优化前一致
+    spvtools::OptimizerOptions options;
+    options.set_preserve_bindings(true);
+    options.set_preserve_spec_constants(!foldSpecConstants);
+
+    return optimizer.Run(reinterpret_cast<const uint32_t*>(stage.code.data()), stage.code.size() / sizeof(uint32_t),
+        &optimized, options);
+}
+#endif
+
+ShaderStage ShaderOptimizer::optimize(const ShaderStage& stage, const std::string& name)
+{
+    const bool fold = foldSpecConstants && stage.specialized();
+    // 折叠常量时常量取值是输入的一部分
+    uint64_t key = hashCombine(fold ? stage.hash : stage.codeHash,
+        (performancePasses ? 1 : 0) | (stripDebugInfo ? 2 : 0) | (fold ? 4 : 0));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<char> code;
+    bool cached = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cache.find(key);
+        if (it != cache.end())
+        {
+            code = it->second;
+            cached = true;
+        }
+    }
+
+    if (!cached)
+    {
+        code = stage.code;
+#ifdef SPIRV_OPTIMIZER_AVAILABLE
+        std::vector<uint32_t> optimized;
+        if (runOptimizer(stage, performancePasses, stripDebugInfo, fold, optimized))
+        {
+            code.resize(optimized.size() * sizeof(uint32_t));
+            std::memcpy(code.data(), optimized.data(), code.size());
+        }
+        else
+        {
+            std::cerr << "spirv-opt failed on " << name << ", using unoptimized SPIR-V" << std::endl;
+        }
+#endif
+        std::lock_guard<std::mutex> lock(mutex);
+        cache.emplace(key, code);
+    }
+
+    // 折叠过的常量已经写死在模块里，不再需要 VkSpecializationInfo
+    ShaderStage result = fold ? ShaderStage(stage.stage, std::move(code)) : stage.withCode(std::move(code));
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    report.push_back({ name, countSpirvInstructions(stage.code), countSpirvInstructions(result.code), ms, cached });
+    return result;
+}
+
+void ShaderOptimizer::printReport() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+#ifndef SPIRV_OPTIMIZER_AVAILABLE
+    std::cout << "shader optimizer: SPIRV-Tools-opt not linked, SPIR-V passed through unchanged" << std::endl;
+#endif
+    for (auto& entry : report)
+    {
+        std::cout << "shader " << entry.name << ": " << entry.instructionsBefore << " -> " << entry.instructionsAfter
+            << " instructions, " << entry.ms << " ms" << (entry.cached ? " (cached)" : "") << std::endl;
+    }
+}
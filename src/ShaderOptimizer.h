@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ShaderStage.h"
+
+// 创建 module 之前对 SPIR-V 做一遍 spirv-tools 优化。
+// 结果按输入哈希 + 选项缓存，同一份 SPIR-V 只优化一次。
+// 只有 CMake 找到 SPIRV-Tools-opt 时才会真正优化（SPIRV_OPTIMIZER_AVAILABLE），否则原样返回，只统计指令数
+class ShaderOptimizer
+{
+public:
+    // 相当于 spirv-opt -O
+    bool performancePasses = true;
+    // 去掉 OpName / OpLine / OpSource 等调试信息，release 用
+    bool stripDebugInfo = false;
+    // 把 stage 上的 specialization constant 取值写进模块、冻结并折叠，
+    // 输出的 stage 不再带常量，死分支在这里就被删掉
+    bool foldSpecConstants = false;
+
+    ShaderStage optimize(const ShaderStage& stage, const std::string& name);
+    void printReport() const;
+
+private:
+    struct ReportEntry
+    {
+        std::string name;
+        size_t instructionsBefore;
+        size_t instructionsAfter;
+        double ms;
+        bool cached;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, std::vector<char>> cache;
+    std::vector<ReportEntry> report;
+};
+
+// SPIR-V 里的指令条数（不含 5 个字的 header）
+size_t countSpirvInstructions(const std::vector<char>& code);
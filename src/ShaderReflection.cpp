@@ -0,0 +1,266 @@
+#include "ShaderReflection.h"
+#include "PipelineStateCache.h"
+#include "VulkanDispatch.h"
+
+#include <spirv_reflect.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static void checkReflect(SpvReflectResult result, const char* what)
+{
+    if (result != SPV_REFLECT_RESULT_SUCCESS)
+    {
+        throw std::runtime_error(std::string("spirv reflect failed: ") + what);
+    }
+}
+
+static void mergeDescriptorSets(const SpvReflectShaderModule& module, VkShaderStageFlagBits stage, ShaderInterface& result)
+{
+    uint32_t count = 0;
+    checkReflect(spvReflectEnumerateDescriptorSets(&module, &count, nullptr), "descriptor sets");
+    std::vector<SpvReflectDescriptorSet*> reflectedSets(count);
+    checkReflect(spvReflectEnumerateDescriptorSets(&module, &count, reflectedSets.data()), "descriptor sets");
+
+    for (auto* reflectedSet : reflectedSets)
+    {
+        auto& bindings = result.sets[reflectedSet->set];
+        for (uint32_t i = 0; i < reflectedSet->binding_count; i++)
+        {
+            const SpvReflectDescriptorBinding* reflected = reflectedSet->bindings[i];
+            // SpvReflectDescriptorType 的取值和 VkDescriptorType 一致
+            VkDescriptorType type = static_cast<VkDescriptorType>(reflected->descriptor_type);
+
+            auto it = std::find_if(bindings.begin(), bindings.end(), [&](const VkDescriptorSetLayoutBinding& b) {
+                return b.binding == reflected->binding;
+            });
+            if (it == bindings.end())
+            {
+                VkDescriptorSetLayoutBinding binding{};
+                binding.binding = reflected->binding;
+                binding.descriptorType = type;
+                binding.descriptorCount = reflected->count;
+                binding.stageFlags = stage;
+                bindings.push_back(binding);
+                continue;
+            }
+            if (it->descriptorType != type || it->descriptorCount != reflected->count)
+            {
+                throw std::runtime_error("descriptor set " + std::to_string(reflectedSet->set) + " binding "
+                    + std::to_string(reflected->binding) + " declared differently between stages");
+            }
+            it->stageFlags |= stage;
+        }
+    }
+}
+
+static void mergePushConstants(const SpvReflectShaderModule& module, VkShaderStageFlagBits stage, ShaderInterface& result)
+{
+    uint32_t count = 0;
+    checkReflect(spvReflectEnumeratePushConstantBlocks(&module, &count, nullptr), "push constants");
+    std::vector<SpvReflectBlockVariable*> blocks(count);
+    checkReflect(spvReflectEnumeratePushConstantBlocks(&module, &count, blocks.data()), "push constants");
+
+    // 一个阶段最多一个 push constant block，范围取实际用到的成员
+    for (auto* block : blocks)
+    {
+        uint32_t begin = block->offset;
+        uint32_t end = block->offset + block->size;
+        if (block->member_count > 0)
+        {
+            begin = UINT32_MAX;
+            end = 0;
+            for (uint32_t i = 0; i < block->member_count; i++)
+            {
+                begin = std::min(begin, block->members[i].offset);
+                end = std::max(end, block->members[i].offset + block->members[i].size);
+            }
+        }
+
+        auto it = std::find_if(result.pushConstants.begin(), result.pushConstants.end(), [&](const VkPushConstantRange& r) {
+            return r.offset == begin && r.size == end - begin;
+        });
+        if (it != result.pushConstants.end())
+        {
+            it->stageFlags |= stage;
+        }
+        else
+        {
+            result.pushConstants.push_back({ static_cast<VkShaderStageFlags>(stage), begin, end - begin });
+        }
+    }
+}
+
+static void reflectVertexInputs(const SpvReflectShaderModule& module, ShaderInterface& result)
+{
+    uint32_t count = 0;
+    checkReflect(spvReflectEnumerateInputVariables(&module, &count, nullptr), "input variables");
+    std::vector<SpvReflectInterfaceVariable*> inputs(count);
+    checkReflect(spvReflectEnumerateInputVariables(&module, &count, inputs.data()), "input variables");
+
+    inputs.erase(std::remove_if(inputs.begin(), inputs.end(), [](const SpvReflectInterfaceVariable* input) {
+        return (input->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) != 0;
+    }), inputs.end());
+    std::sort(inputs.begin(), inputs.end(), [](const SpvReflectInterfaceVariable* a, const SpvReflectInterfaceVariable* b) {
+        return a->location < b->location;
+    });
+
+    uint32_t offset = 0;
+    for (auto* input : inputs)
+    {
+        VkVertexInputAttributeDescription attribute{};
+        attribute.location = input->location;
+        attribute.binding = 0;
+        // SpvReflectFormat 的取值和 VkFormat 一致
+        attribute.format = static_cast<VkFormat>(input->format);
+        attribute.offset = offset;
+        result.vertexAttributes.push_back(attribute);
+
+        uint32_t components = std::max(input->numeric.vector.component_count, 1u);
+        offset += components * input->numeric.scalar.width / 8;
+    }
+    result.vertexStride = offset;
+}
+
+ShaderInterface reflectShaderStages(const std::vector<ShaderStage>& stages)
+{
+    ShaderInterface result;
+    for (auto& stage : stages)
+    {
+        SpvReflectShaderModule module;
+        checkReflect(spvReflectCreateShaderModule(stage.code.size(), stage.code.data(), &module), "create module");
+
+        mergeDescriptorSets(module, stage.stage, result);
+        mergePushConstants(module, stage.stage, result);
+        if (stage.stage == VK_SHADER_STAGE_VERTEX_BIT)
+        {
+            reflectVertexInputs(module, result);
+        }
+
+        spvReflectDestroyShaderModule(&module);
+    }
+
+    for (auto& set : result.sets)
+    {
+        std::sort(set.second.begin(), set.second.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+            return a.binding < b.binding;
+        });
+    }
+    return result;
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getOrCreateSetLayout(VkDevice device, const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+    setLayoutRequests++;
+
+    // binding 已经排好序，内容直接展开成 key
+    std::vector<uint32_t> key;
+    key.reserve(bindings.size() * 4);
+    for (auto& binding : bindings)
+    {
+        key.push_back(binding.binding);
+        key.push_back(binding.descriptorType);
+        key.push_back(binding.descriptorCount);
+        key.push_back(binding.stageFlags);
+    }
+
+    auto it = setLayouts.find(key);
+    if (it != setLayouts.end())
+    {
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout setLayout;
+    if (vkd.vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+    setLayouts.emplace(std::move(key), setLayout);
+    return setLayout;
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::setLayout(VkDevice device, const ShaderInterface& shaderInterface, uint32_t set)
+{
+    auto it = shaderInterface.sets.find(set);
+    if (it == shaderInterface.sets.end())
+    {
+        return VK_NULL_HANDLE;
+    }
+    return getOrCreateSetLayout(device, it->second);
+}
+
+VkPipelineLayout PipelineLayoutCache::getOrCreate(VkDevice device, const ShaderInterface& shaderInterface)
+{
+    pipelineLayoutRequests++;
+
+    // set 编号中间有空的用空 layout 补上
+    std::vector<VkDescriptorSetLayout> layouts;
+    if (!shaderInterface.sets.empty())
+    {
+        uint32_t setCount = shaderInterface.sets.rbegin()->first + 1;
+        for (uint32_t set = 0; set < setCount; set++)
+        {
+            auto it = shaderInterface.sets.find(set);
+            layouts.push_back(getOrCreateSetLayout(device, it != shaderInterface.sets.end() ? it->second : std::vector<VkDescriptorSetLayoutBinding>{}));
+        }
+    }
+
+    std::vector<uint64_t> key;
+    key.push_back(layouts.size());
+    for (auto layout : layouts)
+    {
+        key.push_back(handleBits(layout));
+    }
+    for (auto& range : shaderInterface.pushConstants)
+    {
+        key.push_back(range.stageFlags);
+        key.push_back((uint64_t)range.offset << 32 | range.size);
+    }
+
+    auto it = pipelineLayouts.find(key);
+    if (it != pipelineLayouts.end())
+    {
+        return it->second;
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(shaderInterface.pushConstants.size());
+    pipelineLayoutInfo.pPushConstantRanges = shaderInterface.pushConstants.data();
+
+    VkPipelineLayout pipelineLayout;
+    if (vkd.vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+    pipelineLayouts.emplace(std::move(key), pipelineLayout);
+    return pipelineLayout;
+}
+
+void PipelineLayoutCache::printReport() const
+{
+    std::cout << "pipeline layouts: " << pipelineLayouts.size() << " created for " << pipelineLayoutRequests << " requests"
+        << ", set layouts: " << setLayouts.size() << " created for " << setLayoutRequests << " requests" << std::endl;
+}
+
+void PipelineLayoutCache::destroy(VkDevice device)
+{
+    for (auto& entry : pipelineLayouts)
+    {
+        vkd.vkDestroyPipelineLayout(device, entry.second, nullptr);
+    }
+    for (auto& entry : setLayouts)
+    {
+        vkd.vkDestroyDescriptorSetLayout(device, entry.second, nullptr);
+    }
+    pipelineLayouts.clear();
+    setLayouts.clear();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "ShaderStage.h"
+
+// 用 SPIRV-Reflect 从各阶段 SPIR-V 里读出来的资源接口，已经跨阶段合并：
+// 同一个 set/binding 的 stageFlags 合并，push constant 范围相同的阶段合并成一条
+struct ShaderInterface
+{
+    // set 编号 -> 按 binding 排好序的 binding 列表
+    std::map<uint32_t, std::vector<VkDescriptorSetLayoutBinding>> sets;
+    std::vector<VkPushConstantRange> pushConstants;
+    // vertex shader 的输入，按 location 排序，假设都在 binding 0 上紧密交错排列
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    uint32_t vertexStride = 0;
+};
+
+ShaderInterface reflectShaderStages(const std::vector<ShaderStage>& stages);
+
+// descriptor set layout 和 pipeline layout 按内容去重。
+// 接口相同的 pipeline 拿到的是同一个 layout 句柄，互相兼容，切换 pipeline 时已绑定的 descriptor set 不会失效
+class PipelineLayoutCache
+{
+public:
+    VkPipelineLayout getOrCreate(VkDevice device, const ShaderInterface& shaderInterface);
+    // getOrCreate 里为 set 编号 set 用的 layout，没有则返回 VK_NULL_HANDLE
+    VkDescriptorSetLayout setLayout(VkDevice device, const ShaderInterface& shaderInterface, uint32_t set);
+
+    void printReport() const;
+    void destroy(VkDevice device);
+
+private:
+    VkDescriptorSetLayout getOrCreateSetLayout(VkDevice device, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+    std::map<std::vector<uint32_t>, VkDescriptorSetLayout> setLayouts;
+    std::map<std::vector<uint64_t>, VkPipelineLayout> pipelineLayouts;
+
+    uint32_t setLayoutRequests = 0;
+    uint32_t pipelineLayoutRequests = 0;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Hash.h"
+
+// 一个着色器阶段的 SPIR-V，哈希在加载时算好。
+// 同一份 SPIR-V 可以带不同的 specialization constant 取值，取值也算进哈希，
+// 所以每个 permutation 在 PipelineStateCache / library 缓存里都是独立的条目
+struct ShaderStage
+{
+    VkShaderStageFlagBits stage;
+    std::vector<char> code;
+    uint64_t codeHash = 0;
+    uint64_t hash = 0;
+    // 每个常量固定 4 字节（int/uint/float/bool）
+    std::vector<VkSpecializationMapEntry> specEntries;
+    std::vector<uint32_t> specData;
+
+    ShaderStage(VkShaderStageFlagBits stage, std::vector<char> code)
+        : stage(stage), code(std::move(code))
+    {
+        codeHash = hashBytes(this->code.data(), this->code.size());
+        rehash();
+    }
+
+    template <typename T>
+    ShaderStage& specialize(uint32_t constantId, T value)
+    {
+        static_assert(sizeof(T) == sizeof(uint32_t) && std::is_trivially_copyable_v<T>, "specialization constants are 32-bit");
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        size_t i = 0;
+        while (i < specEntries.size() && specEntries[i].constantID != constantId)
+        {
+            i++;
+        }
+        if (i == specEntries.size())
+        {
+            specEntries.push_back({ constantId, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t) });
+            specData.push_back(bits);
+        }
+        else
+        {
+            specData[i] = bits;
+        }
+        rehash();
+        return *this;
+    }
+
+    bool specialized() const { return !specEntries.empty(); }
+
+    // 换一份 SPIR-V（比如优化过的），保留 specialization constant
+    ShaderStage withCode(std::vector<char> newCode) const
+    {
+        ShaderStage result(stage, std::move(newCode));
+        result.specEntries = specEntries;
+        result.specData = specData;
+        result.rehash();
+        return result;
+    }
+
+    // 返回的结构指向本对象的数据，本对象要活到 create 调用结束
+    VkSpecializationInfo specializationInfo() const
+    {
+        VkSpecializationInfo info{};
+        info.mapEntryCount = static_cast<uint32_t>(specEntries.size());
+        info.pMapEntries = specEntries.data();
+        info.dataSize = specData.size() * sizeof(uint32_t);
+        info.pData = specData.data();
+        return info;
+    }
+
+private:
+    void rehash()
+    {
+        hash = hashCombine(codeHash, stage);
+        for (size_t i = 0; i < specEntries.size(); i++)
+        {
+            hash = hashCombine(hashCombine(hash, specEntries[i].constantID), specData[i]);
+        }
+    }
+};
+
+// 所有阶段的组合哈希，用作 PipelineStateKey::shaderHash
+inline uint64_t hashShaderStages(const std::vector<ShaderStage>& stages)
+{
+    uint64_t hash = FnvOffsetBasis;
+    for (auto& stage : stages)
+    {
+        hash = hashCombine(hash, stage.hash);
+    }
+    return hash;
+}
+
+// 带常量的阶段生成 VkSpecializationInfo 挂到 stage create info 上。
+// specInfos 要提前 reserve 好，和 stageInfos 一起活到 create 调用结束
+inline void applySpecialization(const ShaderStage& stage, VkPipelineShaderStageCreateInfo& stageInfo,
+    std::vector<VkSpecializationInfo>& specInfos)
+{
+    if (stage.specialized())
+    {
+        specInfos.push_back(stage.specializationInfo());
+        stageInfo.pSpecializationInfo = &specInfos.back();
+    }
+}
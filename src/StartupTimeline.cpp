@@ -0,0 +1,81 @@
+#include "StartupTimeline.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+void StartupTimeline::begin()
+{
+    startTime = std::chrono::steady_clock::now();
+}
+
+double StartupTimeline::sinceBegin(std::chrono::steady_clock::time_point time) const
+{
+    return std::chrono::duration<double, std::milli>(time - startTime).count();
+}
+
+void StartupTimeline::step(const char* name, const std::function<void()>& fn)
+{
+    PROFILE_ZONE(name);
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+
+    std::ostringstream thread;
+    thread << std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(stepMutex);
+    steps.push_back({ name, thread.str(), sinceBegin(start), sinceBegin(end) - sinceBegin(start) });
+    if (std::find(threads.begin(), threads.end(), steps.back().thread) == threads.end())
+    {
+        threads.push_back(steps.back().thread);
+    }
+}
+
+void StartupTimeline::markFirstPresent()
+{
+    if (firstPresentDone())
+    {
+        return;
+    }
+    firstPresentMs = sinceBegin(std::chrono::steady_clock::now());
+    printReport();
+}
+
+void StartupTimeline::printReport() const
+{
+    std::lock_guard<std::mutex> lock(stepMutex);
+    if (steps.empty())
+    {
+        return;
+    }
+    std::vector<Step> sorted = steps;
+    std::sort(sorted.begin(), sorted.end(), [](const Step& a, const Step& b) { return a.startMs < b.startMs; });
+
+    double serialMs = 0.0;
+    double lastEndMs = 0.0;
+    std::cout << std::fixed << std::setprecision(2) << "startup breakdown (start + duration ms, thread):" << std::endl;
+    for (const Step& step : sorted)
+    {
+        // 线程按第一次出现的顺序编号，0 是主线程
+        size_t threadIndex = std::find(threads.begin(), threads.end(), step.thread) - threads.begin();
+        std::cout << "  " << std::setw(8) << step.startMs << " + " << std::setw(8) << step.durationMs << "  [" << threadIndex << "] "
+            << step.name << std::endl;
+        serialMs += step.durationMs;
+        lastEndMs = std::max(lastEndMs, step.startMs + step.durationMs);
+    }
+    std::cout << "  steps sum " << serialMs << " ms, finished at " << lastEndMs << " ms";
+    if (serialMs > lastEndMs)
+    {
+        std::cout << " (" << serialMs - lastEndMs << " ms overlapped)";
+    }
+    std::cout << std::endl;
+    if (firstPresentDone())
+    {
+        std::cout << "  time to first present: " << firstPresentMs << " ms" << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
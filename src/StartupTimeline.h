@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 记录启动时每一步的开始时间和耗时（可以在不同线程上），第一次 present 时打印启动分解和 time-to-first-present。
+// 各步耗时之和减去实际经过的时间就是并行省下来的时间
+class StartupTimeline
+{
+public:
+    // run() 开头调用，之后的时间都相对这里
+    void begin();
+    // 执行 fn 并记一步；name 必须一直有效（字符串字面量），同时也是 profiler 的 zone 名
+    void step(const char* name, const std::function<void()>& fn);
+    // 第一次 present 返回后调用，只有第一次有效
+    void markFirstPresent();
+
+    bool firstPresentDone() const { return firstPresentMs >= 0.0; }
+    double timeToFirstPresentMs() const { return firstPresentMs; }
+
+    void printReport() const;
+
+private:
+    struct Step
+    {
+        const char* name;
+        std::string thread;
+        double startMs;
+        double durationMs;
+    };
+
+    double sinceBegin(std::chrono::steady_clock::time_point time) const;
+
+    std::chrono::steady_clock::time_point startTime;
+    mutable std::mutex stepMutex;
+    std::vector<Step> steps;
+    std::vector<std::string> threads;
+    double firstPresentMs = -1.0;
+};
@@ -0,0 +1,24 @@
+#include "VulkanDispatch.h"
+
+VulkanDispatch vkd;
+
+void VulkanDispatch::load(VkDevice device)
+{
+#define VULKAN_LOAD_FUNCTION(name) \
+    if (PFN_vkVoidFunction function = vkGetDeviceProcAddr(device, #name)) \
+    { \
+        name = reinterpret_cast<PFN_##name>(function); \
+    }
+    VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+}
+
+const char* vulkanFunctionName(VulkanFunctionId id)
+{
+    static const char* const names[] = {
+#define VULKAN_FUNCTION_NAME(name) #name,
+        VULKAN_DEVICE_FUNCTIONS(VULKAN_FUNCTION_NAME)
+#undef VULKAN_FUNCTION_NAME
+    };
+    return id < VulkanFunctionCount ? names[id] : "unknown";
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// 应用用到的 device 级入口。新调用的函数要加到这里，然后通过 vkd 调用
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+    VULKAN_EXPORTED_DEVICE_FUNCTIONS(X) \
+    VULKAN_1_3_DEVICE_FUNCTIONS(X)
+
+// vulkan-1 导出的入口
+#define VULKAN_EXPORTED_DEVICE_FUNCTIONS(X) \
+    X(vkAcquireNextImageKHR) \
+    X(vkAllocateCommandBuffers) \
+    X(vkAllocateDescriptorSets) \
+    X(vkAllocateMemory) \
+    X(vkBeginCommandBuffer) \
+    X(vkBindBufferMemory) \
+    X(vkBindImageMemory) \
+    X(vkCmdBeginQuery) \
+    X(vkCmdBeginRenderPass) \
+    X(vkCmdBindDescriptorSets) \
+    X(vkCmdBindPipeline) \
+    X(vkCmdBindVertexBuffers) \
+    X(vkCmdClearColorImage) \
+    X(vkCmdCopyImage) \
+    X(vkCmdCopyImageToBuffer) \
+    X(vkCmdDraw) \
+    X(vkCmdEndQuery) \
+    X(vkCmdEndRenderPass) \
+    X(vkCmdNextSubpass) \
+    X(vkCmdPipelineBarrier) \
+    X(vkCmdPushConstants) \
+    X(vkCmdResetQueryPool) \
+    X(vkCmdSetLineWidth) \
+    X(vkCmdSetScissor) \
+    X(vkCmdSetViewport) \
+    X(vkCmdWriteTimestamp) \
+    X(vkCreateBuffer) \
+    X(vkCreateCommandPool) \
+    X(vkCreateDescriptorPool) \
+    X(vkCreateDescriptorSetLayout) \
+    X(vkCreateFence) \
+    X(vkCreateFramebuffer) \
+    X(vkCreateGraphicsPipelines) \
+    X(vkCreateImage) \
+    X(vkCreateImageView) \
+    X(vkCreatePipelineCache) \
+    X(vkCreatePipelineLayout) \
+    X(vkCreateQueryPool) \
+    X(vkCreateRenderPass) \
+    X(vkCreateSemaphore) \
+    X(vkCreateShaderModule) \
+    X(vkCreateSwapchainKHR) \
+    X(vkDestroyBuffer) \
+    X(vkDestroyCommandPool) \
+    X(vkDestroyDescriptorPool) \
+    X(vkDestroyDescriptorSetLayout) \
+    X(vkDestroyFence) \
+    X(vkDestroyFramebuffer) \
+    X(vkDestroyImage) \
+    X(vkDestroyImageView) \
+    X(vkDestroyPipeline) \
+    X(vkDestroyPipelineCache) \
+    X(vkDestroyPipelineLayout) \
+    X(vkDestroyQueryPool) \
+    X(vkDestroyRenderPass) \
+    X(vkDestroySemaphore) \
+    X(vkDestroyShaderModule) \
+    X(vkDestroySwapchainKHR) \
+    X(vkDeviceWaitIdle) \
+    X(vkEndCommandBuffer) \
+    X(vkFreeCommandBuffers) \
+    X(vkFreeMemory) \
+    X(vkGetBufferMemoryRequirements) \
+    X(vkGetDeviceMemoryCommitment) \
+    X(vkGetDeviceQueue) \
+    X(vkGetImageMemoryRequirements) \
+    X(vkGetPipelineCacheData) \
+    X(vkGetQueryPoolResults) \
+    X(vkGetSwapchainImagesKHR) \
+    X(vkMapMemory) \
+    X(vkMergePipelineCaches) \
+    X(vkQueuePresentKHR) \
+    X(vkQueueSubmit) \
+    X(vkQueueWaitIdle) \
+    X(vkResetCommandBuffer) \
+    X(vkResetFences) \
+    X(vkUnmapMemory) \
+    X(vkUpdateDescriptorSets) \
+    X(vkWaitForFences)
+
+// 1.3 核心入口：老的 loader 不导出，不能直接引用符号，load 之前是空的，协商到 1.3 才能调用
+#define VULKAN_1_3_DEVICE_FUNCTIONS(X) \
+    X(vkCmdPipelineBarrier2)
+
+enum VulkanFunctionId : uint32_t
+{
+#define VULKAN_FUNCTION_ID(name) name##Id,
+    VULKAN_DEVICE_FUNCTIONS(VULKAN_FUNCTION_ID)
+#undef VULKAN_FUNCTION_ID
+    VulkanFunctionCount
+};
+
+// device 级调用都经过这张表：vkd.vkCmdDraw(...)。
+// 默认指向 vulkan-1 导出的入口，每次调用都要先经过 loader 的 trampoline 按 dispatchable handle 再跳一次；
+// 创建 device 之后 load 用 vkGetDeviceProcAddr 换成驱动（或者最上面一层 layer）的入口，省掉这一跳。
+// ApiCallCounter 打开时再换成先计数再转发的包装函数
+struct VulkanDispatch
+{
+#define VULKAN_DISPATCH_MEMBER(name) PFN_##name name = ::name;
+    VULKAN_EXPORTED_DEVICE_FUNCTIONS(VULKAN_DISPATCH_MEMBER)
+#undef VULKAN_DISPATCH_MEMBER
+#define VULKAN_DISPATCH_MEMBER_1_3(name) PFN_##name name = nullptr;
+    VULKAN_1_3_DEVICE_FUNCTIONS(VULKAN_DISPATCH_MEMBER_1_3)
+#undef VULKAN_DISPATCH_MEMBER_1_3
+
+    // 取不到的入口（比如没启用的扩展）保留原来的指针。表只对这一个 device 有效
+    void load(VkDevice device);
+};
+
+extern VulkanDispatch vkd;
+
+const char* vulkanFunctionName(VulkanFunctionId id);
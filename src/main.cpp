@@ -3,6 +3,32 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include "ApiCallCounter.h"
+#include "BarrierBatch.h"
+#include "CompileDaemonClient.h"
+#include "CoreFeatures.h"
+#include "DeferredShading.h"
+#include "DeviceCapabilities.h"
+#include "DynamicRendering.h"
+#include "ExtendedDynamicState.h"
+#include "FrameBottleneck.h"
+#include "FrameStatistics.h"
+#include "Hash.h"
+#include "PipelineFeedback.h"
+#include "OverdrawStatistics.h"
+#include "PipelineLibrary.h"
+#include "PipelineStateCache.h"
+#include "PipelineStatistics.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "ShaderCompiler.h"
+#include "ShaderObject.h"
+#include "ShaderOptimizer.h"
+#include "ShaderReflection.h"
+#include "ShaderStage.h"
+#include "StartupTimeline.h"
+#include "VulkanDispatch.h"
+
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
@@ -14,13 +40,21 @@
 #include <limits>
 #include <optional>
 #include <set>
+#include <map>
+#include <future>
+#include <memory>
 #include <array>
 
 #include <unordered_set>
 #include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <numeric>
 
 const static int Width = 800;
 const static int Height = 640;
+const static std::string ShaderDir = R"(E:\VsWorkSpace\VulkanTutorial\shaders\)";
+const static std::string ShaderCacheDir = "shader_cache";
 std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
@@ -30,23 +64,67 @@ bool enableValidationLayers = true;
 bool enableValidationLayers = false;
 #endif
 
+// 运行时用 shaderc 编译 shaders/ 下的 GLSL，关掉则读 compile.bat 预编译的 .spv
+bool enableRuntimeShaderCompile = true;
+// 本机有编译守护进程时，着色器编译和 VkPipelineCache 数据走守护进程，多个进程共享
+bool enableCompileDaemon = true;
+// SPIR-V 用 spirv-tools 优化之后再建 module；release 下顺便去掉调试信息
+bool enableShaderOptimizer = true;
+#ifdef DEBUG
+bool stripShaderDebugInfo = false;
+#else
+bool stripShaderDebugInfo = true;
+#endif
+// specialization constant 在优化时就折叠进 SPIR-V，每个 permutation 一份模块
+bool foldShaderSpecConstants = false;
+
+// 设备支持 VK_EXT_extended_dynamic_state 1/2/3 时，把对应状态改成 dynamic，减少 pipeline 数量
+bool enableExtendedDynamicState = true;
+// 设备支持 VK_EXT_graphics_pipeline_library 时，pipeline 由缓存的 library 快速 link，后台再做优化
+bool enableGraphicsPipelineLibrary = true;
+// 启动时额外做一次不走 cache 的完整编译，和快速 link 的耗时对比；启动参数 --benchmark-monolithic 打开
+bool benchmarkMonolithicPipeline = false;
+// 用 VK_EXT_shader_object 代替 pipeline 绘制，启动参数 --shader-object 打开
+bool enableShaderObject = false;
+// 细分，启动参数 --tessellation 打开：shader object 路径绑定 tesc/tese，pipeline 路径换成按 TessellationPermutation 建的细分 pipeline。
+// shader object 路径还可以用 --geometry-shader 加上几何着色器，和细分不能同时用。F5 切换（shader object 路径轮换阶段组合）
+bool enableTessellation = false;
+bool enableGeometryShader = false;
+// 用 VK_KHR_dynamic_rendering 代替 VkRenderPass / VkFramebuffer，启动参数 --dynamic-rendering 打开；shader object 路径总是用它
+bool enableDynamicRendering = false;
+// 设备支持 VK_EXT_pipeline_creation_feedback 时记录每个 pipeline 的编译耗时和 cache 命中，F1 随时打印
+bool enablePipelineFeedback = true;
+// 先用只输出深度的 pipeline 画一遍，主 pass 用 EQUAL 测试，每个像素只着色一次；F2 切换
+bool enableDepthPrePass = false;
+// MSAA 采样数，会被限制到设备 framebuffer 支持的最大值，1 表示关闭
+uint32_t msaaSampleCount = 4;
+// G-buffer + 光照两个 subpass 的 deferred shading，启动参数 --deferred 打开，只支持 render pass 路径，不做 MSAA；
+// --deferred-multipass 换成等价的两个 render pass 做对比
+bool enableDeferredShading = false;
+bool deferredMultiPass = false;
+// 不透明物体按深度从近到远排序再画，尽量让 early depth test 剔掉被挡住的片元；F3 切换
+bool sortOpaqueFrontToBack = true;
+// CPU 作用域计时，启动参数 --profile 从启动就开始记录；F4 随时开始 / 停止，停止时写出 trace.json（Perfetto 可以直接打开）。
+// 编译时没定义 ENABLE_PROFILER 则全部计时点都不存在
+bool enableProfiler = false;
+const char* ProfileTracePath = "trace.json";
+// 帧时间分位数每 5 秒追加到 CSV、最新快照写成 JSON；present 间隔超过最近 1000 帧中位数 2 倍记为卡顿
+const char* FrameStatsCsvPath = "frame_stats.csv";
+const char* FrameStatsJsonPath = "frame_stats.json";
+// 统计每帧每个 Vulkan 函数的调用次数，启动参数 --count-api-calls 打开，退出时打印并写出 api_calls.json 给 CI 对比
+bool countApiCalls = false;
+const char* ApiCallCountsPath = "api_calls.json";
+// 启动参数 --check-profile 时对照 VP_KHR_roadmap_2022 检查选中的设备，只打印结果
+bool checkVulkanProfile = false;
+// 启动时 pipeline 创建、command pool / 同步对象和交换链三路并行，启动参数 --serial-startup 关掉用来对比 time-to-first-present
+bool parallelStartup = true;
+
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
 std::vector<const char*>deviceExtents = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
-struct QueueFamilyIndices
-{
-    std::optional<uint32_t> graphicsFamily;
-    std::optional<uint32_t> presentFamily;
-
-    bool IsComplete()
-    {
-        return graphicsFamily.has_value() && presentFamily.has_value();
-    }
-};
-
 struct SwapChainSupportDetails
 {
     VkSurfaceCapabilitiesKHR capabilities;
@@ -79,12 +157,80 @@ struct Vertex {
     }
 };
 
+// shaders/ 里 specialization constant 的 constant_id，和 GLSL 保持一致
+enum SpecializationConstant : uint32_t
+{
+    SpecTessInnerLevel = 0,
+    SpecTessOuterLevel0 = 1,
+    SpecTessOuterLevel1 = 2,
+    SpecTessOuterLevel2 = 3,
+    SpecTeseUsePalette = 10,
+    SpecTeseColorR = 11,
+    SpecTeseColorG = 12,
+    SpecTeseColorB = 13,
+};
+
+// 细分阶段的一个 permutation。以前换细分等级或颜色要改 GLSL，现在只换常量，SPIR-V 还是同一份
+struct TessellationPermutation
+{
+    float innerLevel = 3.0f;
+    float outerLevels[3] = { 3.0f, 4.0f, 5.0f };
+    bool usePalette = false;
+    glm::vec3 color = { 1.0f, 0.0f, 0.0f };
+
+    void apply(ShaderStage& tesc, ShaderStage& tese) const
+    {
+        tesc.specialize(SpecTessInnerLevel, innerLevel)
+            .specialize(SpecTessOuterLevel0, outerLevels[0])
+            .specialize(SpecTessOuterLevel1, outerLevels[1])
+            .specialize(SpecTessOuterLevel2, outerLevels[2]);
+        tese.specialize(SpecTeseUsePalette, usePalette ? VK_TRUE : VK_FALSE)
+            .specialize(SpecTeseColorR, color.x)
+            .specialize(SpecTeseColorG, color.y)
+            .specialize(SpecTeseColorB, color.z);
+    }
+};
+
 const std::vector<Vertex> vertices = {
     {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
     {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
     {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
 };
 
+// 和 shader.vert / depth_prepass.vert 里的 push constant 布局一致
+struct DrawConstants
+{
+    glm::vec2 offset;
+    float scale;
+    float depth;
+};
+
+// 一堆互相遮挡的三角形，提交顺序是从远到近，不排序时 overdraw 最严重
+std::vector<DrawConstants> makeSceneDraws()
+{
+    std::vector<DrawConstants> draws;
+    const uint32_t count = 16;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        float angle = 6.2831853f * i / count;
+        DrawConstants draw{};
+        draw.offset = { 0.15f * std::cos(angle), 0.15f * std::sin(angle) };
+        draw.scale = 1.6f;
+        draw.depth = 0.9f - 0.8f * i / count;
+        draws.push_back(draw);
+    }
+    return draws;
+}
+
+// 只在一帧之内使用的 attachment（多重采样颜色、深度），内容不保存
+struct AttachmentImage
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    bool lazilyAllocated = false;
+};
 
 class VulkanApp
 {
@@ -98,28 +244,61 @@ private:
     void cleanUp();
     void pickPhysicalDevice();
     void createLogicalDevice();
-    bool isPhysicalDeviceSuitable(VkPhysicalDevice device);
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice);
-    bool checkPhysicalDeviceExtents(VkPhysicalDevice physicalDevice);
+    bool isPhysicalDeviceSuitable();
+    bool checkPhysicalDeviceExtents();
     void createSwapChain();
     void createImageViews();
+    VkSampleCountFlagBits getMaxUsableSampleCount(uint32_t requested);
+    uint32_t findTransientMemoryType(uint32_t typeFilter, bool& lazilyAllocated);
+    void createAttachmentImage(VkFormat format, VkSampleCountFlagBits samples, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+        AttachmentImage& attachment);
+    void destroyAttachmentImage(AttachmentImage& attachment);
+    void createColorResources();
+    void createDepthResources();
+    void createFrameGraph();
+    void printAttachmentMemoryReport();
+    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+    VkFormat findDepthFormat();
+    VkImageAspectFlags depthAspectMask() const;
     void createRenderPass();
-    void createGraphicsPipeline();
+    // colorFormat 由调用者传进来：启动时 pipeline 线程和主线程上的 createSwapChain 同时跑，不读成员
+    void createGraphicsPipeline(VkFormat colorFormat);
+    void createDepthPrePassPipelines();
+    void createTessellationPipeline();
+    // shader object 路径和细分 pipeline 都没有对应的 position-only 组合，不做 pre-pass
+    bool depthPrePassActive() const { return depthPrePass && !shaderObjectBackend.enabled() && !tessellate; }
+    VkPipeline getOrCreatePipeline(const PipelineStateKey& key, const std::vector<ShaderStage>& stages, const std::string& name);
+    void createPipelineCache();
+    void savePipelineCache();
     void createFramebuffers();
     void createCommandPool();
     void createCommandBuffers();
     void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    // depthPrepared：深度已经由 frame graph 里单独的 pre-pass 画好
+    void recordScene(VkCommandBuffer commandBuffer, bool depthPrepared = false);
+    void recordDepthPrePass(VkCommandBuffer commandBuffer);
+    void sortDrawOrder();
+    void setViewportAndScissor(VkCommandBuffer commandBuffer);
+    void bindPipelineState(VkCommandBuffer commandBuffer, const PipelineStateKey& state, const PipelineStateKey& key);
+    void drawScene(VkCommandBuffer commandBuffer);
     void createSyncObjects();
     void recreateSwapChain();
+    void selectFormats();
+    void runStartupBenchmarks();
+    void checkRenderGraphAliasing();
+    void benchmarkDispatch(uint32_t drawCount, uint32_t rounds);
     void cleanupSwapChain();
     void drawFrame();
     void createVertexBuffer();
     uint32_t findMemoryType(uint32_t, VkMemoryPropertyFlags);
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice physicalDevice);
+    SwapChainSupportDetails querySwapChainSupport();
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(SwapChainSupportDetails);
     VkExtent2D chooseSwapExtent(SwapChainSupportDetails);
     VkPresentModeKHR chooseSwapPresentMode(SwapChainSupportDetails);
-    VkShaderModule createShaderModule(std::vector<char>& shaderByte);
+    VkShaderModule createShaderModule(const std::vector<char>& shaderByte);
+    void requestShader(const std::string& source);
+    ShaderStage loadShader(const std::string& source);
+    ShaderStage optimizeShader(const ShaderStage& stage, const std::string& source);
 
 
     std::vector<const char*> getRequiredExtensions();
@@ -167,10 +346,61 @@ private:
         app->framebufferResized = true;
     }
 
+    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+        auto app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
+        if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+        {
+            app->pipelineFeedback.printReport();
+        }
+        else if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+        {
+            app->depthPrePass = !app->depthPrePass;
+            // 启动时没开 pre-pass 就没建它的 pipeline，第一次打开时再建
+            if (app->depthPrePass && app->depthPrePassKey.hash == 0)
+            {
+                app->createDepthPrePassPipelines();
+            }
+        }
+        else if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
+        {
+            app->sortDraws = !app->sortDraws;
+        }
+        else if (key == GLFW_KEY_F4 && action == GLFW_PRESS)
+        {
+            bool capture = !Profiler::enabled();
+            Profiler::setEnabled(capture);
+            std::cout << "profiler: capture " << (capture ? "started" : "stopped") << std::endl;
+            if (!capture)
+            {
+                Profiler::exportChromeTrace(ProfileTracePath);
+            }
+        }
+        else if (key == GLFW_KEY_F5 && action == GLFW_PRESS && app->shaderObjectBackend.enabled())
+        {
+            app->shaderObjectBackend.cycleStageCombination();
+            std::cout << "shader object: " << ShaderObjectBackend::stageCombinationName(app->shaderObjectBackend.stageCombination()) << std::endl;
+        }
+        else if (key == GLFW_KEY_F5 && action == GLFW_PRESS && app->capabilities.features.tessellationShader)
+        {
+            app->tessellate = !app->tessellate;
+            if (app->tessellate && app->tessellationKey.hash == 0)
+            {
+                app->createTessellationPipeline();
+            }
+            std::cout << "tessellation: " << (app->tessellate ? "on" : "off") << std::endl;
+        }
+    }
+
     VkInstance instance;
     GLFWwindow* window;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+    // 选中设备的属性、特性、队列族、表面格式等，只查一次
+    DeviceCapabilities capabilities;
+    CoreFeatures coreFeatures;
+    // 录制线程上的 barrier 都经过这里，有 synchronization2 时用 vkCmdPipelineBarrier2
+    BarrierBatch barrierBatch;
     VkDevice device;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
@@ -178,11 +408,70 @@ private:
     VkSwapchainKHR swapChain;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
-    VkFormat swapChainImageFormat;
+    VkFormat swapChainImageFormat = VK_FORMAT_UNDEFINED;
     VkExtent2D swapChainExtent;
-    VkPipelineLayout pipelineLayout;
-    VkRenderPass renderPass;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    AttachmentImage msaaColorTarget;
+    AttachmentImage depthTarget;
+    // dynamic rendering 路径的一帧；多重采样颜色和深度由它创建
+    RenderGraph frameGraph;
+    RenderGraphResource frameColor = RenderGraphNoResource;
+    RenderGraphResource frameMsaaColor = RenderGraphNoResource;
+    RenderGraphResource frameDepth = RenderGraphNoResource;
+    RenderGraphPass framePrePass = 0;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    // dynamic rendering 路径下不创建，保持为空
+    VkRenderPass renderPass = VK_NULL_HANDLE;
     VkPipeline graphicsPipeline;
+    PipelineStateCache pipelineStateCache;
+    PipelineLayoutCache pipelineLayoutCache;
+    ExtendedDynamicState extendedDynamicState;
+    GraphicsPipelineLibrary graphicsPipelineLibrary;
+    PipelineFeedback pipelineFeedback;
+    ShaderObjectBackend shaderObjectBackend;
+    DynamicRendering dynamicRendering;
+    ShaderOptimizer shaderOptimizer;
+    std::unique_ptr<CompileDaemonClient> compileDaemon;
+    std::unique_ptr<ShaderCompiler> shaderCompiler;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    // 守护进程里按设备和驱动区分 pipeline cache 数据
+    uint64_t pipelineCacheKey = 0;
+    // 源文件名 -> 正在编译（或已经读好）的阶段
+    std::map<std::string, std::future<ShaderStage>> pendingShaders;
+    TessellationPermutation tessellationPermutation;
+    // 绘制时想要的完整状态，以及实际用来创建 pipeline 的（可能折叠过 dynamic state 的）key
+    PipelineStateKey graphicsPipelineState;
+    PipelineStateKey graphicsPipelineKey;
+    std::vector<ShaderStage> sceneShaderStages;
+    // depth pre-pass 用的两组：只写深度的 pre-pass，以及之后 EQUAL 测试、不写深度的主 pass
+    PipelineStateKey depthPrePassState;
+    PipelineStateKey depthPrePassKey;
+    PipelineStateKey depthEqualState;
+    PipelineStateKey depthEqualKey;
+    bool depthPrePass = enableDepthPrePass;
+    // pipeline 路径上的细分 pipeline，同一个 permutation 只建一次
+    PipelineStateKey tessellationState;
+    PipelineStateKey tessellationKey;
+    bool tessellate = enableTessellation;
+    bool sortDraws = sortOpaqueFrontToBack;
+    std::vector<DrawConstants> sceneDraws = makeSceneDraws();
+    std::vector<uint32_t> drawOrder;
+    PipelineStatistics pipelineStatistics;
+    OverdrawStatistics overdrawStatistics;
+    FrameStatistics frameStatistics;
+    FrameBottleneck frameBottleneck;
+    // 录制 push constant + draw 时每次调用的开销：loader trampoline 对比 vkGetDeviceProcAddr 取到的入口
+    double trampolineCallNs = 0.0;
+    double deviceTableCallNs = 0.0;
+    StartupTimeline startup;
+    // deferred 打开时几何画进 G-buffer，再用全屏三角形做光照
+    bool deferred = false;
+    DeferredShading deferredShading;
+    PipelineStateKey lightingPipelineState;
+    PipelineStateKey lightingPipelineKey;
+    VkPipelineLayout lightingPipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout lightingSetLayout = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> swapChainFramebuffers;
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
@@ -214,12 +503,19 @@ void VulkanApp::initWindows()
     window = glfwCreateWindow(Width, Height, "Vulkan Tutorial", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    glfwSetKeyCallback(window, keyCallback);
 
 }
 
 void VulkanApp::run()
 {
-    initWindows();
+    PROFILE_THREAD("main");
+    Profiler::setEnabled(enableProfiler);
+    ApiCallCounter::setEnabled(countApiCalls);
+    frameStatistics.csvPath = FrameStatsCsvPath;
+    frameStatistics.jsonPath = FrameStatsJsonPath;
+    startup.begin();
+    startup.step("initWindows", [&] { initWindows(); });
     initVulkan();
     mainLoop();
     cleanUp();
@@ -229,46 +525,402 @@ void VulkanApp::run()
 
 void VulkanApp::initVulkan()
 {
-    createInstance();
-    createSurface();
-    setupDebugMessenger();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
-    createFramebuffers();
-    createCommandPool();
-    createCommandBuffers();
-    createSyncObjects();
-    createVertexBuffer();
+    PROFILE_ZONE("initVulkan");
+    // 着色器编译和 instance/device 创建并行
+    startup.step("requestShaders", [&] {
+        if (enableCompileDaemon)
+        {
+            compileDaemon = std::make_unique<CompileDaemonClient>();
+            compileDaemon->probe();
+        }
+        if (enableRuntimeShaderCompile)
+        {
+            shaderCompiler = std::make_unique<ShaderCompiler>(ShaderDir, ShaderCacheDir);
+            shaderCompiler->generateDebugInfo = !stripShaderDebugInfo;
+            shaderCompiler->daemon = compileDaemon.get();
+        }
+        requestShader("shader.vert");
+        requestShader("shader.frag");
+        if (enableDepthPrePass)
+        {
+            requestShader("depth_prepass.vert");
+        }
+        if (enableDeferredShading)
+        {
+            requestShader("gbuffer.frag");
+            requestShader("lighting.vert");
+            requestShader("lighting.frag");
+        }
+        if (enableShaderObject)
+        {
+            requestShader("shader.tesc");
+            requestShader("shader.tese");
+            requestShader("shader.geom");
+        }
+    });
+
+    startup.step("createInstance", [&] { createInstance(); });
+    startup.step("createSurface", [&] { createSurface(); });
+    startup.step("setupDebugMessenger", [&] { setupDebugMessenger(); });
+    startup.step("pickPhysicalDevice", [&] { pickPhysicalDevice(); });
+    startup.step("createLogicalDevice", [&] { createLogicalDevice(); });
+    // 交换链格式和深度格式先定下来，render pass 和 pipeline 不用等交换链创建完
+    startup.step("selectFormats", [&] { selectFormats(); });
+    startup.step("createRenderPass", [&] { createRenderPass(); });
+
+    // 之后分三路：pipeline（等着色器编译）、command pool / 同步对象 / 顶点缓冲、主线程上的交换链和 attachment。
+    // 三路互相不碰对方的成员，只在用到结果之前 join
+    // --serial-startup 时 deferred，在 get() 的地方按原来的顺序在主线程上执行
+    auto launch = [&](const char* threadName, std::function<void()> work) {
+        if (!parallelStartup)
+        {
+            return std::async(std::launch::deferred, std::move(work));
+        }
+        return std::async(std::launch::async, [threadName, work] {
+            PROFILE_THREAD(threadName);
+            work();
+        });
+    };
+    // 交换链格式在启动时按值带进去，createSwapChain 写成员不影响 pipeline 线程
+    std::future<void> pipelines = launch("startup pipelines", [&, colorFormat = swapChainImageFormat] {
+        startup.step("createPipelineCache", [&] { createPipelineCache(); });
+        startup.step("createGraphicsPipeline", [&] { createGraphicsPipeline(colorFormat); });
+    });
+    std::future<void> frameResources = launch("startup resources", [&] {
+        startup.step("createCommandPool", [&] { createCommandPool(); });
+        startup.step("createCommandBuffers", [&] { createCommandBuffers(); });
+        startup.step("createSyncObjects", [&] { createSyncObjects(); });
+        startup.step("createVertexBuffer", [&] { createVertexBuffer(); });
+    });
+    startup.step("createSwapChain", [&] { createSwapChain(); });
+    startup.step("createImageViews", [&] { createImageViews(); });
+    startup.step("createColorResources", [&] { createColorResources(); });
+    startup.step("createDepthResources", [&] { createDepthResources(); });
+
+    // deferred 的 framebuffer 要用 lighting pipeline 反射出来的 set layout
+    pipelines.get();
+    startup.step("createFramebuffers", [&] { createFramebuffers(); });
+    frameResources.get();
+    startup.step("createFrameGraph", [&] { createFrameGraph(); });
+    // 每个 frame in flight 一个 pool，轮到时那一帧的 fence 已经等过，读回不会阻塞
+    startup.step("createQueries", [&] {
+        pipelineStatistics.create(device, MAX_FRAMES_IN_FLIGHT);
+        frameBottleneck.createQueries(capabilities, device, MAX_FRAMES_IN_FLIGHT);
+        if (deferred)
+        {
+            deferredShading.createQueries(capabilities, device, MAX_FRAMES_IN_FLIGHT);
+        }
+    });
+}
+
+void VulkanApp::runStartupBenchmarks()
+{
+    if (shaderObjectBackend.enabled())
+    {
+        // 比较两条路径每次绘制前绑定 + 设置状态的 CPU 开销
+        shaderObjectBackend.benchmarkBinds(device, commandPool, [&](VkCommandBuffer commandBuffer) {
+            vkd.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+            extendedDynamicState.cmdSetState(commandBuffer, graphicsPipelineState, graphicsPipelineKey);
+        }, graphicsPipelineState, swapChainExtent, 1000);
+    }
+    // 不管当前走哪条路径，都比较一次 framebuffer 重建和 begin/end 的开销
+    // benchmark 的 barrier 不算进每帧的统计
+    BarrierBatch benchmarkBarriers;
+    benchmarkBarriers.load(coreFeatures.flags());
+    dynamicRendering.benchmark(device, commandPool, benchmarkBarriers, swapChainImageFormat, swapChainImages[0], swapChainImageViews[0],
+        swapChainExtent, static_cast<uint32_t>(swapChainImages.size()), 1000);
+    // 只有 render pass 路径上能直接拿主 pipeline 画
+    if (!dynamicRendering.enabled() && !deferred)
+    {
+        benchmarkDispatch(10000, 5);
+    }
+    checkRenderGraphAliasing();
+}
+
+void VulkanApp::checkRenderGraphAliasing()
+{
+    // 每帧的 graph 里 transient image 的生命周期都重叠，用不上别名，这里单独搭一个会别名的检查一遍：
+    // a 在 pass 0-1，b 在 pass 1-3，c 在 pass 2-3，a 和 c 放进同一块内存。
+    // pass 2 清 c 之前必须等 pass 1 从 a 拷贝完，否则读回来的 b 是 c 的颜色
+    const VkExtent2D extent{ 16, 16 };
+    const VkDeviceSize imageBytes = VkDeviceSize(extent.width) * extent.height * 4;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = imageBytes * 2;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer readback;
+    if (vkd.vkCreateBuffer(device, &bufferInfo, nullptr, &readback) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create readback buffer!");
+    }
+    VkMemoryRequirements memRequirements;
+    vkd.vkGetBufferMemoryRequirements(device, readback, &memRequirements);
+    VkMemoryAllocateInfo memoryInfo{};
+    memoryInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryInfo.allocationSize = memRequirements.size;
+    memoryInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VkDeviceMemory readbackMemory;
+    if (vkd.vkAllocateMemory(device, &memoryInfo, nullptr, &readbackMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate readback buffer memory!");
+    }
+    vkd.vkBindBufferMemory(device, readback, readbackMemory, 0);
+
+    RenderGraph graph;
+    RenderGraphImageDesc desc;
+    desc.format = VK_FORMAT_R8G8B8A8_UNORM;
+    desc.extent = extent;
+    // SAMPLED 只是为了 allocate 能给它建 image view
+    desc.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    RenderGraphResource a = graph.createImage("alias check a", desc);
+    RenderGraphResource b = graph.createImage("alias check b", desc);
+    RenderGraphResource c = graph.createImage("alias check c", desc);
+    RenderGraphResource output = graph.importBuffer("alias check readback", readback);
+
+    const VkImageSubresourceRange range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    const VkImageSubresourceLayers layers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    const VkClearColorValue red = { {1.0f, 0.0f, 0.0f, 1.0f} };
+    const VkClearColorValue blue = { {0.0f, 0.0f, 1.0f, 1.0f} };
+    RenderGraphPass clearA = graph.addPass("clear a", [&](VkCommandBuffer commandBuffer) {
+        vkd.vkCmdClearColorImage(commandBuffer, graph.image(a), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &red, 1, &range);
+    });
+    graph.write(clearA, a, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    RenderGraphPass copyAB = graph.addPass("copy a to b", [&](VkCommandBuffer commandBuffer) {
+        VkImageCopy region{};
+        region.srcSubresource = layers;
+        region.dstSubresource = layers;
+        region.extent = { extent.width, extent.height, 1 };
+        vkd.vkCmdCopyImage(commandBuffer, graph.image(a), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, graph.image(b),
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    });
+    graph.read(copyAB, a, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    graph.write(copyAB, b, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    RenderGraphPass clearC = graph.addPass("clear c", [&](VkCommandBuffer commandBuffer) {
+        vkd.vkCmdClearColorImage(commandBuffer, graph.image(c), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &blue, 1, &range);
+    });
+    graph.write(clearC, c, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    RenderGraphPass readBack = graph.addPass("read back", [&](VkCommandBuffer commandBuffer) {
+        VkBufferImageCopy region{};
+        region.imageSubresource = layers;
+        region.imageExtent = { extent.width, extent.height, 1 };
+        vkd.vkCmdCopyImageToBuffer(commandBuffer, graph.image(b), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback, 1, &region);
+        region.bufferOffset = imageBytes;
+        vkd.vkCmdCopyImageToBuffer(commandBuffer, graph.image(c), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback, 1, &region);
+    });
+    graph.read(readBack, b, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    graph.read(readBack, c, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    graph.write(readBack, output, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    graph.allocate(capabilities, device);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (vkd.vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkd.vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    BarrierBatch checkBarriers;
+    checkBarriers.load(coreFeatures.flags());
+    graph.execute(commandBuffer, checkBarriers);
+    // 主机读之前的可见性 graph 不管
+    checkBarriers.memoryBarrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
+        VK_ACCESS_2_HOST_READ_BIT);
+    checkBarriers.flush(commandBuffer);
+    vkd.vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if (vkd.vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit render graph aliasing check!");
+    }
+    vkd.vkQueueWaitIdle(graphicsQueue);
+
+    void* data;
+    vkd.vkMapMemory(device, readbackMemory, 0, bufferInfo.size, 0, &data);
+    const uint8_t* pixels = static_cast<const uint8_t*>(data);
+    uint32_t wrong = 0;
+    for (VkDeviceSize i = 0; i < imageBytes; i += 4)
+    {
+        bool bIsRed = pixels[i] == 255 && pixels[i + 1] == 0 && pixels[i + 2] == 0;
+        bool cIsBlue = pixels[imageBytes + i] == 0 && pixels[imageBytes + i + 1] == 0 && pixels[imageBytes + i + 2] == 255;
+        wrong += (bIsRed && cIsBlue) ? 0 : 1;
+    }
+    vkd.vkUnmapMemory(device, readbackMemory);
+
+    bool aliased = graph.aliased(a, c);
+    if (wrong != 0)
+    {
+        std::cerr << "render graph aliasing check: " << wrong << " of " << imageBytes / 4 << " pixels wrong"
+            << (aliased ? " (a and c share memory)" : "") << std::endl;
+    }
+    else
+    {
+        std::cout << "render graph aliasing check: passed, " << (aliased ? "a and c share memory" : "no aliasing (different memory types)")
+            << std::endl;
+    }
+
+    vkd.vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    graph.destroy(device);
+    vkd.vkDestroyBuffer(device, readback, nullptr);
+    vkd.vkFreeMemory(device, readbackMemory, nullptr);
+}
+
+void VulkanApp::benchmarkDispatch(uint32_t drawCount, uint32_t rounds)
+{
+    // 两张表都在这里单独建，和 vkd 当前是否装了计数包装函数无关
+    VulkanDispatch trampolines;
+    VulkanDispatch deviceTable;
+    deviceTable.load(device);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (vkd.vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    clearValues[1].depthStencil = { 1.0f, 0 };
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[0];
+    renderPassInfo.renderArea = { { 0, 0 }, swapChainExtent };
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+    VkViewport viewport{ 0.0f, 0.0f, (float)swapChainExtent.width, (float)swapChainExtent.height, 0.0f, 1.0f };
+    VkRect2D scissor{ { 0, 0 }, swapChainExtent };
+    VkBuffer vertexBuffers[] = { vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+    // 只计时 draw 循环；command buffer 不提交
+    auto record = [&](const VulkanDispatch& table) {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        table.vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        table.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        table.vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        table.vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        table.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        extendedDynamicState.cmdSetState(commandBuffer, graphicsPipelineState, graphicsPipelineKey);
+        table.vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            const DrawConstants& draw = sceneDraws[i % sceneDraws.size()];
+            table.vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &draw);
+            table.vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        table.vkCmdEndRenderPass(commandBuffer);
+        table.vkEndCommandBuffer(commandBuffer);
+        table.vkResetCommandBuffer(commandBuffer, 0);
+        return std::chrono::duration<double, std::nano>(end - start).count() / (2.0 * drawCount);
+    };
+
+    // 两种交替跑，各取最快的一轮，减少驱动内部分配和缓存冷热的影响
+    trampolineCallNs = std::numeric_limits<double>::max();
+    deviceTableCallNs = std::numeric_limits<double>::max();
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        trampolineCallNs = std::min(trampolineCallNs, record(trampolines));
+        deviceTableCallNs = std::min(deviceTableCallNs, record(deviceTable));
+    }
+    vkd.vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
 void VulkanApp::mainLoop()
 {
+    bool benchmarksDone = false;
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        PROFILE_ZONE("frame");
+        {
+            PROFILE_ZONE("glfwPollEvents");
+            glfwPollEvents();
+        }
         drawFrame();
+        // 这些对比测试不影响画面，放到第一帧出来之后，不拖慢 time-to-first-present
+        if (!benchmarksDone && startup.firstPresentDone())
+        {
+            startup.step("benchmarks", [&] { runStartupBenchmarks(); });
+            benchmarksDone = true;
+        }
     }
-    vkDeviceWaitIdle(device);
+    vkd.vkDeviceWaitIdle(device);
 }
 
 void VulkanApp::cleanUp()
 {
+    if (Profiler::enabled())
+    {
+        Profiler::setEnabled(false);
+        Profiler::exportChromeTrace(ProfileTracePath);
+    }
+    extendedDynamicState.printPermutationReport();
+    graphicsPipelineLibrary.printReport();
+    pipelineFeedback.printReport();
+    shaderObjectBackend.printReport();
+    dynamicRendering.printReport();
+    frameGraph.printReport();
+    barrierBatch.printReport();
+    pipelineStatistics.printReport();
+    overdrawStatistics.printReport();
+    frameStatistics.printReport();
+    frameBottleneck.printReport();
+    if (deviceTableCallNs > 0.0)
+    {
+        std::cout << "device dispatch: " << deviceTableCallNs << " ns per recorded call, loader trampoline "
+            << trampolineCallNs << " ns (" << trampolineCallNs - deviceTableCallNs << " ns saved)" << std::endl;
+    }
+    ApiCallCounter::printReport();
+    if (ApiCallCounter::enabled())
+    {
+        ApiCallCounter::exportJson(ApiCallCountsPath);
+    }
+    deferredShading.printReport(device);
+    printAttachmentMemoryReport();
+    pipelineLayoutCache.printReport();
+    shaderOptimizer.printReport();
+    if (shaderCompiler)
+    {
+        shaderCompiler->printReport();
+    }
     cleanupSwapChain();
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    vkd.vkDestroyBuffer(device, vertexBuffer, nullptr);
+    vkd.vkFreeMemory(device, vertexBufferMemory, nullptr);
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
-    }
-    vkDestroyCommandPool(device, commandPool, nullptr);
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
+        vkd.vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+        vkd.vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+        vkd.vkDestroyFence(device, inFlightFences[i], nullptr);
+    }
+    vkd.vkDestroyCommandPool(device, commandPool, nullptr);
+    pipelineStatistics.destroy(device);
+    frameBottleneck.destroy(device);
+    deferredShading.destroy(device);
+    graphicsPipelineLibrary.destroy(device);
+    shaderObjectBackend.destroy(device);
+    pipelineStateCache.destroy(device);
+    savePipelineCache();
+    vkd.vkDestroyPipelineCache(device, pipelineCache, nullptr);
+    pipelineLayoutCache.destroy(device);
+    vkd.vkDestroyRenderPass(device, renderPass, nullptr);
     
     vkDestroyDevice(device, nullptr);
     if (enableValidationLayers)
@@ -290,7 +942,9 @@ void VulkanApp::createInstance()
     appInfo.applicationVersion = 1;
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = 1;
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 按 loader 支持的最高版本（不超过 1.3）创建，device 的有效版本再和它取小
+    instanceApiVersion = CoreFeatures::instanceApiVersion();
+    appInfo.apiVersion = instanceApiVersion;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -370,9 +1024,11 @@ void VulkanApp::pickPhysicalDevice()
     std::vector<VkPhysicalDevice> physicalDeviceList(count);
     vkEnumeratePhysicalDevices(instance, &count, physicalDeviceList.data());
 
+    // 每个候选设备查一次快照，选中的那份留下来给后面所有地方用
     for (auto& device : physicalDeviceList)
     {
-        if (isPhysicalDeviceSuitable(device))
+        capabilities.gather(device, surface, instanceApiVersion);
+        if (isPhysicalDeviceSuitable())
         {
             physicalDevice = device;
             break;
@@ -382,13 +1038,48 @@ void VulkanApp::pickPhysicalDevice()
     if (physicalDevice == VK_NULL_HANDLE) {
         throw std::runtime_error("failed to find a suitable GPU!");
     }
+    // 其他模块按这里协商的结果决定走核心版本还是扩展
+    coreFeatures.query(capabilities);
+    if (checkVulkanProfile)
+    {
+        coreFeatures.checkProfile(instance, physicalDevice);
+    }
+    if (enableExtendedDynamicState)
+    {
+        extendedDynamicState.query(capabilities);
+    }
+    if (enableGraphicsPipelineLibrary)
+    {
+        graphicsPipelineLibrary.query(capabilities);
+    }
+    if (enableShaderObject)
+    {
+        shaderObjectBackend.query(capabilities);
+    }
+    if (enableDynamicRendering || shaderObjectBackend.enabled())
+    {
+        dynamicRendering.query(capabilities, coreFeatures.flags());
+    }
+    pipelineStatistics.query(capabilities);
+    // input attachment 的 subpass 只在 render pass 路径上有
+    deferred = enableDeferredShading && !dynamicRendering.enabled();
+    if (enableDeferredShading)
+    {
+        std::cout << "deferred shading: " << (deferred ? (deferredMultiPass ? "multi-pass" : "subpass") : "needs the render pass path") << std::endl;
+    }
+    // deferred 的 G-buffer 是单采样的
+    msaaSamples = getMaxUsableSampleCount(deferred ? 1 : msaaSampleCount);
+    if (enablePipelineFeedback)
+    {
+        pipelineFeedback.query(capabilities);
+        graphicsPipelineLibrary.setFeedback(&pipelineFeedback);
+    }
 }
 
 void VulkanApp::createLogicalDevice()
 {
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies{ indices.graphicsFamily.value(),indices.presentFamily.value() };
+    std::set<uint32_t> uniqueQueueFamilies{ capabilities.graphicsFamily.value(), capabilities.presentFamily.value() };
     float priorities = 1.0f;
     for (uint32_t queueFamilyIndex : uniqueQueueFamilies)
     {
@@ -420,16 +1111,38 @@ void VulkanApp::createLogicalDevice()
         deviceCreateInfo.enabledLayerCount = 0;
     }
 
-    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtents.size());
-    deviceCreateInfo.ppEnabledExtensionNames = deviceExtents.data();
+    std::vector<const char*> enabledExtents = deviceExtents;
+    extendedDynamicState.appendDeviceExtensions(enabledExtents);
+    graphicsPipelineLibrary.appendDeviceExtensions(enabledExtents);
+    shaderObjectBackend.appendDeviceExtensions(enabledExtents);
+    dynamicRendering.appendDeviceExtensions(enabledExtents);
+    pipelineFeedback.appendDeviceExtensions(enabledExtents);
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtents.size());
+    deviceCreateInfo.ppEnabledExtensionNames = enabledExtents.data();
+    deviceCreateInfo.pNext = coreFeatures.chainFeatures(dynamicRendering.chainFeatures(shaderObjectBackend.chainFeatures(
+        graphicsPipelineLibrary.chainFeatures(extendedDynamicState.chainFeatures(nullptr)))));
     VkPhysicalDeviceFeatures deviceFeatures{};
+    shaderObjectBackend.enableCoreFeatures(deviceFeatures);
+    // 细分 pipeline 可以随时用 F5 打开，设备支持就开
+    deviceFeatures.tessellationShader = capabilities.features.tessellationShader;
+    pipelineStatistics.enableCoreFeatures(deviceFeatures);
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
     if (vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device) != VK_SUCCESS)
     {
         throw std::runtime_error("can't create device");
     }
-    vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    // 之后的 device 级调用不再经过 loader trampoline。计数的包装函数要转发到新的入口，先卸掉再装回去
+    bool countingCalls = ApiCallCounter::enabled();
+    ApiCallCounter::setEnabled(false);
+    vkd.load(device);
+    ApiCallCounter::setEnabled(countingCalls);
+    vkd.vkGetDeviceQueue(device, capabilities.graphicsFamily.value(), 0, &graphicsQueue);
+    vkd.vkGetDeviceQueue(device, capabilities.presentFamily.value(), 0, &presentQueue);
+    extendedDynamicState.load(device);
+    shaderObjectBackend.load(device);
+    dynamicRendering.load(device);
+    barrierBatch.load(coreFeatures.flags());
+    std::cout << "barriers: " << (barrierBatch.synchronization2() ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier (no synchronization2)") << std::endl;
 }
 
 std::vector<const char*> VulkanApp::getRequiredExtensions()
@@ -467,71 +1180,27 @@ std::vector<const char*> VulkanApp::getRequiredExtensions()
 
 
 
-bool VulkanApp::isPhysicalDeviceSuitable(VkPhysicalDevice device)
+bool VulkanApp::isPhysicalDeviceSuitable()
 {
     // 还可以检查是独显，核显；支持哪些特性等
-    //VkPhysicalDeviceProperties deviceProperties;
-    //VkPhysicalDeviceFeatures deviceFeatures;
-    //vkGetPhysicalDeviceProperties(device, &deviceProperties);
-    //vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-    //return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-    //    deviceFeatures.geometryShader;
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(device);
-    bool isExtentsSupport = checkPhysicalDeviceExtents(device);
-
-    bool swapChainAdequate = false;
-    SwapChainSupportDetails details = querySwapChainSupport(device);
-    swapChainAdequate = !details.formats.empty() && !details.presentModes.empty();
-    
-    return queueFamilyIndices.IsComplete() && isExtentsSupport && swapChainAdequate;
+    //return capabilities.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
+    //    capabilities.features.geometryShader;
+    bool queueFamiliesComplete = capabilities.graphicsFamily.has_value() && capabilities.presentFamily.has_value();
+    bool isExtentsSupport = checkPhysicalDeviceExtents();
+    bool swapChainAdequate = !capabilities.surfaceFormats.empty() && !capabilities.presentModes.empty();
+    return queueFamiliesComplete && isExtentsSupport && swapChainAdequate;
 }
 
-QueueFamilyIndices VulkanApp::findQueueFamilies(VkPhysicalDevice physicalDevice)
+bool VulkanApp::checkPhysicalDeviceExtents()
 {
-    QueueFamilyIndices indices;
-    uint32_t count;
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, nullptr);
-    std::vector<VkQueueFamilyProperties> queueFamily(count);
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, queueFamily.data());
-    int i = 0;
-    for (auto& qf : queueFamily)
+    for (const char* extent : deviceExtents)
     {
-        if (qf.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-        {
-            indices.graphicsFamily = i;
-        }
-        VkBool32 surfaceSupport = VK_FALSE;
-        if (vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &surfaceSupport) == VK_SUCCESS)
+        if (!capabilities.hasExtension(extent))
         {
-            indices.presentFamily = i;
+            return false;
         }
-        if (indices.IsComplete())
-        {
-            break;
-        }
-        i++;
     }
-    return indices;
-}
-
-bool VulkanApp::checkPhysicalDeviceExtents(VkPhysicalDevice physicalDevice)
-{
-    uint32_t count;
-    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
-    std::vector<VkExtensionProperties> availableExtents;
-    if (count > 0)
-    {
-        availableExtents.resize(count);
-        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, availableExtents.data());
-    }
-    std::set<std::string> requiredExtents(deviceExtents.begin(), deviceExtents.end());
-    for (auto extent : availableExtents)
-    {
-        requiredExtents.erase(extent.extensionName);
-    }
-    
-    return requiredExtents.empty();
+    return true;
 }
 
 
@@ -539,7 +1208,7 @@ bool VulkanApp::checkPhysicalDeviceExtents(VkPhysicalDevice physicalDevice)
 
 void VulkanApp::createSwapChain()
 {
-    SwapChainSupportDetails details = querySwapChainSupport(physicalDevice);
+    SwapChainSupportDetails details = querySwapChainSupport();
     VkSwapchainCreateInfoKHR createInfo{};
     VkSurfaceFormatKHR imageFormat = chooseSwapSurfaceFormat(details);
     VkExtent2D imageExtent = chooseSwapExtent(details);
@@ -558,9 +1227,8 @@ void VulkanApp::createSwapChain()
     createInfo.imageExtent = imageExtent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-    uint32_t indicesArray[] = { indices.graphicsFamily.value(),indices.presentFamily.value() };
-    if (indices.presentFamily != indices.graphicsFamily)
+    uint32_t indicesArray[] = { capabilities.graphicsFamily.value(), capabilities.presentFamily.value() };
+    if (capabilities.presentFamily != capabilities.graphicsFamily)
     {
         createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         createInfo.queueFamilyIndexCount = 2;
@@ -577,21 +1245,27 @@ void VulkanApp::createSwapChain()
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
     createInfo.oldSwapchain = VK_NULL_HANDLE;
-    if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
+    if (vkd.vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
     {
         throw std::runtime_error("create swap chain failed!");
     }
     uint32_t swapChainImageCount;
-    vkGetSwapchainImagesKHR(device, swapChain, &swapChainImageCount, nullptr);
+    vkd.vkGetSwapchainImagesKHR(device, swapChain, &swapChainImageCount, nullptr);
     swapChainImages.resize(swapChainImageCount);
     if (swapChainImageCount != 0)
     {
-        vkGetSwapchainImagesKHR(device, swapChain, &swapChainImageCount, swapChainImages.data());
+        vkd.vkGetSwapchainImagesKHR(device, swapChain, &swapChainImageCount, swapChainImages.data());
     }
     swapChainExtent = imageExtent;
     swapChainImageFormat = imageFormat.format;
 }
 
+void VulkanApp::selectFormats()
+{
+    swapChainImageFormat = chooseSwapSurfaceFormat(querySwapChainSupport()).format;
+    depthFormat = findDepthFormat();
+}
+
 void VulkanApp::createImageViews()
 {
     swapChainImageViews.resize(swapChainImages.size());
@@ -613,207 +1287,742 @@ void VulkanApp::createImageViews()
         createInfo.subresourceRange.layerCount = 1;
         createInfo.subresourceRange.baseMipLevel = 0;
         createInfo.subresourceRange.levelCount = 1;
-        if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS)
+        if (vkd.vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS)
         {
             throw std::runtime_error("create image view failed!");
         }
     }
 }
 
+VkFormat VulkanApp::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+{
+    for (VkFormat format : candidates)
+    {
+        VkFormatProperties properties = capabilities.formatProperties(format);
+        VkFormatFeatureFlags supported = tiling == VK_IMAGE_TILING_LINEAR ? properties.linearTilingFeatures : properties.optimalTilingFeatures;
+        if ((supported & features) == features)
+        {
+            return format;
+        }
+    }
+    throw std::runtime_error("failed to find supported format!");
+}
+
+VkFormat VulkanApp::findDepthFormat()
+{
+    // D32_SFLOAT 精度最好，不支持时退到带 stencil 的格式
+    return findSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT },
+        VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
+VkImageAspectFlags VulkanApp::depthAspectMask() const
+{
+    // 带 stencil 的格式做布局转换时两个 aspect 都要带上
+    if (depthFormat == VK_FORMAT_D24_UNORM_S8_UINT || depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT)
+    {
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+VkSampleCountFlagBits VulkanApp::getMaxUsableSampleCount(uint32_t requested)
+{
+    VkSampleCountFlags counts = capabilities.limits().framebufferColorSampleCounts & capabilities.limits().framebufferDepthSampleCounts;
+    for (uint32_t samples = VK_SAMPLE_COUNT_64_BIT; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1)
+    {
+        if (samples <= requested && (counts & samples))
+        {
+            std::cout << "msaa: " << samples << " samples" << (samples < requested ? " (clamped)" : "") << std::endl;
+            return static_cast<VkSampleCountFlagBits>(samples);
+        }
+    }
+    std::cout << "msaa: off" << std::endl;
+    return VK_SAMPLE_COUNT_1_BIT;
+}
+
+uint32_t VulkanApp::findTransientMemoryType(uint32_t typeFilter, bool& lazilyAllocated)
+{
+    // tiler 上 LAZILY_ALLOCATED 的 transient attachment 只存在于片上内存，不占显存
+    uint32_t memoryType = capabilities.findMemoryType(typeFilter, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    lazilyAllocated = memoryType != ~0u;
+    if (lazilyAllocated)
+    {
+        return memoryType;
+    }
+    return findMemoryType(typeFilter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void VulkanApp::createAttachmentImage(VkFormat format, VkSampleCountFlagBits samples, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+    AttachmentImage& attachment)
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // 内容从不保存，标成 transient 才能放进 lazily allocated 内存
+    imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.samples = samples;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkd.vkCreateImage(device, &imageInfo, nullptr, &attachment.image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create attachment image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkd.vkGetImageMemoryRequirements(device, attachment.image, &memRequirements);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findTransientMemoryType(memRequirements.memoryTypeBits, attachment.lazilyAllocated);
+    if (vkd.vkAllocateMemory(device, &allocInfo, nullptr, &attachment.memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate attachment image memory!");
+    }
+    vkd.vkBindImageMemory(device, attachment.image, attachment.memory, 0);
+    attachment.size = memRequirements.size;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = attachment.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = aspect;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkd.vkCreateImageView(device, &viewInfo, nullptr, &attachment.view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create attachment image view!");
+    }
+}
+
+void VulkanApp::destroyAttachmentImage(AttachmentImage& attachment)
+{
+    vkd.vkDestroyImageView(device, attachment.view, nullptr);
+    vkd.vkDestroyImage(device, attachment.image, nullptr);
+    vkd.vkFreeMemory(device, attachment.memory, nullptr);
+    attachment = AttachmentImage{};
+}
+
+void VulkanApp::createColorResources()
+{
+    // 不开 MSAA 时直接画到交换链图像上；dynamic rendering 路径由 frame graph 创建
+    if (msaaSamples == VK_SAMPLE_COUNT_1_BIT || dynamicRendering.enabled())
+    {
+        return;
+    }
+    createAttachmentImage(swapChainImageFormat, msaaSamples, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, msaaColorTarget);
+}
+
+void VulkanApp::createDepthResources()
+{
+    if (depthFormat == VK_FORMAT_UNDEFINED)
+    {
+        depthFormat = findDepthFormat();
+    }
+    if (dynamicRendering.enabled())
+    {
+        return;
+    }
+    createAttachmentImage(depthFormat, msaaSamples, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, depthTarget);
+}
+
+void VulkanApp::createFrameGraph()
+{
+    if (!dynamicRendering.enabled())
+    {
+        return;
+    }
+    frameColor = frameGraph.importImage("swapchain", VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    RenderGraphResource vertices = frameGraph.importBuffer("vertices", vertexBuffer);
+
+    RenderGraphImageDesc depthDesc;
+    depthDesc.format = depthFormat;
+    depthDesc.extent = swapChainExtent;
+    depthDesc.samples = msaaSamples;
+    depthDesc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    depthDesc.aspect = depthAspectMask();
+    frameDepth = frameGraph.createImage("depth", depthDesc);
+    frameMsaaColor = RenderGraphNoResource;
+    if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+    {
+        RenderGraphImageDesc colorDesc;
+        colorDesc.format = swapChainImageFormat;
+        colorDesc.extent = swapChainExtent;
+        colorDesc.samples = msaaSamples;
+        colorDesc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        frameMsaaColor = frameGraph.createImage("msaa color", colorDesc);
+    }
+
+    // depth pre-pass 单独一个只有深度的 pass，主 pass 接着它的深度画；关掉时被剔除，深度由主 pass 自己 clear
+    framePrePass = frameGraph.addPass("depth pre-pass", [this](VkCommandBuffer commandBuffer) {
+        RenderTargets targets;
+        targets.depth = frameGraph.image(frameDepth);
+        targets.depthView = frameGraph.view(frameDepth);
+        targets.depthAspect = depthAspectMask();
+        targets.storeDepth = true;
+        dynamicRendering.beginRendering(commandBuffer, targets, swapChainExtent, VkClearValue{});
+        recordDepthPrePass(commandBuffer);
+        dynamicRendering.endRendering(commandBuffer);
+    });
+    frameGraph.write(framePrePass, frameDepth, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    frameGraph.read(framePrePass, vertices, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+    RenderGraphPass scene = frameGraph.addPass("scene", [this](VkCommandBuffer commandBuffer) {
+        bool prePass = depthPrePassActive();
+        RenderTargets targets;
+        targets.color = frameGraph.image(frameColor);
+        targets.colorView = frameGraph.view(frameColor);
+        targets.msaaColor = frameGraph.image(frameMsaaColor);
+        targets.msaaColorView = frameGraph.view(frameMsaaColor);
+        targets.depth = frameGraph.image(frameDepth);
+        targets.depthView = frameGraph.view(frameDepth);
+        targets.depthAspect = depthAspectMask();
+        targets.loadDepth = prePass;
+        VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+        dynamicRendering.beginRendering(commandBuffer, targets, swapChainExtent, clearColor);
+        recordScene(commandBuffer, prePass);
+        dynamicRendering.endRendering(commandBuffer);
+    });
+    frameGraph.write(scene, frameColor, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    frameGraph.write(scene, frameMsaaColor, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    frameGraph.write(scene, frameDepth, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    // 声明读深度，pre-pass 打开时它的结果才不会被当成没人用而剔除
+    frameGraph.read(scene, frameDepth, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    frameGraph.read(scene, vertices, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+    frameGraph.allocate(capabilities, device);
+}
+
+void VulkanApp::printAttachmentMemoryReport()
+{
+    // 同样分辨率下各个采样数需要的多重采样颜色 + 深度大小，只查 requirements 不分配
+    VkSampleCountFlags counts = capabilities.limits().framebufferColorSampleCounts & capabilities.limits().framebufferDepthSampleCounts;
+    std::cout << "attachment memory at " << swapChainExtent.width << "x" << swapChainExtent.height << ":" << std::endl;
+    for (uint32_t samples = VK_SAMPLE_COUNT_1_BIT; samples <= VK_SAMPLE_COUNT_64_BIT; samples <<= 1)
+    {
+        if (!(counts & samples))
+        {
+            continue;
+        }
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.samples = static_cast<VkSampleCountFlagBits>(samples);
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkDeviceSize colorSize = 0;
+        VkDeviceSize depthSize = 0;
+        VkImage image;
+        VkMemoryRequirements memRequirements;
+        if (samples > VK_SAMPLE_COUNT_1_BIT)
+        {
+            imageInfo.format = swapChainImageFormat;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            if (vkd.vkCreateImage(device, &imageInfo, nullptr, &image) == VK_SUCCESS)
+            {
+                vkd.vkGetImageMemoryRequirements(device, image, &memRequirements);
+                colorSize = memRequirements.size;
+                vkd.vkDestroyImage(device, image, nullptr);
+            }
+        }
+        imageInfo.format = depthFormat;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        if (vkd.vkCreateImage(device, &imageInfo, nullptr, &image) == VK_SUCCESS)
+        {
+            vkd.vkGetImageMemoryRequirements(device, image, &memRequirements);
+            depthSize = memRequirements.size;
+            vkd.vkDestroyImage(device, image, nullptr);
+        }
+        std::cout << "  " << samples << "x: msaa color " << colorSize / 1024 << " KB, depth " << depthSize / 1024 << " KB"
+            << (samples == msaaSamples ? "  <- in use" : "") << std::endl;
+    }
+
+    // lazily allocated 内存实际提交了多少，tiler 上应该接近 0
+    for (const AttachmentImage* attachment : { &msaaColorTarget, &depthTarget })
+    {
+        if (attachment->memory == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+        VkDeviceSize committed = attachment->size;
+        if (attachment->lazilyAllocated)
+        {
+            vkd.vkGetDeviceMemoryCommitment(device, attachment->memory, &committed);
+        }
+        std::cout << "  " << (attachment == &msaaColorTarget ? "msaa color" : "depth") << ": " << attachment->size / 1024 << " KB requested, "
+            << committed / 1024 << " KB committed" << (attachment->lazilyAllocated ? " (lazily allocated)" : " (device local)") << std::endl;
+    }
+}
+
 void VulkanApp::createRenderPass()
 {
+    if (dynamicRendering.enabled())
+    {
+        return;
+    }
+    if (deferred)
+    {
+        deferredShading.multiPass = deferredMultiPass;
+        deferredShading.createRenderPasses(device, swapChainImageFormat, depthFormat);
+        return;
+    }
+    // 开 MSAA 时 attachment 0 是多重采样图像，只在 subpass 结束时 resolve 到交换链图像，本身不保存
+    bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = swapChainImageFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.samples = msaaSamples;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout= VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    // 深度只在这一帧里用，不需要保存
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = depthFormat;
+    depthAttachment.samples = msaaSamples;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentDescription resolveAttachment{};
+    resolveAttachment.format = swapChainImageFormat;
+    resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resolveAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference resolveAttachmentRef{};
+    resolveAttachmentRef.attachment = 2;
+    resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    if (multisampled)
+    {
+        subpass.pResolveAttachments = &resolveAttachmentRef;
+    }
 
 
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    // 上一帧的深度写完之后才能 clear
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, resolveAttachment };
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = multisampled ? 3 : 2;
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
     
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        if (vkd.vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
             throw std::runtime_error("failed to create render pass!");
         }
     }
 
-void VulkanApp::createGraphicsPipeline()
+void VulkanApp::createGraphicsPipeline(VkFormat colorFormat)
 {
-    auto vertShaderCode = readFile(R"(E:\VsWorkSpace\VulkanTutorial\shaders\vert.spv)");
-    auto fragShaderCode = readFile(R"(E:\VsWorkSpace\VulkanTutorial\shaders\frag.spv)");
-    
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-    
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-    
-    /*std::vector<VkPipelineShaderStageCreateInfo> shaderStages{
-        vertStageInfo, fragStageInfo };*/
-
-   VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+    shaderOptimizer.stripDebugInfo = stripShaderDebugInfo;
+    shaderOptimizer.foldSpecConstants = foldShaderSpecConstants;
+
+    std::vector<ShaderStage> shaderStages;
+    shaderStages.push_back(optimizeShader(loadShader("shader.vert"), "shader.vert"));
+    // deferred 时几何 subpass 只写 G-buffer
+    const char* fragmentShader = deferred ? "gbuffer.frag" : "shader.frag";
+    shaderStages.push_back(optimizeShader(loadShader(fragmentShader), fragmentShader));
+
+    // descriptor set layout、push constant 和顶点输入都从 SPIR-V 反射出来，layout 按内容去重
+    ShaderInterface shaderInterface = reflectShaderStages(shaderStages);
+    pipelineLayout = pipelineLayoutCache.getOrCreate(device, shaderInterface);
+
+    // 所有固定管线状态都写进 key，相同的 key 直接从 cache 里拿，不会再调驱动
+    PipelineStateKey key{};
+    key.shaderHash = hashShaderStages(shaderStages);
+    key.layout = handleBits(pipelineLayout);
+    key.renderPass = handleBits(renderPass);
+    key.subpass = 0;
+    if (deferred)
+    {
+        key.renderPass = handleBits(deferredShading.geometryRenderPass());
+        key.colorAttachmentCount = 2;
+    }
+    if (dynamicRendering.enabled())
+    {
+        key.colorFormat = colorFormat;
+        key.depthFormat = depthFormat;
+    }
 
-    
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    // 顶点输入以 Vertex 的描述为准，反射出来的输入只用来检查：着色器读的每个 location 格式必须一致，
+    // 反射按紧密交错排列推出来的 stride 和缓冲一致时偏移也必须一致。对不上说明着色器和顶点格式只改了一边
     auto bindingDescription = Vertex::getBindingDescription();
     auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    bool checkOffsets = shaderInterface.vertexStride == bindingDescription.stride;
+    for (const auto& reflected : shaderInterface.vertexAttributes)
+    {
+        auto it = std::find_if(attributeDescriptions.begin(), attributeDescriptions.end(),
+            [&](const VkVertexInputAttributeDescription& attribute) { return attribute.location == reflected.location; });
+        if (it == attributeDescriptions.end())
+        {
+            throw std::runtime_error("vertex shader input location " + std::to_string(reflected.location) + " has no Vertex attribute!");
+        }
+        if (it->format != reflected.format || (checkOffsets && it->offset != reflected.offset))
+        {
+            throw std::runtime_error("vertex shader input location " + std::to_string(reflected.location) +
+                " does not match the Vertex attribute (format " + std::to_string(reflected.format) + " vs " + std::to_string(it->format) +
+                ", offset " + std::to_string(reflected.offset) + " vs " + std::to_string(it->offset) + ")!");
+        }
+    }
+    key.setVertexInput(&bindingDescription, 1, attributeDescriptions.data(), static_cast<uint32_t>(attributeDescriptions.size()));
 
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    key.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    key.primitiveRestartEnable = VK_FALSE;
 
+    key.depthClampEnable = VK_FALSE;
+    key.rasterizerDiscardEnable = VK_FALSE;
+    key.polygonMode = VK_POLYGON_MODE_FILL;
+    key.setLineWidth(1.0f);
+    key.cullMode = VK_CULL_MODE_BACK_BIT;
+    key.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    key.depthBiasEnable = VK_FALSE;
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
+    key.rasterizationSamples = msaaSamples;
 
-    /*VkViewport viewPort{};
-    viewPort.x = 0.0f;
-    viewPort.y = 0.0f;
-    viewPort.width = (float)swapChainExtent.width;
-    viewPort.height = (float)swapChainExtent.height;
-    viewPort.minDepth = 0.0f;
-    viewPort.maxDepth = 1.0f;
+    key.depthTestEnable = VK_TRUE;
+    key.depthWriteEnable = VK_TRUE;
+    key.depthCompareOp = VK_COMPARE_OP_LESS;
 
-    VkRect2D scissor{};
-    scissor.offset = { 0,0 };
-    scissor.extent = swapChainExtent;*/
-    
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    // viewportState.pViewports = &viewPort;
-    viewportState.scissorCount = 1;
-    // viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-    
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f; // Optional
-    colorBlending.blendConstants[1] = 0.0f; // Optional
-    colorBlending.blendConstants[2] = 0.0f; // Optional
-    colorBlending.blendConstants[3] = 0.0f; // Optional
+    key.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    key.blendEnable = VK_FALSE;
+    key.logicOpEnable = VK_FALSE;
 
     std::vector<VkDynamicState> dynamicStates = {
     VK_DYNAMIC_STATE_VIEWPORT,
     VK_DYNAMIC_STATE_SCISSOR
     };
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicState.pDynamicStates = dynamicStates.data();
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 0;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
+    key.setDynamicStates(dynamicStates.data(), static_cast<uint32_t>(dynamicStates.size()));
+    key.finalize();
+
+    // 设备支持的话，cull mode、topology、depth、blend 等改成绘制时设置，不同取值共用一个 pipeline
+    graphicsPipelineState = key;
+    graphicsPipelineKey = extendedDynamicState.collapse(key);
+
+    auto compileStart = std::chrono::steady_clock::now();
+    graphicsPipeline = getOrCreatePipeline(graphicsPipelineKey, shaderStages, "graphics pipeline");
+    shaderObjectBackend.recordPipelineCompile(
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count());
+
+    // 先用快速 link 的版本画，后台优化好了再替换；需要的话测一次完整编译的耗时做对比
+    if (graphicsPipelineLibrary.enabled() && benchmarkMonolithicPipeline)
+    {
+        graphicsPipelineLibrary.measureMonolithic(device, graphicsPipelineKey, shaderStages);
+    }
+
+    sceneShaderStages = shaderStages;
+    if (depthPrePass)
+    {
+        createDepthPrePassPipelines();
+    }
+    if (tessellate && !capabilities.features.tessellationShader)
+    {
+        std::cout << "tessellation: not supported" << std::endl;
+        tessellate = false;
+    }
+    if (tessellate && !shaderObjectBackend.enabled())
+    {
+        createTessellationPipeline();
+    }
+
+    if (deferred)
+    {
+        // 光照：全屏三角形，没有顶点输入和深度，G-buffer 从 input attachment 读
+        std::vector<ShaderStage> lightingStages;
+        lightingStages.push_back(optimizeShader(loadShader("lighting.vert"), "lighting.vert"));
+        lightingStages.push_back(optimizeShader(loadShader("lighting.frag"), "lighting.frag"));
+        ShaderInterface lightingInterface = reflectShaderStages(lightingStages);
+        lightingPipelineLayout = pipelineLayoutCache.getOrCreate(device, lightingInterface);
+        lightingSetLayout = pipelineLayoutCache.setLayout(device, lightingInterface, 0);
+
+        PipelineStateKey lightingKey = key;
+        lightingKey.shaderHash = hashShaderStages(lightingStages);
+        lightingKey.layout = handleBits(lightingPipelineLayout);
+        lightingKey.renderPass = handleBits(deferredShading.lightingRenderPass());
+        lightingKey.subpass = static_cast<uint8_t>(deferredShading.lightingSubpass());
+        lightingKey.colorAttachmentCount = 1;
+        lightingKey.setVertexInput(nullptr, 0, nullptr, 0);
+        lightingKey.cullMode = VK_CULL_MODE_NONE;
+        lightingKey.depthTestEnable = VK_FALSE;
+        lightingKey.depthWriteEnable = VK_FALSE;
+        lightingKey.finalize();
+        lightingPipelineState = lightingKey;
+        lightingPipelineKey = extendedDynamicState.collapse(lightingKey);
+        getOrCreatePipeline(lightingPipelineKey, lightingStages, "deferred lighting");
+    }
+
+    if (shaderObjectBackend.enabled())
+    {
+        // shader object 路径：所有阶段各自创建，切换组合时不用再编译 pipeline
+        std::vector<ShaderStage> objectStages = shaderStages;
+        ShaderStage tesc = loadShader("shader.tesc");
+        ShaderStage tese = loadShader("shader.tese");
+        tessellationPermutation.apply(tesc, tese);
+        objectStages.push_back(optimizeShader(tesc, "shader.tesc"));
+        objectStages.push_back(optimizeShader(tese, "shader.tese"));
+        objectStages.push_back(optimizeShader(loadShader("shader.geom"), "shader.geom"));
+        shaderObjectBackend.createShaders(device, objectStages, shaderInterface.pushConstants);
+
+        VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        if (enableTessellation)
+            stages |= VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        if (enableGeometryShader)
+            stages |= VK_SHADER_STAGE_GEOMETRY_BIT;
+        if (!shaderObjectBackend.setStageCombination(stages))
+        {
+            std::cout << "shader object: " << ShaderObjectBackend::stageCombinationName(stages) << " not available, using "
+                << ShaderObjectBackend::stageCombinationName(shaderObjectBackend.stageCombination()) << std::endl;
         }
+    }
+}
+
+void VulkanApp::createTessellationPipeline()
+{
+    // 和 shader object 路径同一份 tesc/tese，细分等级和颜色是 permutation 的 specialization constant，
+    // 常量取值算进 shaderHash，每个 permutation 一个 pipeline，走 cache / library link
+    std::vector<ShaderStage> stages = sceneShaderStages;
+    ShaderStage tesc = loadShader("shader.tesc");
+    ShaderStage tese = loadShader("shader.tese");
+    tessellationPermutation.apply(tesc, tese);
+    stages.push_back(optimizeShader(tesc, "shader.tesc"));
+    stages.push_back(optimizeShader(tese, "shader.tese"));
+
+    PipelineStateKey key = graphicsPipelineState;
+    key.shaderHash = hashShaderStages(stages);
+    key.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+    // shader.tesc 输出 3 个控制点
+    key.patchControlPoints = 3;
+    key.finalize();
+    tessellationState = key;
+    tessellationKey = extendedDynamicState.collapse(key);
+    getOrCreatePipeline(tessellationKey, stages, "graphics pipeline (tessellation)");
+}
+
+void VulkanApp::createDepthPrePassPipelines()
+{
+    // depth pre-pass：只有位置输入、没有 fragment shader、不写颜色
+    std::vector<ShaderStage> depthStages;
+    depthStages.push_back(optimizeShader(loadShader("depth_prepass.vert"), "depth_prepass.vert"));
+    PipelineStateKey depthKey = graphicsPipelineState;
+    depthKey.shaderHash = hashShaderStages(depthStages);
+    // push constant 和主 pass 一样，去重之后是同一个 layout
+    depthKey.layout = handleBits(pipelineLayoutCache.getOrCreate(device, reflectShaderStages(depthStages)));
+    auto bindingDescription = Vertex::getBindingDescription();
+    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    depthKey.setVertexInput(&bindingDescription, 1, attributeDescriptions.data(), 1);
+    depthKey.colorWriteMask = 0;
+    if (depthKey.renderPass == 0)
+    {
+        // dynamic rendering 下 pre-pass 是 frame graph 里单独的 pass，只有深度附件
+        depthKey.colorFormat = VK_FORMAT_UNDEFINED;
+        depthKey.colorAttachmentCount = 0;
+    }
+    depthKey.finalize();
+    depthPrePassState = depthKey;
+    depthPrePassKey = extendedDynamicState.collapse(depthKey);
+    getOrCreatePipeline(depthPrePassKey, depthStages, "depth pre-pass");
+
+    // pre-pass 之后深度已经是最终结果，主 pass 只画深度相等的片元
+    PipelineStateKey equalKey = graphicsPipelineState;
+    equalKey.depthWriteEnable = VK_FALSE;
+    equalKey.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    equalKey.finalize();
+    depthEqualState = equalKey;
+    depthEqualKey = extendedDynamicState.collapse(equalKey);
+    getOrCreatePipeline(depthEqualKey, sceneShaderStages, "graphics pipeline (depth equal)");
+}
+
+VkPipeline VulkanApp::getOrCreatePipeline(const PipelineStateKey& key, const std::vector<ShaderStage>& stages, const std::string& name)
+{
+    bool linked = false;
+    VkPipeline pipeline = pipelineStateCache.getOrCreate(key, [&](const PipelineStateKey& k) {
+        if (graphicsPipelineLibrary.enabled())
+        {
+            linked = true;
+            return graphicsPipelineLibrary.link(device, k, stages);
+        }
+
+        std::vector<VkShaderModule> shaderModules;
+        std::vector<VkPipelineShaderStageCreateInfo> stageInfos;
+        std::vector<VkSpecializationInfo> specInfos;
+        specInfos.reserve(stages.size());
+        for (auto& stage : stages)
+        {
+            VkShaderModule shaderModule = createShaderModule(stage.code);
+            shaderModules.push_back(shaderModule);
+
+            VkPipelineShaderStageCreateInfo stageInfo{};
+            stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stageInfo.stage = stage.stage;
+            stageInfo.module = shaderModule;
+            stageInfo.pName = "main";
+            applySpecialization(stage, stageInfo, specInfos);
+            stageInfos.push_back(stageInfo);
+        }
+
+        PipelineStateCreateInfo state(k);
+        VkGraphicsPipelineCreateInfo pipelineInfo = state.info(stageInfos.data(), static_cast<uint32_t>(stageInfos.size()));
+
+        PipelineFeedback::Capture feedback;
+        pipelineFeedback.attach(feedback, pipelineInfo);
+        VkPipeline created;
+        if (vkd.vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &created) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        pipelineFeedback.record(name, feedback, pipelineInfo);
+
+        for (VkShaderModule shaderModule : shaderModules)
+        {
+            vkd.vkDestroyShaderModule(device, shaderModule, nullptr);
+        }
+        return created;
+    });
+
+    if (linked)
+    {
+        graphicsPipelineLibrary.optimizeInBackground(device, key, pipelineStateCache);
+    }
+    return pipeline;
+}
 
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+void VulkanApp::createPipelineCache()
+{
+    const VkPhysicalDeviceProperties& properties = capabilities.properties;
+    pipelineCacheKey = hashBytes(properties.pipelineCacheUUID, VK_UUID_SIZE);
+    pipelineCacheKey = hashCombine(pipelineCacheKey, (uint64_t)properties.vendorID << 32 | properties.deviceID);
+    pipelineCacheKey = hashCombine(pipelineCacheKey, properties.driverVersion);
+
+    // 驱动会校验数据头，不匹配的数据直接忽略，不会出错；没取到（没有数据或者连接中途断开）时从空的开始
+    std::vector<char> initialData;
+    if (compileDaemon && !compileDaemon->getPipelineCache(pipelineCacheKey, initialData))
+    {
+        initialData.clear();
+    }
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create graphics pipeline!");
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = initialData.size();
+    cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+    if (vkd.vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline cache!");
     }
+    graphicsPipelineLibrary.setPipelineCache(pipelineCache);
+    std::cout << "pipeline cache: " << initialData.size() << " bytes from compile daemon" << std::endl;
+}
 
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+void VulkanApp::savePipelineCache()
+{
+    if (!compileDaemon || !compileDaemon->available())
+    {
+        return;
+    }
+    // 别的进程可能在这之间存过，先把守护进程里现在的数据合并进来，不然后存的会覆盖掉先存的
+    std::vector<char> storedData;
+    if (compileDaemon->getPipelineCache(pipelineCacheKey, storedData))
+    {
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = storedData.size();
+        cacheInfo.pInitialData = storedData.data();
+        VkPipelineCache storedCache;
+        if (vkd.vkCreatePipelineCache(device, &cacheInfo, nullptr, &storedCache) == VK_SUCCESS)
+        {
+            vkd.vkMergePipelineCaches(device, pipelineCache, 1, &storedCache);
+            vkd.vkDestroyPipelineCache(device, storedCache, nullptr);
+        }
     }
 
+    size_t size = 0;
+    vkd.vkGetPipelineCacheData(device, pipelineCache, &size, nullptr);
+    std::vector<char> data(size);
+    if (size > 0 && vkd.vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) == VK_SUCCESS)
+    {
+        data.resize(size);
+        compileDaemon->putPipelineCache(pipelineCacheKey, data);
+    }
+}
+
 void VulkanApp::createFramebuffers()
 {
+    if (dynamicRendering.enabled())
+    {
+        return;
+    }
+    if (deferred)
+    {
+        deferredShading.createAttachments(capabilities, device, swapChainExtent);
+        deferredShading.createFramebuffers(device, swapChainImageViews, depthTarget.view);
+        deferredShading.createDescriptorSet(device, lightingSetLayout);
+        return;
+    }
     swapChainFramebuffers.resize(swapChainImageViews.size());
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        VkImageView attachments[] = {
-            swapChainImageViews[i]
-        };
+        std::vector<VkImageView> attachments = { swapChainImageViews[i], depthTarget.view };
+        if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+        {
+            attachments = { msaaColorTarget.view, depthTarget.view, swapChainImageViews[i] };
+        }
 
         VkFramebufferCreateInfo framebufferInfo{};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
         framebufferInfo.width = swapChainExtent.width;
         framebufferInfo.height = swapChainExtent.height;
         framebufferInfo.layers = 1;
 
-        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+        if (vkd.vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
             throw std::runtime_error("failed to create framebuffer!");
         }
     }
@@ -821,14 +2030,12 @@ void VulkanApp::createFramebuffers()
 
 void VulkanApp::createCommandPool()
 {
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    poolInfo.queueFamilyIndex = capabilities.graphicsFamily.value();
 
-    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+    if (vkd.vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create command pool!");
     }
 }
@@ -842,7 +2049,7 @@ void VulkanApp::createCommandBuffers()
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+    if (vkd.vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate command buffers!");
     }
 }
@@ -851,30 +2058,82 @@ void VulkanApp::createCommandBuffers()
 
 void VulkanApp::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
+    PROFILE_ZONE("recordCommandBuffer");
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     // beginInfo.flags = 0; // Optional
     // beginInfo.pInheritanceInfo = nullptr; // Optional
 
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    if (vkd.vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    // 包住这一帧所有的 pass
+    pipelineStatistics.cmdBegin(device, commandBuffer);
+    frameBottleneck.cmdBegin(commandBuffer, currentFrame);
+    sortDrawOrder();
 
-    renderPassInfo.renderArea.offset = { 0, 0 };
-    renderPassInfo.renderArea.extent = swapChainExtent;
+    if (dynamicRendering.enabled())
+    {
+        // barrier 和布局转换都由 frame graph 按各个 pass 的声明生成
+        frameGraph.setPassEnabled(framePrePass, depthPrePassActive());
+        frameGraph.setImportedImage(frameColor, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+        frameGraph.execute(commandBuffer, barrierBatch);
+    }
+    else if (deferred)
+    {
+        deferredShading.cmdBeginGeometry(commandBuffer, imageIndex, currentFrame);
+        recordScene(commandBuffer);
+        deferredShading.cmdBeginLighting(commandBuffer, imageIndex);
+        // viewport / scissor 是 dynamic state，沿用几何 subpass 里设置的
+        bindPipelineState(commandBuffer, lightingPipelineState, lightingPipelineKey);
+        VkDescriptorSet lightingSet = deferredShading.descriptorSet();
+        vkd.vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipelineLayout, 0, 1, &lightingSet, 0, nullptr);
+        vkd.vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        deferredShading.cmdEnd(commandBuffer, currentFrame);
+    }
+    else
+    {
+        std::array<VkClearValue, 2> clearValues{};
+        clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+        clearValues[1].depthStencil = { 1.0f, 0 };
 
-    VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = swapChainExtent;
+
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+        vkd.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        recordScene(commandBuffer);
+        vkd.vkCmdEndRenderPass(commandBuffer);
+    }
+
+    pipelineStatistics.cmdEnd(commandBuffer);
+    frameBottleneck.cmdEnd(commandBuffer, currentFrame);
+
+    if (vkd.vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
 
+void VulkanApp::sortDrawOrder()
+{
+    // 不透明物体从近到远画，被挡住的片元在 early depth test 就被剔掉
+    drawOrder.resize(sceneDraws.size());
+    std::iota(drawOrder.begin(), drawOrder.end(), 0);
+    if (sortDraws)
+    {
+        std::sort(drawOrder.begin(), drawOrder.end(), [&](uint32_t a, uint32_t b) { return sceneDraws[a].depth < sceneDraws[b].depth; });
+    }
+}
+
+void VulkanApp::setViewportAndScissor(VkCommandBuffer commandBuffer)
+{
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
@@ -882,27 +2141,86 @@ void VulkanApp::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imag
     viewport.height = (float)swapChainExtent.height;
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkd.vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = { 0, 0 };
     scissor.extent = swapChainExtent;
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    vkd.vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+void VulkanApp::recordDepthPrePass(VkCommandBuffer commandBuffer)
+{
+    PROFILE_ZONE("recordDepthPrePass");
+    VkBuffer vertexBuffers[] = { vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    vkd.vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    setViewportAndScissor(commandBuffer);
+    bindPipelineState(commandBuffer, depthPrePassState, depthPrePassKey);
+    drawScene(commandBuffer);
+}
 
+void VulkanApp::recordScene(VkCommandBuffer commandBuffer, bool depthPrepared)
+{
+    PROFILE_ZONE("recordScene");
     VkBuffer vertexBuffers[] = { vertexBuffer };
     VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkd.vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+    bool prePass = depthPrePassActive();
+    if (pipelineStatistics.enabled())
+    {
+        overdrawStatistics.setMode(pipelineStatistics.currentFrame(), (sortDraws ? OverdrawFrontToBack : 0) |
+            (prePass ? OverdrawDepthPrePass : 0) | (deferred ? OverdrawDeferred : 0));
+    }
 
-    vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
+    if (shaderObjectBackend.enabled())
+    {
+        shaderObjectBackend.bind(commandBuffer, graphicsPipelineState, swapChainExtent);
+    }
+    else
+    {
+        setViewportAndScissor(commandBuffer);
 
-    vkCmdEndRenderPass(commandBuffer);
+        if (prePass)
+        {
+            if (!depthPrepared)
+            {
+                bindPipelineState(commandBuffer, depthPrePassState, depthPrePassKey);
+                drawScene(commandBuffer);
+            }
+            bindPipelineState(commandBuffer, depthEqualState, depthEqualKey);
+        }
+        else if (tessellate)
+        {
+            bindPipelineState(commandBuffer, tessellationState, tessellationKey);
+        }
+        else
+        {
+            bindPipelineState(commandBuffer, graphicsPipelineState, graphicsPipelineKey);
+        }
+    }
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+    drawScene(commandBuffer);
+}
+
+void VulkanApp::bindPipelineState(VkCommandBuffer commandBuffer, const PipelineStateKey& state, const PipelineStateKey& key)
+{
+    // 后台 link time optimization 完成后 cache 里的句柄会被替换，每帧重新查一次
+    VkPipeline pipeline = pipelineStateCache.find(key);
+    vkd.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    extendedDynamicState.cmdSetState(commandBuffer, state, key);
+}
+
+void VulkanApp::drawScene(VkCommandBuffer commandBuffer)
+{
+    for (uint32_t index : drawOrder)
+    {
+        vkd.vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &sceneDraws[index]);
+        vkd.vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
     }
 }
+
 void VulkanApp::createSyncObjects()
 {
     imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -916,9 +2234,9 @@ void VulkanApp::createSyncObjects()
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+        if (vkd.vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+            vkd.vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+            vkd.vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
 
             throw std::runtime_error("failed to create synchronization objects for a frame!");
         }
@@ -926,9 +2244,28 @@ void VulkanApp::createSyncObjects()
 }
 
 void VulkanApp::drawFrame() {
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    PROFILE_ZONE("drawFrame");
+    auto frameStart = std::chrono::steady_clock::now();
+    FrameTimings timings;
+    {
+        PROFILE_ZONE("waitForFence");
+        vkd.vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    }
+    timings.fenceWaitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    {
+        PROFILE_ZONE("collectQueries");
+        overdrawStatistics.collect(pipelineStatistics, (uint64_t)swapChainExtent.width * swapChainExtent.height);
+        deferredShading.collect(device, currentFrame);
+        frameBottleneck.collect(device, currentFrame);
+    }
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult result;
+    {
+        PROFILE_ZONE("acquireNextImage");
+        auto acquireStart = std::chrono::steady_clock::now();
+        result = vkd.vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        timings.acquireMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - acquireStart).count();
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         recreateSwapChain();
@@ -937,9 +2274,12 @@ void VulkanApp::drawFrame() {
     else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("failed to acquire swap chain image!");
     }
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
-    vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
+    vkd.vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    vkd.vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
+    auto recordStart = std::chrono::steady_clock::now();
     recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    timings.recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+    dynamicRendering.recordFrame(!dynamicRendering.enabled(), timings.recordMs * 1000.0);
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -957,8 +2297,11 @@ void VulkanApp::drawFrame() {
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    {
+        PROFILE_ZONE("queueSubmit");
+        if (vkd.vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
     }
 
     VkPresentInfoKHR presentInfo{};
@@ -973,7 +2316,18 @@ void VulkanApp::drawFrame() {
 
     presentInfo.pImageIndices = &imageIndex;
 
-    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    {
+        PROFILE_ZONE("queuePresent");
+        auto presentStart = std::chrono::steady_clock::now();
+        result = vkd.vkQueuePresentKHR(presentQueue, &presentInfo);
+        timings.presentMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - presentStart).count();
+    }
+    if ((result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) && !startup.firstPresentDone())
+    {
+        startup.markFirstPresent();
+        // 初始化、启动 benchmark 和第一帧都算启动阶段
+        ApiCallCounter::endStartup();
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
         framebufferResized = false;
@@ -982,6 +2336,10 @@ void VulkanApp::drawFrame() {
     else if (result != VK_SUCCESS) {
         throw std::runtime_error("failed to present swap chain image!");
     }
+    timings.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count() - timings.fenceWaitMs;
+    frameStatistics.recordFrame(timings);
+    frameBottleneck.recordFrame(currentFrame, timings);
+    ApiCallCounter::endFrame();
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
@@ -993,64 +2351,74 @@ void VulkanApp::createVertexBuffer()
     bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    if (vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer) != VK_SUCCESS) {
+    if (vkd.vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to create vertex buffer!");
     }
 
     VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, vertexBuffer, &memRequirements);
+    vkd.vkGetBufferMemoryRequirements(device, vertexBuffer, &memRequirements);
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &vertexBufferMemory) != VK_SUCCESS) {
+    if (vkd.vkAllocateMemory(device, &allocInfo, nullptr, &vertexBufferMemory) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate vertex buffer memory!");
     }
-    vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
+    vkd.vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
     void* data;
-    vkMapMemory(device, vertexBufferMemory, 0, bufferInfo.size, 0, &data);
+    vkd.vkMapMemory(device, vertexBufferMemory, 0, bufferInfo.size, 0, &data);
     memcpy(data, vertices.data(), (size_t)bufferInfo.size);
-    vkUnmapMemory(device, vertexBufferMemory);
+    vkd.vkUnmapMemory(device, vertexBufferMemory);
 }
 
 uint32_t VulkanApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
-        }
+    uint32_t memoryType = capabilities.findMemoryType(typeFilter, properties);
+    if (memoryType == ~0u) {
+        throw std::runtime_error("failed to find suitable memory type!");
     }
-    throw std::runtime_error("failed to find suitable memory type!");
+    return memoryType;
 }
 
 void VulkanApp::recreateSwapChain()
 {
+    PROFILE_ZONE("recreateSwapChain");
     int width = 0, height = 0;
     glfwGetFramebufferSize(window, &width, &height);
     while (width == 0 || height == 0) {
         glfwGetFramebufferSize(window, &width, &height);
         glfwWaitEvents();
     }
-    vkDeviceWaitIdle(device);
+    vkd.vkDeviceWaitIdle(device);
 
+    // dynamic rendering 路径下 createFramebuffers 什么都不做，只重建 image view 和深度
+    auto start = std::chrono::steady_clock::now();
     cleanupSwapChain();
     createSwapChain();
     createImageViews();
+    createColorResources();
+    createDepthResources();
     createFramebuffers();
+    createFrameGraph();
+    dynamicRendering.recordResize(!dynamicRendering.enabled(),
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 }
 
 void VulkanApp::cleanupSwapChain()
 {
     for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-        vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
+        vkd.vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
     }
 
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        vkDestroyImageView(device, swapChainImageViews[i], nullptr);
+        vkd.vkDestroyImageView(device, swapChainImageViews[i], nullptr);
     }
 
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    destroyAttachmentImage(msaaColorTarget);
+    destroyAttachmentImage(depthTarget);
+    frameGraph.destroy(device);
+    deferredShading.destroySwapChainResources(device);
+
+    vkd.vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
 VkSurfaceFormatKHR VulkanApp::chooseSwapSurfaceFormat(SwapChainSupportDetails details)
@@ -1096,27 +2464,13 @@ VkExtent2D VulkanApp::chooseSwapExtent(SwapChainSupportDetails details)
     }
 }
 
-SwapChainSupportDetails VulkanApp::querySwapChainSupport(VkPhysicalDevice physicalDevice)
+SwapChainSupportDetails VulkanApp::querySwapChainSupport()
 {
+    // 格式和 present mode 不会变，用快照；capabilities 里的 currentExtent 跟着窗口变，重新查
     SwapChainSupportDetails details;
-    if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &details.capabilities) != VK_SUCCESS)
-    {
-        std::cerr << "query swap chain capabilities failed";
-    }
-    uint32_t formatCount;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, nullptr);
-    if (formatCount > 0)
-    {
-        details.formats.resize(formatCount);
-        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, details.formats.data());
-    }
-    uint32_t presentModeCount;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
-    if (presentModeCount > 0)
-    {
-        details.presentModes.resize(presentModeCount);
-        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, details.presentModes.data());
-    }
+    details.capabilities = capabilities.surfaceCapabilities();
+    details.formats = capabilities.surfaceFormats;
+    details.presentModes = capabilities.presentModes;
     return details;
 }
 
@@ -1187,22 +2541,121 @@ VkResult VulkanApp::destroyDebugUtilsMessengerEXT(
     fun(instance, debugMessenger, pAllocator);
 }
 
-VkShaderModule VulkanApp::createShaderModule(std::vector<char>& code)
+VkShaderModule VulkanApp::createShaderModule(const std::vector<char>& code)
 {
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.codeSize = code.size();
     createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
     VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    if (vkd.vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
     {
         throw std::runtime_error("can't create shader module!");
     }
     return shaderModule;
 }
 
-int main()
+static VkShaderStageFlagBits shaderStageFromFile(const std::string& source)
+{
+    std::string extension = source.substr(source.rfind('.') + 1);
+    if (extension == "vert") return VK_SHADER_STAGE_VERTEX_BIT;
+    if (extension == "tesc") return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    if (extension == "tese") return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    if (extension == "geom") return VK_SHADER_STAGE_GEOMETRY_BIT;
+    if (extension == "frag") return VK_SHADER_STAGE_FRAGMENT_BIT;
+    throw std::runtime_error("unknown shader stage for " + source);
+}
+
+void VulkanApp::requestShader(const std::string& source)
+{
+    if (pendingShaders.count(source))
+    {
+        return;
+    }
+    VkShaderStageFlagBits stage = shaderStageFromFile(source);
+    if (shaderCompiler)
+    {
+        pendingShaders[source] = shaderCompiler->compileAsync(stage, source);
+        return;
+    }
+
+    // 预编译的文件名是 compile.bat 里的 vert.spv / frag.spv ...，shader.* 以外的是 <名字>_<阶段>.spv
+    std::string baseName = source.substr(0, source.rfind('.'));
+    std::string spvName = (baseName == "shader" ? "" : baseName + "_") + source.substr(source.rfind('.') + 1) + ".spv";
+    std::promise<ShaderStage> loaded;
+    loaded.set_value(ShaderStage(stage, readFile(ShaderDir + spvName)));
+    pendingShaders[source] = loaded.get_future();
+}
+
+ShaderStage VulkanApp::loadShader(const std::string& source)
+{
+    requestShader(source);
+    auto it = pendingShaders.find(source);
+    ShaderStage stage = it->second.get();
+    pendingShaders.erase(it);
+    return stage;
+}
+
+ShaderStage VulkanApp::optimizeShader(const ShaderStage& stage, const std::string& source)
+{
+    if (!enableShaderOptimizer)
+    {
+        return stage;
+    }
+    return shaderOptimizer.optimize(stage, source);
+}
+
+int main(int argc, char** argv)
 {
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--shader-object") == 0)
+        {
+            enableShaderObject = true;
+        }
+        else if (std::strcmp(argv[i], "--tessellation") == 0)
+        {
+            enableTessellation = true;
+        }
+        else if (std::strcmp(argv[i], "--geometry-shader") == 0)
+        {
+            enableGeometryShader = true;
+        }
+        else if (std::strcmp(argv[i], "--dynamic-rendering") == 0)
+        {
+            enableDynamicRendering = true;
+        }
+        else if (std::strcmp(argv[i], "--deferred") == 0)
+        {
+            enableDeferredShading = true;
+        }
+        else if (std::strcmp(argv[i], "--deferred-multipass") == 0)
+        {
+            enableDeferredShading = true;
+            deferredMultiPass = true;
+        }
+        else if (std::strcmp(argv[i], "--profile") == 0)
+        {
+            enableProfiler = true;
+        }
+        else if (std::strcmp(argv[i], "--count-api-calls") == 0)
+        {
+            countApiCalls = true;
+        }
+        else if (std::strcmp(argv[i], "--check-profile") == 0)
+        {
+            checkVulkanProfile = true;
+        }
+        else if (std::strcmp(argv[i], "--serial-startup") == 0)
+        {
+            parallelStartup = false;
+        }
+        else if (std::strcmp(argv[i], "--benchmark-monolithic") == 0)
+        {
+            benchmarkMonolithicPipeline = true;
+        }
+    }
+
     VulkanApp app;
     try
     {